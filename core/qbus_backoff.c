@@ -0,0 +1,351 @@
+#include "qbus_backoff.h"
+
+// cape includes
+#include "sys/cape_log.h"
+#include "sys/cape_mutex.h"
+#include "aio/cape_aio_timer.h"
+
+// c includes
+#include <time.h>
+
+#if defined __WINDOWS_OS
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+#define QBUS_BACKOFF_INITIAL      100
+#define QBUS_BACKOFF_MAX          10000
+#define QBUS_BACKOFF_MULTIPLIER   2.0
+#define QBUS_BACKOFF_JITTER       0.2
+
+//-----------------------------------------------------------------------------
+
+struct QBusBackoff_s
+{
+  number_t initial;       // delay after the immediate retry in ms
+  
+  number_t max;           // upper limit of the delay in ms
+  
+  double multiplier;
+  
+  double jitter;          // part of the delay which is randomized
+  
+  number_t attempt;
+  
+  double delay;
+  
+  unsigned int seed;
+  
+  // the state is changed by the AIO threads and by the owner of the engine
+  CapeMutex mutex;
+  
+  number_t refcnt;        // the owner and every pending timer
+  
+  int canceled;           // the owner is gone, pending timers must not call back
+  
+  number_t running;       // callbacks of timers which are running right now
+};
+
+//-----------------------------------------------------------------------------
+
+QBusBackoff qbus_backoff_new (void)
+{
+  QBusBackoff self = CAPE_NEW (struct QBusBackoff_s);
+  
+  self->initial = QBUS_BACKOFF_INITIAL;
+  self->max = QBUS_BACKOFF_MAX;
+  self->multiplier = QBUS_BACKOFF_MULTIPLIER;
+  self->jitter = QBUS_BACKOFF_JITTER;
+  
+  self->attempt = 0;
+  self->delay = 0;
+  
+  // every instance must run out of step with the others
+  self->seed = (unsigned int)time (NULL) ^ (unsigned int)(number_t)self;
+  
+  if (self->seed == 0)
+  {
+    self->seed = 1;
+  }
+  
+  self->mutex = cape_mutex_new ();
+  
+  self->refcnt = 1;
+  self->canceled = FALSE;
+  self->running = 0;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_backoff__dec (QBusBackoff self)
+{
+  if (__atomic_sub_fetch (&(self->refcnt), 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    cape_mutex_del (&(self->mutex));
+    
+    CAPE_DEL (&self, struct QBusBackoff_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_backoff_del (QBusBackoff* p_self)
+{
+  if (*p_self)
+  {
+    QBusBackoff self = *p_self;
+    
+    *p_self = NULL;
+    
+    cape_mutex_lock (self->mutex);
+    
+    self->canceled = TRUE;
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // a running retry still uses the engine
+    for (;;)
+    {
+      number_t running;
+      
+      cape_mutex_lock (self->mutex);
+      
+      running = self->running;
+      
+      cape_mutex_unlock (self->mutex);
+      
+      if (running == 0)
+      {
+        break;
+      }
+      
+#if defined __WINDOWS_OS
+      Sleep (0);
+#else
+      sched_yield ();
+#endif
+    }
+    
+    // pending timers keep the memory until they fire
+    qbus_backoff__dec (self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_backoff_config (QBusBackoff self, CapeUdc remote)
+{
+  CapeUdc node = cape_udc_get (remote, "backoff");
+  
+  if (node == NULL)
+  {
+    return;
+  }
+  
+  cape_mutex_lock (self->mutex);
+  
+  self->initial = cape_udc_get_n (node, "initial", self->initial);
+  self->max = cape_udc_get_n (node, "max", self->max);
+  self->multiplier = cape_udc_get_f (node, "multiplier", self->multiplier);
+  self->jitter = cape_udc_get_f (node, "jitter", self->jitter);
+  
+  if (self->initial < 1)
+  {
+    self->initial = 1;
+  }
+  
+  if (self->max < self->initial)
+  {
+    self->max = self->initial;
+  }
+  
+  if (self->multiplier < 1.0)
+  {
+    self->multiplier = 1.0;
+  }
+  
+  if (self->jitter < 0.0 || self->jitter > 1.0)
+  {
+    cape_log_fmt (CAPE_LL_WARN, "QBUS", "backoff", "jitter %f out of range, use %f", self->jitter, QBUS_BACKOFF_JITTER);
+    
+    self->jitter = QBUS_BACKOFF_JITTER;
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static double qbus_backoff__random (QBusBackoff self)
+{
+  // xorshift, good enough to spread the clients
+  unsigned int x = self->seed;
+  
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  
+  self->seed = x;
+  
+  return (double)x / 4294967296.0;
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_backoff_next (QBusBackoff self)
+{
+  number_t delay;
+  
+  cape_mutex_lock (self->mutex);
+  
+  self->attempt++;
+  
+  if (self->attempt == 1)
+  {
+    // the remote might be back already (failover), retry with the next loop
+    delay = 1;
+    goto exit_and_cleanup;
+  }
+  
+  if (self->attempt == 2)
+  {
+    self->delay = self->initial;
+  }
+  else
+  {
+    self->delay = self->delay * self->multiplier;
+    
+    if (self->delay > self->max)
+    {
+      self->delay = self->max;
+    }
+  }
+  
+  // remove a random part, never exceed the maximum
+  delay = (number_t)(self->delay * (1.0 - self->jitter * qbus_backoff__random (self)));
+  
+  if (delay < 1)
+  {
+    delay = 1;
+  }
+  
+exit_and_cleanup:
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return delay;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_backoff_reset (QBusBackoff self)
+{
+  cape_mutex_lock (self->mutex);
+  
+  self->attempt = 0;
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusBackoff backoff;    // holds a reference
+  
+  void* ptr;
+  
+  fct_qbus_backoff_onRetry onRetry;
+  
+} QBusBackoffTimer;
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_backoff__on_timer (void* ptr)
+{
+  QBusBackoffTimer* timer = ptr;
+  QBusBackoff self = timer->backoff;
+  
+  int canceled;
+  
+  cape_mutex_lock (self->mutex);
+  
+  canceled = self->canceled;
+  
+  if (!canceled)
+  {
+    self->running++;
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  if (!canceled)
+  {
+    timer->onRetry (timer->ptr);
+    
+    cape_mutex_lock (self->mutex);
+    
+    self->running--;
+    
+    cape_mutex_unlock (self->mutex);
+  }
+  
+  qbus_backoff__dec (self);
+  
+  CAPE_DEL (&timer, QBusBackoffTimer);
+  
+  // remove the timer
+  return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_backoff_schedule (QBusBackoff self, CapeAioContext aio, void* ptr, fct_qbus_backoff_onRetry onRetry, CapeErr err)
+{
+  int res;
+  
+  QBusBackoffTimer* ctx;
+  CapeAioTimer timer = cape_aio_timer_new ();
+  
+  // the delay grows with every failed attempt
+  number_t delay = qbus_backoff_next (self);
+  
+  cape_log_fmt (CAPE_LL_TRACE, "QBUS", "backoff", "next attempt in %li ms", delay);
+  
+  ctx = CAPE_NEW (QBusBackoffTimer);
+  
+  ctx->backoff = self;
+  ctx->ptr = ptr;
+  ctx->onRetry = onRetry;
+  
+  __atomic_add_fetch (&(self->refcnt), 1, __ATOMIC_RELAXED);
+  
+  res = cape_aio_timer_set (timer, delay, ctx, qbus_backoff__on_timer, err);
+  if (res)
+  {
+    goto exit_and_cleanup;
+  }
+  
+  res = cape_aio_timer_add (&timer, aio);
+  if (res)
+  {
+    goto exit_and_cleanup;
+  }
+  
+  return CAPE_ERR_NONE;
+  
+exit_and_cleanup:
+  
+  qbus_backoff__dec (self);
+  
+  CAPE_DEL (&ctx, QBusBackoffTimer);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,39 @@
+#ifndef __QBUS__BACKOFF__H
+#define __QBUS__BACKOFF__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_types.h"
+#include "sys/cape_err.h"
+#include "stc/cape_udc.h"
+#include "aio/cape_aio_ctx.h"
+
+//=============================================================================
+
+struct QBusBackoff_s; typedef struct QBusBackoff_s* QBusBackoff;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   QBusBackoff       qbus_backoff_new         (void);
+
+                 // pending attempts are dropped, waits for an attempt which is running right now
+__CAPE_LIBEX   void              qbus_backoff_del         (QBusBackoff*);
+
+                 // reads the 'backoff' node of a remote: initial, max (ms), multiplier, jitter (0.0 - 1.0)
+__CAPE_LIBEX   void              qbus_backoff_config      (QBusBackoff, CapeUdc remote);
+
+                 // returns the delay in ms for the next reconnect attempt, the first attempt is immediate (1 ms)
+__CAPE_LIBEX   number_t          qbus_backoff_next        (QBusBackoff);
+
+                 // the remote is alive again
+__CAPE_LIBEX   void              qbus_backoff_reset       (QBusBackoff);
+
+//-----------------------------------------------------------------------------
+
+typedef void (__STDCALL *fct_qbus_backoff_onRetry) (void* ptr);
+
+                 // calls onRetry after the delay of qbus_backoff_next, not anymore if the backoff was deleted meanwhile
+__CAPE_LIBEX   int               qbus_backoff_schedule    (QBusBackoff, CapeAioContext aio, void* ptr, fct_qbus_backoff_onRetry, CapeErr);
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,315 @@
+// memfd_create
+#define _GNU_SOURCE
+
+#include "qbus_blob.h"
+
+// cape includes
+#include "sys/cape_log.h"
+
+// c includes
+#if defined __LINUX_OS || defined __BSD_OS
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#endif
+
+#if defined __LINUX_OS
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+#define QBUS_BLOB_CHUNK        65536
+
+// content up to this size is kept in memory, bigger files go to TMPDIR
+#define QBUS_BLOB_MEMFD_MAX    262144
+
+//-----------------------------------------------------------------------------
+
+int qbus_blob_open (const CapeString path, number_t* p_size, CapeErr err)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  struct stat st;
+  
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+  
+  if (fd < 0)
+  {
+    cape_err_lastOSError (err);
+    return -1;
+  }
+  
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode))
+  {
+    cape_err_set_fmt (err, CAPE_ERR_WRONG_VALUE, "not a regular file: %s", path);
+    
+    close (fd);
+    return -1;
+  }
+  
+  *p_size = st.st_size;
+  
+  return fd;
+  
+#else
+  
+  cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "blobs are not supported");
+  return -1;
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_blob_create (number_t size, CapeString* p_path, CapeErr err)
+{
+#if defined __LINUX_OS
+  
+  if (size <= QBUS_BLOB_MEMFD_MAX)
+  {
+    // a small anonymous file in memory, nothing is left on disk
+    int fd = memfd_create ("qbus_blob", MFD_CLOEXEC);
+    
+    if (fd >= 0)
+    {
+      return fd;
+    }
+  }
+  
+#endif
+  
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  {
+    int fd;
+    
+    const char* dir = getenv ("TMPDIR");
+    
+    CapeString path = cape_str_fmt ("%s/qbus_blob_XXXXXX", dir ? dir : "/tmp");
+    
+    // replaces the placeholder with a unique name
+    fd = mkstemp (path);
+    
+    if (fd < 0)
+    {
+      cape_err_lastOSError (err);
+      
+      cape_str_del (&path);
+      return -1;
+    }
+    
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+    
+    cape_str_replace_mv (p_path, &path);
+    
+    return fd;
+  }
+  
+#else
+  
+  cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "blobs are not supported");
+  return -1;
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_blob_write (int fd, const char* bufdat, number_t buflen, CapeErr err)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  while (buflen > 0)
+  {
+    ssize_t len = write (fd, bufdat, buflen);
+    
+    if (len < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      
+      return cape_err_lastOSError (err);
+    }
+    
+    bufdat += len;
+    buflen -= len;
+  }
+  
+  return CAPE_ERR_NONE;
+  
+#else
+  
+  return cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "blobs are not supported");
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_blob_close (int* p_fd)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  if (*p_fd >= 0)
+  {
+    close (*p_fd);
+  }
+  
+#endif
+  
+  *p_fd = -1;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_blob_discard (int* p_fd, CapeString* p_path)
+{
+  qbus_blob_close (p_fd);
+  
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  if (*p_path)
+  {
+    unlink (*p_path);
+  }
+  
+#endif
+  
+  cape_str_del (p_path);
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_blob_send (int sock, int fd, number_t offset, number_t size)
+{
+#if defined __LINUX_OS
+  
+  off_t off = offset;
+  
+  ssize_t len = sendfile (sock, fd, &off, size);
+  
+  if (len < 0)
+  {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  
+  return len;
+  
+#elif defined __BSD_OS
+  
+  char buffer[QBUS_BLOB_CHUNK];
+  
+  ssize_t len = pread (fd, buffer, size < QBUS_BLOB_CHUNK ? size : QBUS_BLOB_CHUNK, offset);
+  
+  if (len <= 0)
+  {
+    return -1;
+  }
+  
+  len = send (sock, buffer, len, 0);
+  
+  if (len < 0)
+  {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  
+  return len;
+  
+#else
+  
+  return -1;
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  int fd;
+  
+  CapeString path;           // only set for named temporary files
+  
+} QBusBlobsItem;
+
+//-----------------------------------------------------------------------------
+
+struct QBusBlobs_s
+{
+  CapeList items;
+};
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_blobs__items_onDel (void* ptr)
+{
+  QBusBlobsItem* item = ptr;
+  
+  qbus_blob_discard (&(item->fd), &(item->path));
+  
+  CAPE_DEL (&item, QBusBlobsItem);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusBlobs qbus_blobs_new (void)
+{
+  QBusBlobs self = CAPE_NEW (struct QBusBlobs_s);
+  
+  self->items = cape_list_new (qbus_blobs__items_onDel);
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_blobs_del (QBusBlobs* p_self)
+{
+  if (*p_self)
+  {
+    QBusBlobs self = *p_self;
+    
+    cape_list_del (&(self->items));
+    
+    CAPE_DEL (p_self, struct QBusBlobs_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+CapeString qbus_blobs_add (QBusBlobs self, int fd, CapeString* p_path)
+{
+  QBusBlobsItem* item = CAPE_NEW (QBusBlobsItem);
+  
+  item->fd = fd;
+  item->path = NULL;
+  
+  if (p_path)
+  {
+    cape_str_replace_mv (&(item->path), p_path);
+  }
+  
+  cape_list_push_back (self->items, item);
+  
+  if (item->path)
+  {
+    return cape_str_cp (item->path);
+  }
+  
+  // the content stays reachable as long as we keep the handle open
+  // but the path is only valid inside this process
+  return cape_str_fmt ("/proc/self/fd/%i", fd);
+}
+
+//-----------------------------------------------------------------------------
+
@@ -0,0 +1,50 @@
+#ifndef __QBUS__BLOB__H
+#define __QBUS__BLOB__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_types.h"
+#include "sys/cape_err.h"
+#include "stc/cape_str.h"
+#include "stc/cape_list.h"
+
+//=============================================================================
+
+                 // opens a file for sending, returns the handle or -1
+__CAPE_LIBEX   int               qbus_blob_open           (const CapeString path, number_t* p_size, CapeErr);
+
+                 // creates a new temporary file for received content, returns the handle or -1
+                 // small content is kept in memory on linux, otherwise a named file in TMPDIR is used
+                 // the path is only set if the file has a name and needs to be removed
+__CAPE_LIBEX   int               qbus_blob_create         (number_t size, CapeString* p_path, CapeErr);
+
+                 // appends received content to a temporary file
+__CAPE_LIBEX   int               qbus_blob_write          (int fd, const char* bufdat, number_t buflen, CapeErr);
+
+__CAPE_LIBEX   void              qbus_blob_close          (int* p_fd);
+
+                 // closes and removes an incomplete temporary file
+__CAPE_LIBEX   void              qbus_blob_discard        (int* p_fd, CapeString* p_path);
+
+//-----------------------------------------------------------------------------
+
+                 // sends a part of a file to a non blocking socket without copying it into user space
+                 // returns the bytes sent, 0 if the socket is not writable or -1 on error
+__CAPE_LIBEX   number_t          qbus_blob_send           (int sock, int fd, number_t offset, number_t size);
+
+//-----------------------------------------------------------------------------
+
+struct QBusBlobs_s; typedef struct QBusBlobs_s* QBusBlobs;
+
+                 // owns the received files of a message, the handles are closed and temporary files are removed with it
+__CAPE_LIBEX   QBusBlobs         qbus_blobs_new           (void);
+
+__CAPE_LIBEX   void              qbus_blobs_del           (QBusBlobs*);
+
+                 // takes over the handle and the path of a temporary file, returns the path to read the content
+                 // files without a name are returned as /proc/self/fd/N, which is only valid inside this process
+                 // all paths are only valid as long as the message is alive
+__CAPE_LIBEX   CapeString        qbus_blobs_add           (QBusBlobs, int fd, CapeString* p_path);
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -1,10 +1,50 @@
 #include "qbus_core.h"
 #include "qbus_frame.h"
+#include "qbus_blob.h"
 
 // cape includes
 #include "stc/cape_list.h"
 #include "sys/cape_mutex.h"
+#include "sys/cape_log.h"
 #include "stc/cape_stream.h"
+#include "fmt/cape_json.h"
+
+// c includes
+#include <stdlib.h>
+
+#if defined __WINDOWS_OS
+#include <windows.h>
+#else
+#include <time.h>
+#include <sched.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+struct QBusShared_s
+{
+  CapeStream cs;
+  
+  number_t refcnt;
+};
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  CapeStream cs;             // encoded data, NULL for the content of a file
+  
+  QBusShared shared;         // encoded data for several connections, instead of cs
+  
+  QBusFrame frame;           // passed as it is to engines with fct_frame
+  
+  int fd;                    // file which is sent by the engine, -1 if not used
+  
+  number_t offset;
+  
+  number_t left;
+  
+} QBusConnectionItem;
 
 //-----------------------------------------------------------------------------
 
@@ -19,25 +59,129 @@ struct QBusConnection_s
   fct_qbus_connection_send fct_send;
   
   fct_qbus_connection_mark fct_mark;
+  
+  fct_qbus_connection_frame fct_frame;   // optional, frames are passed without encoding
+  
+  fct_qbus_connection_close fct_close;   // optional, drops the connection from our side
+  
+  fct_qbus_connection_blob fct_blob;     // optional, sends the content of files
+  
+  fct_qbus_connection_fetch fct_fetch;   // optional, file handles are passed instead of the content
+  
+  void* blob_ptr;
 
   CapeString ident;
   
-  // income
+  // income, only touched by the thread the AIO subsystem handed the socket to
   
   QBusFrame frame;
+  
+  QBusConnection cut_conn;   // reference, outgoing connection for the payload
+  
+  number_t cut_left;
+  
+  int blob_fd;               // temporary file for the content of a blob
+  
+  number_t blob_left;
+  
+  CapeString blob_path;
+  
+  CapeUdc blob_files;        // received files for the next message, index -> local path
+  
+  QBusBlobs blobs;           // owns the received files until the message takes them
 
   // out 
   
   CapeList cache_qeue;
   
   CapeMutex mutex;  
+  
+  int cut_active;            // the queue is reserved for a frame passed through
+  
+  CapeList cut_hold;         // frames waiting until the pass through has finished
+  
+  QBusConnectionItem* blob_out;   // only touched by the sending thread of the AIO subsystem
+  
+  // heartbeat
+  
+  number_t hb_missed;        // heartbeat intervals without any received data
+  
+  number_t rtt;              // last measured round trip time in ms
+  
+  // lifetime
+  
+  number_t refcnt;           // the engine holds the first reference
+  
+  int closed;                // the engine is done, its callbacks must not be called anymore
+  
+  number_t busy;             // callbacks of the engine which are running right now
 };
 
 //-----------------------------------------------------------------------------
 
+static QBusConnectionItem* qbus_connection_item_new (CapeStream* p_cs, int fd, number_t size)
+{
+  QBusConnectionItem* self = CAPE_NEW (QBusConnectionItem);
+  
+  self->cs = p_cs ? *p_cs : NULL;
+  self->shared = NULL;
+  self->frame = NULL;
+  self->fd = fd;
+  self->offset = 0;
+  self->left = size;
+  
+  if (p_cs)
+  {
+    *p_cs = NULL;
+  }
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
 static void __STDCALL qbus_connection_cache_onDel (void* ptr)
 {
-  CapeStream cs = ptr; cape_stream_del (&cs);
+  QBusConnectionItem* self = ptr;
+  
+  cape_stream_del (&(self->cs));
+  qbus_shared_del (&(self->shared));
+  qbus_frame_del (&(self->frame));
+  qbus_blob_close (&(self->fd));
+  
+  CAPE_DEL (&self, QBusConnectionItem);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusShared qbus_shared_new (CapeStream* p_cs)
+{
+  QBusShared self = CAPE_NEW (struct QBusShared_s);
+  
+  self->cs = *p_cs;
+  *p_cs = NULL;
+  
+  self->refcnt = 1;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_shared_del (QBusShared* p_self)
+{
+  QBusShared self = *p_self;
+  
+  *p_self = NULL;
+  
+  if (self == NULL || __atomic_sub_fetch (&(self->refcnt), 1, __ATOMIC_ACQ_REL))
+  {
+    return;
+  }
+  
+  cape_stream_del (&(self->cs));
+  
+  CAPE_DEL (&self, struct QBusShared_s);
 }
 
 //-----------------------------------------------------------------------------
@@ -49,31 +193,159 @@ QBusConnection qbus_connection_new (QBusRoute route, number_t channels)
   self->cache_qeue = cape_list_new (qbus_connection_cache_onDel);
   self->mutex = cape_mutex_new (); 
   
+  self->cut_conn = NULL;
+  self->cut_left = 0;
+  self->cut_active = FALSE;
+  self->cut_hold = cape_list_new (qbus_connection_cache_onDel);
+  
+  self->blob_fd = -1;
+  self->blob_left = 0;
+  self->blob_path = NULL;
+  self->blob_files = NULL;
+  self->blobs = NULL;
+  self->blob_out = NULL;
+  
   // initial frame
   self->frame = qbus_frame_new ();
   
   self->route = route;
   self->ident = NULL;
   
+  self->fct_frame = NULL;
+  self->fct_close = NULL;
+  self->fct_blob = NULL;
+  self->fct_fetch = NULL;
+  self->blob_ptr = NULL;
+  
+  self->hb_missed = 0;
+  self->rtt = 0;
+  
+  self->refcnt = 1;
+  self->closed = FALSE;
+  self->busy = 0;
+  
   return self;
 }
 
 //-----------------------------------------------------------------------------
 
+static int qbus_connection__enter (QBusConnection self)
+{
+  __atomic_add_fetch (&(self->busy), 1, __ATOMIC_SEQ_CST);
+  
+  if (__atomic_load_n (&(self->closed), __ATOMIC_SEQ_CST))
+  {
+    // the engine might have released the socket already
+    __atomic_sub_fetch (&(self->busy), 1, __ATOMIC_SEQ_CST);
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection__leave (QBusConnection self)
+{
+  __atomic_sub_fetch (&(self->busy), 1, __ATOMIC_SEQ_CST);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection__mark (QBusConnection self)
+{
+  if (qbus_connection__enter (self))
+  {
+    // trigger the underlaying engine to process the buffer
+    self->fct_mark (self->ptr1, self->ptr2);
+    
+    qbus_connection__leave (self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection__wait (QBusConnection self)
+{
+  __atomic_store_n (&(self->closed), TRUE, __ATOMIC_SEQ_CST);
+  
+  // other threads might still be inside of a callback of the engine
+  while (__atomic_load_n (&(self->busy), __ATOMIC_SEQ_CST))
+  {
+#if defined __WINDOWS_OS
+    Sleep (0);
+#else
+    sched_yield ();
+#endif
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_connection_del (QBusConnection* p_self)
 {
   QBusConnection self = *p_self;
   
+  qbus_connection__wait (self);
+  
   qbus_route_conn_rm (self->route, self);
   
+  if (self->cut_conn)
+  {
+    // the peer would take the truncated frame as complete, the outgoing stream can't be recovered
+    qbus_connection_cut_abort (self->cut_conn);
+    
+    qbus_connection_dec (&(self->cut_conn));
+  }
+  
+  if (self->blob_out)
+  {
+    qbus_connection_cache_onDel (self->blob_out);
+    self->blob_out = NULL;
+  }
+  
+  // a blob might be incomplete
+  qbus_blob_discard (&(self->blob_fd), &(self->blob_path));
+  
+  // the files of a message which never arrived
+  cape_udc_del (&(self->blob_files));
+  qbus_blobs_del (&(self->blobs));
+  
+  // other parts might still hold a reference
+  qbus_connection_dec (p_self);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusConnection qbus_connection_inc (QBusConnection self)
+{
+  __atomic_add_fetch (&(self->refcnt), 1, __ATOMIC_RELAXED);
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_dec (QBusConnection* p_self)
+{
+  QBusConnection self = *p_self;
+  
+  *p_self = NULL;
+  
+  if (self == NULL || __atomic_sub_fetch (&(self->refcnt), 1, __ATOMIC_ACQ_REL))
+  {
+    return;
+  }
+  
   cape_list_del (&(self->cache_qeue));
+  cape_list_del (&(self->cut_hold));
   cape_mutex_del (&(self->mutex));
   
   qbus_frame_del (&(self->frame));
   
   cape_str_del (&(self->ident));
   
-  CAPE_DEL (p_self, struct QBusConnection_s);
+  CAPE_DEL (&self, struct QBusConnection_s);
 }
 
 //-----------------------------------------------------------------------------
@@ -89,6 +361,100 @@ void qbus_connection_cb (QBusConnection self, void* ptr1, void* ptr2, fct_qbus_c
 
 //-----------------------------------------------------------------------------
 
+void qbus_connection_cb_frame (QBusConnection self, fct_qbus_connection_frame frame)
+{
+  self->fct_frame = frame;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_cb_close (QBusConnection self, fct_qbus_connection_close close)
+{
+  self->fct_close = close;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_cb_blob (QBusConnection self, void* ptr, fct_qbus_connection_blob blob, fct_qbus_connection_fetch fetch)
+{
+  self->fct_blob = blob;
+  self->fct_fetch = fetch;
+  
+  self->blob_ptr = ptr;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_close (QBusConnection self)
+{
+  if (self->fct_close && qbus_connection__enter (self))
+  {
+    // the engine will call qbus_connection_del when the socket is done
+    self->fct_close (self->ptr1, self->ptr2);
+    
+    qbus_connection__leave (self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static number_t qbus_connection__now (void)
+{
+#if defined __WINDOWS_OS
+  
+  return (number_t)GetTickCount64 ();
+  
+#else
+  
+  struct timespec ts;
+  
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  
+  return (number_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_connection_hb_next (QBusConnection self, number_t* p_stamp)
+{
+  *p_stamp = qbus_connection__now ();
+  
+  return __atomic_add_fetch (&(self->hb_missed), 1, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_hb_pong (QBusConnection self, number_t stamp)
+{
+  __atomic_store_n (&(self->rtt), qbus_connection__now () - stamp, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_connection_rtt (QBusConnection self)
+{
+  return __atomic_load_n (&(self->rtt), __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_connection_queued (QBusConnection self)
+{
+  number_t ret;
+  
+  cape_mutex_lock (self->mutex);
+  
+  ret = cape_list_size (self->cache_qeue) + cape_list_size (self->cut_hold);
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return ret;
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_connection_reg (QBusConnection self)
 {
   qbus_route_conn_reg (self->route, self);
@@ -110,26 +476,346 @@ const CapeString qbus_connection_get (QBusConnection self)
 
 //-----------------------------------------------------------------------------
 
+static int qbus_connection_onSent__blob (QBusConnection self)
+{
+  QBusConnectionItem* item = self->blob_out;
+  
+  if (self->fct_fetch)
+  {
+    // the engine passes the handle itself
+    if (self->fct_blob (self->blob_ptr, item->fd, 0, item->left) < 0)
+    {
+      cape_log_msg (CAPE_LL_ERROR, "QBUS", "send blob", "can't pass the file handle");
+    }
+  }
+  else
+  {
+    while (item->left > 0)
+    {
+      number_t len = self->fct_blob (self->blob_ptr, item->fd, item->offset, item->left);
+      
+      if (len == 0)
+      {
+        // continue as soon as the engine is able to send again
+        qbus_connection__mark (self);
+        return FALSE;
+      }
+      
+      if (len < 0)
+      {
+        cape_log_msg (CAPE_LL_ERROR, "QBUS", "send blob", "can't send the file content, drop connection");
+        
+        // the peer expects the remaining content, the stream can't be recovered
+        qbus_connection_close (self);
+        return FALSE;
+      }
+      
+      item->offset += len;
+      item->left -= len;
+    }
+  }
+  
+  self->blob_out = NULL;
+  
+  qbus_connection_cache_onDel (item);
+  
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_connection_onSent (QBusConnection self, void* userdata)
 {
-  CapeStream cs;
+  QBusConnectionItem* item;
   
   if (userdata)
   {
     qbus_connection_cache_onDel (userdata);
   }
   
-  cape_mutex_lock (self->mutex);
+  if (self->blob_out && qbus_connection_onSent__blob (self) == FALSE)
+  {
+    // the file content is not sent completely
+    return;
+  }
   
-  // extract the first element from the queue cache
-  cs = cape_list_pop_front (self->cache_qeue);
+  for (;;)
+  {
+    cape_mutex_lock (self->mutex);
+    
+    // extract the first element from the queue cache
+    item = cape_list_pop_front (self->cache_qeue);
+    
+    cape_mutex_unlock (self->mutex);
+    
+    if (item == NULL)
+    {
+      return;
+    }
+    
+    if (item->cs)
+    {
+      // finally send the buffer content to the unerlaying engine
+      self->fct_send (self->ptr1, self->ptr2, cape_stream_data(item->cs), cape_stream_size(item->cs), item);
+      return;
+    }
+    
+    if (item->shared)
+    {
+      // the buffer is only read, all connections send the same one
+      self->fct_send (self->ptr1, self->ptr2, cape_stream_data(item->shared->cs), cape_stream_size(item->shared->cs), item);
+      return;
+    }
+    
+    if (item->frame)
+    {
+      // the engine takes the frame in the same order as the streams
+      self->fct_frame (self->ptr1, self->ptr2, &(item->frame));
+      
+      qbus_connection_cache_onDel (item);
+      continue;
+    }
+    
+    self->blob_out = item;
+    
+    if (qbus_connection_onSent__blob (self) == FALSE)
+    {
+      return;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_onRecv__cut (QBusConnection self, const char* bufdat, number_t buflen, number_t* written)
+{
+  number_t len = buflen - *written;
   
-  cape_mutex_unlock (self->mutex);
+  if (len > self->cut_left)
+  {
+    len = self->cut_left;
+  }
+  
+  self->cut_left -= len;
+  
+  qbus_connection_cut_send (self->cut_conn, bufdat + *written, len, self->cut_left == 0);
+  
+  *written += len;
+  
+  if (self->cut_left == 0)
+  {
+    qbus_connection_dec (&(self->cut_conn));
+    
+    // the payload was passed through, recreate a new frame
+    qbus_frame_del (&(self->frame));
+    self->frame = qbus_frame_new ();
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_onRecv__blob_add (QBusConnection self, int fd, CapeString* p_path)
+{
+  CapeString path;
+  
+  if (self->blob_files == NULL)
+  {
+    self->blob_files = cape_udc_new (CAPE_UDC_NODE, NULL);
+    self->blobs = qbus_blobs_new ();
+  }
+  
+  path = qbus_blobs_add (self->blobs, fd, p_path);
+  
+  // the method of the blob frame is the position of the file in the message
+  cape_udc_add_s_mv (self->blob_files, qbus_frame_get_method (self->frame), &path);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_onRecv__blob_open (QBusConnection self)
+{
+  CapeErr err = cape_err_new ();
+  
+  self->blob_left = qbus_frame_get_size (self->frame);
+  self->blob_fd = qbus_blob_create (self->blob_left, &(self->blob_path), err);
+  
+  if (self->blob_fd < 0)
+  {
+    // the content will be skipped
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "recv blob", "can't store the file content: %s", cape_err_text (err));
+  }
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_onRecv__blob_done (QBusConnection self)
+{
+  if (self->blob_fd >= 0)
+  {
+    // the handle stays open, an anonymous file in memory has no other reference
+    qbus_connection_onRecv__blob_add (self, self->blob_fd, &(self->blob_path));
+    
+    self->blob_fd = -1;
+  }
+  
+  // the content was stored, recreate a new frame
+  qbus_frame_del (&(self->frame));
+  self->frame = qbus_frame_new ();
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_onRecv__blob (QBusConnection self, const char* bufdat, number_t buflen, number_t* written)
+{
+  number_t len = buflen - *written;
+  
+  if (len > self->blob_left)
+  {
+    len = self->blob_left;
+  }
+  
+  self->blob_left -= len;
+  
+  if (self->blob_fd >= 0)
+  {
+    CapeErr err = cape_err_new ();
+    
+    if (qbus_blob_write (self->blob_fd, bufdat + *written, len, err))
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "recv blob", "can't store the file content: %s", cape_err_text (err));
+      
+      // skip the rest of the content
+      qbus_blob_discard (&(self->blob_fd), &(self->blob_path));
+    }
+    
+    cape_err_del (&err);
+  }
+  
+  *written += len;
+  
+  if (self->blob_left == 0)
+  {
+    qbus_connection_onRecv__blob_done (self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_onRecv__blob_fetch (QBusConnection self)
+{
+  // the handle was passed ahead of the header
+  int fd = self->fct_fetch ? self->fct_fetch (self->blob_ptr) : -1;
+  
+  if (fd < 0)
+  {
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "recv blob", "no file handle was passed");
+  }
+  else
+  {
+    // keep the handle instead of copying the content
+    qbus_connection_onRecv__blob_add (self, fd, NULL);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_onRecv__blob_apply (QBusConnection self)
+{
+  const char* bufdat;
+  number_t buflen;
+  
+  if (self->blob_files == NULL)
+  {
+    return;
+  }
+  
+  if (qbus_frame_get_member (self->frame, "F", &bufdat, &buflen))
+  {
+    CapeUdc files = cape_json_from_buf (bufdat, buflen);
+    
+    if (files)
+    {
+      number_t k = 0;
+      CapeUdcCursor* cursor = cape_udc_cursor_new (files, CAPE_DIRECTION_FORW);
+      
+      while (cape_udc_cursor_next (cursor))
+      {
+        CapeString h = cape_str_fmt ("%li", k);
+        
+        // replace the path of the sender by the local copy
+        const CapeString path = cape_udc_get_s (self->blob_files, h, NULL);
+        
+        if (path)
+        {
+          cape_udc_set_s_cp (cursor->item, path);
+        }
+        
+        cape_str_del (&h);
+        
+        k++;
+      }
+      
+      cape_udc_cursor_del (&cursor);
+      
+      {
+        CapeString h = cape_json_to_s (files);
+        
+        qbus_frame_set_member (self->frame, "F", h, cape_str_size (h));
+        
+        cape_str_del (&h);
+      }
+    }
+    
+    cape_udc_del (&files);
+  }
+  
+  // the files belong to this message, even if it doesn't list them
+  qbus_frame_set_blobs (self->frame, &(self->blobs));
+  
+  cape_udc_del (&(self->blob_files));
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_onRecv__head (QBusConnection self)
+{
+  QBusConnection conn_forward;
+  
+  if (qbus_frame_get_type (self->frame) == QBUS_FRAME_TYPE_BLOB)
+  {
+    // the content is written into a temporary file
+    qbus_connection_onRecv__blob_open (self);
+    return;
+  }
+  
+  // ask the route if the frame can be passed through
+  conn_forward = qbus_route_conn_onHead (self->route, self, self->frame);
   
-  if (cs)
+  if (conn_forward)
   {
-    // finally send the buffer content to the unerlaying engine
-    self->fct_send (self->ptr1, self->ptr2, cape_stream_data(cs), cape_stream_size(cs), cs);
+    CapeStream cs = cape_stream_new ();
+    
+    if (self->blob_files)
+    {
+      // the next hop gets the files ahead of the message, the position is all it needs
+      qbus_connection_cut_files (conn_forward, self->blob_files);
+      
+      cape_udc_del (&(self->blob_files));
+      qbus_blobs_del (&(self->blobs));
+    }
+    
+    // encode the rewritten header
+    qbus_frame_encode_head (self->frame, cs);
+    
+    qbus_connection_cut_send (conn_forward, cape_stream_data (cs), cape_stream_size (cs), FALSE);
+    
+    cape_stream_del (&cs);
+    
+    // transfer the reference
+    self->cut_conn = conn_forward;
+    self->cut_left = qbus_frame_get_size (self->frame);
   }
 }
 
@@ -139,23 +825,256 @@ void qbus_connection_onRecv (QBusConnection self, const char* bufdat, number_t b
 {
   number_t written = 0;    // how many bytes were processed
   
-  // decode the data stream into frames
-  while (qbus_frame_decode (self->frame, bufdat + written, buflen - written, &written))
+  // any data proves that the peer is alive
+  __atomic_store_n (&(self->hb_missed), 0, __ATOMIC_RELAXED);
+  
+  while (written < buflen)
   {
-    // call the route method to deliver the frame
-    qbus_route_conn_onFrame (self->route, self, &(self->frame));
+    if (self->cut_conn)
+    {
+      // pass the payload directly to the outgoing connection
+      qbus_connection_onRecv__cut (self, bufdat, buflen, &written);
+      continue;
+    }
+    
+    if (self->blob_left)
+    {
+      // store the content of a file
+      qbus_connection_onRecv__blob (self, bufdat, buflen, &written);
+      continue;
+    }
+    
+    // decode the data stream into frames
+    switch (qbus_frame_decode (self->frame, bufdat + written, buflen - written, &written))
+    {
+      case TRUE:
+      {
+        switch (qbus_frame_get_type (self->frame))
+        {
+          case QBUS_FRAME_TYPE_BLOB:
+          {
+            // a file without content
+            qbus_connection_onRecv__blob_open (self);
+            qbus_connection_onRecv__blob_done (self);
+            
+            break;
+          }
+          case QBUS_FRAME_TYPE_BLOB_FD:
+          {
+            qbus_connection_onRecv__blob_fetch (self);
+            
+            // recreate a new frame
+            qbus_frame_del (&(self->frame));
+            self->frame = qbus_frame_new ();
+            
+            break;
+          }
+          default:
+          {
+            qbus_connection_onRecv__blob_apply (self);
+            
+            // call the route method to deliver the frame
+            qbus_route_conn_onFrame (self->route, self, &(self->frame));
+            
+            // recreate a new frame
+            self->frame = qbus_frame_new ();
+            
+            break;
+          }
+        }
+        
+        break;
+      }
+      case QBUS_FRAME_DECODE_HEAD:
+      {
+        qbus_connection_onRecv__head (self);
+        break;
+      }
+      default:
+      {
+        return;
+      }
+    }
+  }
+}
 
-    // recreate a new frame
-    self->frame = qbus_frame_new ();
+//-----------------------------------------------------------------------------
+
+void qbus_connection_onFrame (QBusConnection self, QBusFrame* p_frame)
+{
+  __atomic_store_n (&(self->hb_missed), 0, __ATOMIC_RELAXED);
+  
+  // call the route method to deliver the frame
+  qbus_route_conn_onFrame (self->route, self, p_frame);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_send__file (QBusConnection self, CapeList items, const CapeString path, number_t position)
+{
+  CapeErr err = cape_err_new ();
+  
+  number_t size = 0;
+  int fd = qbus_blob_open (path, &size, err);
+  
+  if (fd < 0)
+  {
+    // the peer gets the path as it is
+    cape_log_fmt (CAPE_LL_WARN, "QBUS", "send blob", "can't open '%s': %s", path, cape_err_text (err));
   }
+  else
+  {
+    QBusFrame frame = qbus_frame_new ();
+    CapeStream cs = cape_stream_new ();
+    
+    CapeString h = cape_str_fmt ("%li", position);
+    
+    if (self->fct_fetch)
+    {
+      qbus_frame_set (frame, QBUS_FRAME_TYPE_BLOB_FD, NULL, NULL, h, NULL);
+      
+      qbus_frame_encode_head (frame, cs);
+      
+      // the handle must be available for the peer when the header arrives
+      cape_list_push_back (items, qbus_connection_item_new (NULL, fd, size));
+      cape_list_push_back (items, qbus_connection_item_new (&cs, -1, 0));
+    }
+    else
+    {
+      qbus_frame_set (frame, QBUS_FRAME_TYPE_BLOB, NULL, NULL, h, NULL);
+      qbus_frame_set_blob (frame, size);
+      
+      qbus_frame_encode_head (frame, cs);
+      
+      // the content follows the header
+      cape_list_push_back (items, qbus_connection_item_new (&cs, -1, 0));
+      
+      if (size > 0)
+      {
+        cape_list_push_back (items, qbus_connection_item_new (NULL, fd, size));
+      }
+      else
+      {
+        qbus_blob_close (&fd);
+      }
+    }
+    
+    cape_str_del (&h);
+    qbus_frame_del (&frame);
+  }
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection_send__files (QBusConnection self, QBusFrame* p_frame)
+{
+  CapeList items = cape_list_new (NULL);
+  
+  const char* bufdat;
+  number_t buflen;
+  
+  if (qbus_frame_get_member (*p_frame, "F", &bufdat, &buflen))
+  {
+    CapeUdc files = cape_json_from_buf (bufdat, buflen);
+    
+    if (files)
+    {
+      number_t k = 0;
+      CapeUdcCursor* cursor = cape_udc_cursor_new (files, CAPE_DIRECTION_FORW);
+      
+      while (cape_udc_cursor_next (cursor))
+      {
+        if (cape_udc_type (cursor->item) == CAPE_UDC_STRING)
+        {
+          qbus_connection_send__file (self, items, cape_udc_s (cursor->item, NULL), k);
+        }
+        
+        k++;
+      }
+      
+      cape_udc_cursor_del (&cursor);
+    }
+    
+    cape_udc_del (&files);
+  }
+  
+  // the message follows the files
+  {
+    CapeStream cs = cape_stream_new ();
+    
+    qbus_frame_encode (*p_frame, cs);
+    
+    cape_list_push_back (items, qbus_connection_item_new (&cs, -1, 0));
+  }
+  
+  qbus_frame_del (p_frame);
+  
+  // enter monitor
+  cape_mutex_lock (self->mutex);
+  
+  // all parts must stay in sequence
+  {
+    QBusConnectionItem* item;
+    
+    while ((item = cape_list_pop_front (items)))
+    {
+      cape_list_push_back (self->cut_active ? self->cut_hold : self->cache_qeue, (void*)item);
+    }
+  }
+  
+  // leave monitor
+  cape_mutex_unlock (self->mutex);
+  
+  cape_list_del (&items);
+  
+  qbus_connection__mark (self);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_connection__push (QBusConnection self, QBusConnectionItem* item)
+{
+  // enter monitor
+  cape_mutex_lock (self->mutex);
+  
+  // add the item to the queue, or hold it back until the pass through has finished
+  cape_list_push_back (self->cut_active ? self->cut_hold : self->cache_qeue, (void*)item);
+
+  // leave monitor
+  cape_mutex_unlock (self->mutex);
+
+  qbus_connection__mark (self);
 }
 
 //-----------------------------------------------------------------------------
 
 void qbus_connection_send (QBusConnection self, QBusFrame* p_frame)
 {
+  CapeStream cs;
+  
+  if (self->fct_frame)
+  {
+    // the engine takes the frame as it is, but it is queued with the streams to keep the order
+    QBusConnectionItem* item = qbus_connection_item_new (NULL, -1, 0);
+    
+    item->frame = *p_frame;
+    *p_frame = NULL;
+    
+    qbus_connection__push (self, item);
+    return;
+  }
+  
+  if (self->fct_blob && qbus_frame_get_mtype (*p_frame) == QBUS_MTYPE_FILE)
+  {
+    // the content of the files is sent by the engine
+    qbus_connection_send__files (self, p_frame);
+    return;
+  }
+  
   // create a new buffer stream
-  CapeStream cs = cape_stream_new ();
+  cs = cape_stream_new ();
 
   // encode (stringify) the frame
   qbus_frame_encode (*p_frame, cs);
@@ -163,17 +1082,150 @@ void qbus_connection_send (QBusConnection self, QBusFrame* p_frame)
   // cleanup the frame  
   qbus_frame_del (p_frame);
   
-  // enter monitor
+  qbus_connection_send_stream (self, &cs);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_send_stream (QBusConnection self, CapeStream* p_cs)
+{
+  qbus_connection__push (self, qbus_connection_item_new (p_cs, -1, 0));
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_send_shared (QBusConnection self, QBusShared shared)
+{
+  QBusConnectionItem* item = qbus_connection_item_new (NULL, -1, 0);
+  
+  __atomic_add_fetch (&(shared->refcnt), 1, __ATOMIC_RELAXED);
+  
+  item->shared = shared;
+  
+  qbus_connection__push (self, item);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_connection_cut_lock (QBusConnection self)
+{
+  int res = FALSE;
+  
   cape_mutex_lock (self->mutex);
   
-  // add the stream buffer to the queue
-  cape_list_push_back (self->cache_qeue, (void*)cs);
+  if (!self->cut_active)
+  {
+    self->cut_active = TRUE;
+    res = TRUE;
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return res;
+}
 
-  // leave monitor
+//-----------------------------------------------------------------------------
+
+void qbus_connection_cut_send (QBusConnection self, const char* bufdat, number_t buflen, int last)
+{
+  cape_mutex_lock (self->mutex);
+  
+  if (buflen)
+  {
+    CapeStream cs = cape_stream_new ();
+    
+    cape_stream_append_buf (cs, bufdat, buflen);
+    
+    cape_list_push_back (self->cache_qeue, (void*)qbus_connection_item_new (&cs, -1, 0));
+  }
+  
+  if (last)
+  {
+    QBusConnectionItem* item;
+    
+    // release all frames which were hold back
+    while ((item = cape_list_pop_front (self->cut_hold)))
+    {
+      cape_list_push_back (self->cache_qeue, (void*)item);
+    }
+    
+    self->cut_active = FALSE;
+  }
+  
   cape_mutex_unlock (self->mutex);
+  
+  qbus_connection__mark (self);
+}
+
+//-----------------------------------------------------------------------------
 
-  // trigger the underlaying engine to process the buffer
-  self->fct_mark (self->ptr1, self->ptr2);
+void qbus_connection_cut_files (QBusConnection self, CapeUdc files)
+{
+  CapeList items = cape_list_new (NULL);
+  
+  if (self->fct_blob)
+  {
+    CapeUdcCursor* cursor = cape_udc_cursor_new (files, CAPE_DIRECTION_FORW);
+    
+    while (cape_udc_cursor_next (cursor))
+    {
+      // the files are opened here, the local copies can be released afterwards
+      qbus_connection_send__file (self, items, cape_udc_s (cursor->item, NULL), strtol (cape_udc_name (cursor->item), NULL, 10));
+    }
+    
+    cape_udc_cursor_del (&cursor);
+  }
+  else
+  {
+    cape_log_msg (CAPE_LL_WARN, "QBUS", "cut files", "the connection can't transfer files, the peer gets the paths of the sender");
+  }
+  
+  cape_mutex_lock (self->mutex);
+  
+  // the queue is reserved for the cut-through, the files go right before the message
+  {
+    QBusConnectionItem* item;
+    
+    while ((item = cape_list_pop_front (items)))
+    {
+      cape_list_push_back (self->cache_qeue, (void*)item);
+    }
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  cape_list_del (&items);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_connection_cut_abort (QBusConnection self)
+{
+  cape_mutex_lock (self->mutex);
+  
+  // no other frame must follow the incomplete one, release the reservation and drop what was hold back
+  {
+    QBusConnectionItem* item;
+    
+    while ((item = cape_list_pop_front (self->cut_hold)))
+    {
+      qbus_connection_cache_onDel (item);
+    }
+  }
+  
+  self->cut_active = FALSE;
+  
+  cape_mutex_unlock (self->mutex);
+  
+  if (self->fct_close == NULL)
+  {
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "cut abort", "the incoming connection was lost within a payload, the engine can't drop the outgoing connection");
+    return;
+  }
+  
+  cape_log_msg (CAPE_LL_WARN, "QBUS", "cut abort", "the incoming connection was lost within a payload, drop the outgoing connection");
+  
+  qbus_connection_close (self);
 }
 
 //-----------------------------------------------------------------------------
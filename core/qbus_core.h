@@ -10,18 +10,55 @@
 
 //=============================================================================
 
+struct QBusShared_s; typedef struct QBusShared_s* QBusShared;
+
+                 // an encoded frame for several connections, takes ownership of the stream
+__CAPE_LIBEX   QBusShared        qbus_shared_new          (CapeStream* p_cs);
+
+                 // releases the reference of the caller, the connections hold their own
+__CAPE_LIBEX   void              qbus_shared_del          (QBusShared*);
+
+//-----------------------------------------------------------------------------
+
 __CAPE_LIBEX   QBusConnection    qbus_connection_new      (QBusRoute, number_t channels);
 
+                 // called by the engine when the socket is done, the memory is released with the last reference
 __CAPE_LIBEX   void              qbus_connection_del      (QBusConnection*);
 
+                 // keeps the connection valid after the route lock was released, returns the connection
+__CAPE_LIBEX   QBusConnection    qbus_connection_inc      (QBusConnection);
+
+__CAPE_LIBEX   void              qbus_connection_dec      (QBusConnection*);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   void              qbus_connection_onSent   (QBusConnection, void* userdata);
 
 __CAPE_LIBEX   void              qbus_connection_onRecv   (QBusConnection, const char* bufdat, number_t buflen);
 
+                 // delivers a frame which was not encoded, takes ownership
+__CAPE_LIBEX   void              qbus_connection_onFrame  (QBusConnection, QBusFrame*);
+
 __CAPE_LIBEX   void              qbus_connection_send     (QBusConnection, QBusFrame*);
 
+                 // sends an already encoded frame, takes ownership of the stream
+__CAPE_LIBEX   void              qbus_connection_send_stream  (QBusConnection, CapeStream*);
+
+                 // sends an already encoded frame, which is shared with other connections
+__CAPE_LIBEX   void              qbus_connection_send_shared  (QBusConnection, QBusShared);
+
+                 // reserves the outgoing queue for a frame passed through, returns FALSE if already reserved
+__CAPE_LIBEX   int               qbus_connection_cut_lock     (QBusConnection);
+
+                 // appends raw bytes of the reserved frame, the last call releases the queue
+__CAPE_LIBEX   void              qbus_connection_cut_send     (QBusConnection, const char* bufdat, number_t buflen, int last);
+
+                 // queues the received files of the reserved frame ahead of it, index -> local path
+__CAPE_LIBEX   void              qbus_connection_cut_files    (QBusConnection, CapeUdc files);
+
+                 // the reserved frame can't be completed, drops the connection instead of sending a truncated frame
+__CAPE_LIBEX   void              qbus_connection_cut_abort    (QBusConnection);
+
 //-----------------------------------------------------------------------------
 
 typedef void (__STDCALL *fct_qbus_connection_send) (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata);
@@ -29,6 +66,41 @@ typedef void (__STDCALL *fct_qbus_connection_mark) (void* ptr1, void* ptr2);
 
 __CAPE_LIBEX   void              qbus_connection_cb       (QBusConnection, void* ptr1, void* ptr2, fct_qbus_connection_send, fct_qbus_connection_mark);
 
+typedef void (__STDCALL *fct_qbus_connection_frame) (void* ptr1, void* ptr2, QBusFrame* p_frame);
+
+                 // optional for engines in the same process, frames are handed over without encoding
+                 // the frames are queued with the streams and handed over by qbus_connection_onSent in send order
+__CAPE_LIBEX   void              qbus_connection_cb_frame (QBusConnection, fct_qbus_connection_frame);
+
+typedef void (__STDCALL *fct_qbus_connection_close) (void* ptr1, void* ptr2);
+
+                 // optional, the engine closes the socket and deletes the connection when it is done
+__CAPE_LIBEX   void              qbus_connection_cb_close (QBusConnection, fct_qbus_connection_close);
+
+__CAPE_LIBEX   void              qbus_connection_close    (QBusConnection);
+
+typedef number_t (__STDCALL *fct_qbus_connection_blob) (void* ptr, int fd, number_t offset, number_t size);
+typedef int (__STDCALL *fct_qbus_connection_fetch) (void* ptr);
+
+                 // optional, the files of a message are sent by the engine without copying them into buffers
+                 // without fetch the content follows a header, blob returns the bytes sent, 0 to wait for the socket or -1
+                 // with fetch the handle itself is passed ahead of the header and fetched by the peer
+__CAPE_LIBEX   void              qbus_connection_cb_blob  (QBusConnection, void* ptr, fct_qbus_connection_blob, fct_qbus_connection_fetch);
+
+//-----------------------------------------------------------------------------
+
+                 // counts a heartbeat interval, returns the intervals without any received data
+__CAPE_LIBEX   number_t          qbus_connection_hb_next  (QBusConnection, number_t* p_stamp);
+
+                 // the peer answered the heartbeat with the stamp
+__CAPE_LIBEX   void              qbus_connection_hb_pong  (QBusConnection, number_t stamp);
+
+                 // last measured round trip time in ms
+__CAPE_LIBEX   number_t          qbus_connection_rtt      (QBusConnection);
+
+                 // amount of encoded frames waiting to be sent
+__CAPE_LIBEX   number_t          qbus_connection_queued   (QBusConnection);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   void              qbus_connection_reg      (QBusConnection);
@@ -5,6 +5,7 @@
 #include "sys/cape_log.h"
 
 #include <stdio.h>
+#include <string.h>
 
 //-----------------------------------------------------------------------------
 
@@ -54,6 +55,10 @@ struct QBusFrame_s
   number_t     state;
   
   CapeStream   stream;
+  
+  // received files of the payload, removed with the frame
+  
+  QBusBlobs    blobs;
 };
 
 //-----------------------------------------------------------------------------
@@ -75,6 +80,8 @@ QBusFrame qbus_frame_new ()
   self->state = QBUS_PP_STATE__START;
   self->stream = cape_stream_new ();
   
+  self->blobs = NULL;
+  
   return self;
 }
 
@@ -96,6 +103,8 @@ void qbus_frame_del (QBusFrame* p_self)
     
     cape_stream_del (&(self->stream));
     
+    qbus_blobs_del (&(self->blobs));
+    
     CAPE_DEL (p_self, struct QBusFrame_s);
   }
 }
@@ -159,7 +168,7 @@ CapeUdc qbus_frame_set_udc (QBusFrame self, number_t msgType, CapeUdc* p_payload
 
 //-----------------------------------------------------------------------------
 
-CapeUdc qbus_frame_set_qmsg (QBusFrame self, QBusM qmsg, CapeErr err)
+CapeUdc qbus_frame_qmsg_to_udc (QBusM qmsg, CapeErr err)
 {
   CapeUdc payload = cape_udc_new (CAPE_UDC_NODE, NULL);
   
@@ -206,11 +215,96 @@ CapeUdc qbus_frame_set_qmsg (QBusFrame self, QBusM qmsg, CapeErr err)
     qmsg->mtype = QBUS_MTYPE_JSON;
   }
   
+  return payload;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_frame_udc_to_qmsg (CapeUdc payload, QBusM qin)
+{
+  // extract all substructures from the payload
+  qin->clist = cape_udc_ext_list (payload, "L");
+  qin->cdata = cape_udc_ext (payload, "D");
+  qin->pdata = cape_udc_ext (payload, "P");
+  qin->rinfo = cape_udc_ext (payload, "I");
+  qin->files = cape_udc_ext (payload, "F");
+
+  // check for errors
+  {
+    number_t err_code = cape_udc_get_n (payload, "err_code", 0);
+    if (err_code)
+    {
+      // create a new error object
+      qin->err = cape_err_new ();
+      
+      // set the error
+      cape_err_set (qin->err, err_code, cape_udc_get_s (payload, "err_text", "no error text"));
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+CapeUdc qbus_frame_set_qmsg (QBusFrame self, QBusM qmsg, CapeErr err)
+{
+  CapeUdc payload = qbus_frame_qmsg_to_udc (qmsg, err);
+  
   return qbus_frame_set_udc (self, qmsg->mtype, &payload);
 }
 
 //-----------------------------------------------------------------------------
 
+void qbus_frame_set_raw (QBusFrame self, number_t msgType, const char* bufdat, number_t buflen)
+{
+  CapeString h = (bufdat && buflen) ? cape_str_sub (bufdat, buflen) : NULL;
+  
+  cape_str_replace_mv (&(self->msg_data), &h);
+  
+  self->msg_size = self->msg_data ? buflen : 0;
+  self->msg_type = msgType;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_frame_set_payload (QBusFrame self, number_t msgType, const char* bufdat, number_t buflen)
+{
+  CapeStream cs = cape_stream_new ();
+  CapeString h;
+  
+  cape_stream_append_c (cs, '{');
+  
+  if (bufdat && buflen)
+  {
+    cape_stream_append_str (cs, "\"D\":");
+    cape_stream_append_buf (cs, bufdat, buflen);
+  }
+  
+  cape_stream_append_c (cs, '}');
+  
+  // the stream is empty after the conversion
+  self->msg_size = cape_stream_size (cs);
+  self->msg_type = msgType;
+  
+  h = cape_stream_to_s (cs);
+  
+  cape_str_replace_mv (&(self->msg_data), &h);
+  
+  cape_stream_del (&cs);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_frame_set_blob (QBusFrame self, number_t size)
+{
+  cape_str_del (&(self->msg_data));
+  
+  // the content is not part of the frame
+  self->msg_size = size;
+  self->msg_type = QBUS_MTYPE_FILE;
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_frame_set_err (QBusFrame self, CapeErr err)
 {
   CapeUdc rinfo = NULL;
@@ -227,6 +321,16 @@ void qbus_frame_set_err (QBusFrame self, CapeErr err)
 
 //-----------------------------------------------------------------------------
 
+void qbus_frame_set_blobs (QBusFrame self, QBusBlobs* p_blobs)
+{
+  qbus_blobs_del (&(self->blobs));
+  
+  self->blobs = *p_blobs;
+  *p_blobs = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
 number_t qbus_frame_get_type (QBusFrame self)
 {
   return self->ftype;
@@ -255,6 +359,27 @@ const CapeString qbus_frame_get_sender (QBusFrame self)
 
 //-----------------------------------------------------------------------------
 
+number_t qbus_frame_get_size (QBusFrame self)
+{
+  return self->msg_size;
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_frame_get_mtype (QBusFrame self)
+{
+  return self->msg_type;
+}
+
+//-----------------------------------------------------------------------------
+
+const char* qbus_frame_get_data (QBusFrame self)
+{
+  return self->msg_data;
+}
+
+//-----------------------------------------------------------------------------
+
 const CapeString qbus_frame_get_chainkey (QBusFrame self)
 {
   return self->chain_key;
@@ -284,12 +409,233 @@ CapeUdc qbus_frame_get_udc (QBusFrame self)
 
 //-----------------------------------------------------------------------------
 
+static const char* qbus_frame__json_ws (const char* pos, const char* end)
+{
+  while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n'))
+  {
+    pos++;
+  }
+  
+  return pos;
+}
+
+//-----------------------------------------------------------------------------
+
+static const char* qbus_frame__json_skip_string (const char* pos, const char* end)
+{
+  // pos is at the opening quote
+  for (pos++; pos < end; pos++)
+  {
+    if (*pos == '\\')
+    {
+      pos++;
+    }
+    else if (*pos == '"')
+    {
+      return pos + 1;
+    }
+  }
+  
+  return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+static const char* qbus_frame__json_skip_value (const char* pos, const char* end)
+{
+  number_t depth = 0;
+  
+  while (pos < end)
+  {
+    switch (*pos)
+    {
+      case '"':
+      {
+        pos = qbus_frame__json_skip_string (pos, end);
+        
+        if (pos == NULL || depth == 0)
+        {
+          return pos;
+        }
+        
+        continue;
+      }
+      case '{':
+      case '[':
+      {
+        depth++;
+        break;
+      }
+      case '}':
+      case ']':
+      {
+        if (depth == 0)
+        {
+          // end of the enclosing object
+          return pos;
+        }
+        
+        depth--;
+        
+        if (depth == 0)
+        {
+          return pos + 1;
+        }
+        
+        break;
+      }
+      case ',':
+      {
+        if (depth == 0)
+        {
+          return pos;
+        }
+        
+        break;
+      }
+    }
+    
+    pos++;
+  }
+  
+  return depth == 0 ? pos : NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_frame_get_member (QBusFrame self, const char* name, const char** p_bufdat, number_t* p_buflen)
+{
+  const char* pos = self->msg_data;
+  const char* end = pos + self->msg_size;
+  
+  number_t name_len = strlen (name);
+  
+  if (pos == NULL)
+  {
+    return FALSE;
+  }
+  
+  pos = qbus_frame__json_ws (pos, end);
+  
+  if (pos >= end || *pos != '{')
+  {
+    return FALSE;
+  }
+  
+  pos++;
+  
+  while (TRUE)
+  {
+    const char* key;
+    const char* val;
+    number_t key_len;
+    
+    pos = qbus_frame__json_ws (pos, end);
+    
+    if (pos >= end || *pos != '"')
+    {
+      return FALSE;
+    }
+    
+    key = pos + 1;
+    
+    pos = qbus_frame__json_skip_string (pos, end);
+    if (pos == NULL)
+    {
+      return FALSE;
+    }
+    
+    key_len = (pos - 1) - key;
+    
+    pos = qbus_frame__json_ws (pos, end);
+    
+    if (pos >= end || *pos != ':')
+    {
+      return FALSE;
+    }
+    
+    val = qbus_frame__json_ws (pos + 1, end);
+    
+    pos = qbus_frame__json_skip_value (val, end);
+    if (pos == NULL)
+    {
+      return FALSE;
+    }
+    
+    if (key_len == name_len && memcmp (key, name, name_len) == 0)
+    {
+      const char* val_end = pos;
+      
+      // scalars end at the next separator
+      while (val_end > val && (val_end[-1] == ' ' || val_end[-1] == '\t' || val_end[-1] == '\r' || val_end[-1] == '\n'))
+      {
+        val_end--;
+      }
+      
+      *p_bufdat = val;
+      *p_buflen = val_end - val;
+      
+      return TRUE;
+    }
+    
+    pos = qbus_frame__json_ws (pos, end);
+    
+    if (pos >= end || *pos != ',')
+    {
+      return FALSE;
+    }
+    
+    pos++;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_frame_set_member (QBusFrame self, const char* name, const char* bufdat, number_t buflen)
+{
+  const char* val;
+  number_t len;
+  
+  if (qbus_frame_get_member (self, name, &val, &len) == FALSE)
+  {
+    return FALSE;
+  }
+  
+  {
+    CapeStream cs = cape_stream_new ();
+    CapeString h;
+    
+    number_t pos = val - self->msg_data;
+    
+    cape_stream_append_buf (cs, self->msg_data, pos);
+    cape_stream_append_buf (cs, bufdat, buflen);
+    cape_stream_append_buf (cs, val + len, self->msg_size - pos - len);
+    
+    // the stream is empty after the conversion
+    self->msg_size = cape_stream_size (cs);
+    
+    h = cape_stream_to_s (cs);
+    
+    cape_str_replace_mv (&(self->msg_data), &h);
+    
+    cape_stream_del (&cs);
+  }
+  
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+
 QBusM qbus_frame_qin (QBusFrame self)
 {
   QBusM qin = qbus_message_new (self->chain_key, self->sender);
   
   qin->mtype = self->msg_type;
   
+  // the message might outlive the frame
+  qin->blobs = self->blobs;
+  self->blobs = NULL;
+  
   switch (self->msg_type)
   {
     case QBUS_MTYPE_JSON:
@@ -301,25 +647,7 @@ QBusM qbus_frame_qin (QBusFrame self)
         CapeUdc payload = cape_json_from_buf (self->msg_data, self->msg_size);
         if (payload)
         {
-          // extract all substructures from the payload
-          qin->clist = cape_udc_ext_list (payload, "L");
-          qin->cdata = cape_udc_ext (payload, "D");
-          qin->pdata = cape_udc_ext (payload, "P");
-          qin->rinfo = cape_udc_ext (payload, "I");
-          qin->files = cape_udc_ext (payload, "F");
-
-          // check for errors
-          {
-            number_t err_code = cape_udc_get_n (payload, "err_code", 0);
-            if (err_code)
-            {
-              // create a new error object
-              qin->err = cape_err_new ();
-              
-              // set the error
-              cape_err_set (qin->err, err_code, cape_udc_get_s (payload, "err_text", "no error text"));
-            }
-          }
+          qbus_frame_udc_to_qmsg (payload, qin);
         }
         else
         {
@@ -462,6 +790,15 @@ int qbus_frame_decode (QBusFrame self, const char* bufdat, number_t buflen, numb
             
             return TRUE;
           }
+          else if (self->msg_size >= QBUS_FRAME_CUT_THROUGH_SIZE || self->ftype == QBUS_FRAME_TYPE_BLOB)
+          {
+            *written += (posB - bufdat) + 1;
+            
+            self->state = QBUS_PP_STATE__CO;
+            
+            // give the caller the chance to pass the payload through or to store the blob
+            return QBUS_FRAME_DECODE_HEAD;
+          }
           else
           {
             self->state = QBUS_PP_STATE__CO;
@@ -501,7 +838,7 @@ int qbus_frame_decode (QBusFrame self, const char* bufdat, number_t buflen, numb
 
 //-----------------------------------------------------------------------------
 
-void qbus_frame_encode (QBusFrame self, CapeStream cs)
+void qbus_frame_encode_head (QBusFrame self, CapeStream cs)
 {
   cape_stream_clr (cs);
   
@@ -544,6 +881,14 @@ void qbus_frame_encode (QBusFrame self, CapeStream cs)
   
   // CO
   cape_stream_append_c (cs, QBUS_SE_STATE__CO);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_frame_encode (QBusFrame self, CapeStream cs)
+{
+  qbus_frame_encode_head (self, cs);
+  
   if (self->msg_data)
   {
     cape_stream_append_buf (cs, self->msg_data, self->msg_size);
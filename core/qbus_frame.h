@@ -6,6 +6,7 @@
 #include "stc/cape_stream.h"
 
 #include "qbus_route.h"
+#include "qbus_blob.h"
 
 //-----------------------------------------------------------------------------
 
@@ -16,6 +17,24 @@
 #define QBUS_FRAME_TYPE_MSG_RES      4
 #define QBUS_FRAME_TYPE_ROUTE_UPD    5
 #define QBUS_FRAME_TYPE_METHODS      6
+#define QBUS_FRAME_TYPE_MSG_NOTIFY   7
+#define QBUS_FRAME_TYPE_TOPICS_UPD   8
+#define QBUS_FRAME_TYPE_MSG_PUBLISH  9
+#define QBUS_FRAME_TYPE_BATCH_REQ   10
+#define QBUS_FRAME_TYPE_BATCH_RES   11
+#define QBUS_FRAME_TYPE_PING        12
+#define QBUS_FRAME_TYPE_PONG        13
+#define QBUS_FRAME_TYPE_BLOB        14
+#define QBUS_FRAME_TYPE_BLOB_FD     15
+
+// forwarding routers push the previous hop onto the chain key: <chain key>@<hop1>@<hop2>
+#define QBUS_FRAME_HOP_SEPARATOR    '@'
+
+// frames with a larger payload are passed through by forwarding nodes
+#define QBUS_FRAME_CUT_THROUGH_SIZE  65536
+
+// returned by decode if the header of a large frame or a blob was parsed
+#define QBUS_FRAME_DECODE_HEAD       2
 
 //=============================================================================
 
@@ -41,6 +60,21 @@ __CAPE_LIBEX   CapeUdc           qbus_frame_set_udc       (QBusFrame, number_t m
 // returns the rinfo if available
 __CAPE_LIBEX   CapeUdc           qbus_frame_set_qmsg      (QBusFrame, QBusM, CapeErr);
 
+                 // sets the complete payload as it is
+__CAPE_LIBEX   void              qbus_frame_set_raw       (QBusFrame, number_t msgType, const char* bufdat, number_t buflen);
+
+                 // sets the JSON text as 'cdata' of the payload without building a tree
+__CAPE_LIBEX   void              qbus_frame_set_payload   (QBusFrame, number_t msgType, const char* bufdat, number_t buflen);
+
+                 // announces the size of a file content, only the header is encoded and the content has to follow
+__CAPE_LIBEX   void              qbus_frame_set_blob      (QBusFrame, number_t size);
+
+                 // replaces the JSON text of a top level member of the payload, the payload is not parsed
+__CAPE_LIBEX   int               qbus_frame_set_member    (QBusFrame, const char* name, const char* bufdat, number_t buflen);
+
+                 // the frame takes over the received files of its payload
+__CAPE_LIBEX   void              qbus_frame_set_blobs     (QBusFrame, QBusBlobs* p_blobs);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   number_t          qbus_frame_get_type      (QBusFrame);
@@ -53,16 +87,37 @@ __CAPE_LIBEX   const CapeString  qbus_frame_get_sender    (QBusFrame);
 
 __CAPE_LIBEX   const CapeString  qbus_frame_get_chainkey  (QBusFrame);
 
+__CAPE_LIBEX   number_t          qbus_frame_get_size      (QBusFrame);
+
+__CAPE_LIBEX   number_t          qbus_frame_get_mtype     (QBusFrame);
+
+__CAPE_LIBEX   const char*       qbus_frame_get_data      (QBusFrame);
+
 __CAPE_LIBEX   CapeUdc           qbus_frame_get_udc       (QBusFrame);
 
+                 // finds the JSON text of a top level member of the payload, the payload is not parsed
+__CAPE_LIBEX   int               qbus_frame_get_member    (QBusFrame, const char* name, const char** p_bufdat, number_t* p_buflen);
+
+                 // the message takes over the received files of the frame
 __CAPE_LIBEX   QBusM             qbus_frame_qin           (QBusFrame);
 
+//-----------------------------------------------------------------------------
+
+                 // moves the content of the message into a payload node
+__CAPE_LIBEX   CapeUdc           qbus_frame_qmsg_to_udc   (QBusM, CapeErr);
+
+                 // extracts the content of a payload node into the message
+__CAPE_LIBEX   void              qbus_frame_udc_to_qmsg   (CapeUdc payload, QBusM);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   int               qbus_frame_decode        (QBusFrame, const char* bufdat, number_t buflen, number_t* written);
 
 __CAPE_LIBEX   void              qbus_frame_encode        (QBusFrame, CapeStream cs);
 
+                 // encodes only the header, the payload has to follow
+__CAPE_LIBEX   void              qbus_frame_encode_head   (QBusFrame, CapeStream cs);
+
 //=============================================================================
 
 #endif
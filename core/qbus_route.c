@@ -1,23 +1,30 @@
 #include "qbus_route.h"
 #include "qbus_core.h"
 #include "qbus_route_items.h"
+#include "qbus_submit.h"
 
 // cape includes
 #include "sys/cape_types.h"
 #include "sys/cape_mutex.h"
+#include "sys/cape_queue.h"
 #include "sys/cape_log.h"
 #include "stc/cape_map.h"
 #include "fmt/cape_json.h"
 
 // c includes
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 //-----------------------------------------------------------------------------
 
 #define QBUS_METHOD_TYPE__REQUEST      1
 #define QBUS_METHOD_TYPE__RESPONSE     2
-#define QBUS_METHOD_TYPE__FORWARD      3
 #define QBUS_METHOD_TYPE__METHODS      4
+#define QBUS_METHOD_TYPE__BATCH        5
+
+// how many ids of forwarded publishes are remembered to drop duplicates
+#define QBUS_ROUTE_PUBLISH_SEEN        1024
 
 struct QBusMethod_s
 {
@@ -29,6 +36,16 @@ struct QBusMethod_s
   
   fct_qbus_onRemoved onRm;
   
+  fct_qbus_onPayload onPayload;   // if set the method works on the serialized payload
+  
+  fct_qbus_onRaw onRaw;           // if set the method gets and returns the payload as it is
+  
+  // execution
+  
+  CapeQueue queue;      // reference or owned, if NULL the method runs inline
+  
+  int queue_owned;
+  
   // for continue
   
   CapeString chain_key;
@@ -52,6 +69,12 @@ QBusMethod qbus_method_new (int type, void* ptr, fct_qbus_onMessage onMsg, fct_q
   self->onMsg = onMsg;
   self->onRm = onRm;
   
+  self->onPayload = NULL;
+  self->onRaw = NULL;
+  
+  self->queue = NULL;
+  self->queue_owned = FALSE;
+  
   self->chain_key = NULL;
   self->chain_sender = NULL;
   
@@ -66,6 +89,12 @@ void qbus_method_del (QBusMethod* p_self)
 { 
   QBusMethod self = *p_self;
   
+  if (self->queue_owned)
+  {
+    // wait until all worker threads are done
+    cape_queue_del (&(self->queue));
+  }
+  
   if (self->onRm)
   {
     self->onRm (self->ptr);
@@ -84,9 +113,10 @@ void qbus_method_del (QBusMethod* p_self)
 
 //-----------------------------------------------------------------------------
 
-void qbus_method_continue (QBusMethod self, CapeString* p_chain_key, CapeString* p_chain_sender, CapeUdc* p_rinfo)
+void qbus_method_continue (QBusMethod self, const CapeString chain_key, CapeString* p_chain_sender, CapeUdc* p_rinfo)
 {
-  cape_str_replace_mv (&(self->chain_key), p_chain_key);
+  // the message keeps its key, a local method registers its chain with it after the call
+  cape_str_replace_cp (&(self->chain_key), chain_key);
   cape_str_replace_mv (&(self->chain_sender), p_chain_sender);
   
   self->rinfo = *p_rinfo;
@@ -95,10 +125,140 @@ void qbus_method_continue (QBusMethod self, CapeString* p_chain_key, CapeString*
 
 //-----------------------------------------------------------------------------
 
+static void qbus_method__raw_to_qmsg (QBusM msg, number_t mtype, const char* bufdat, number_t buflen)
+{
+  if (bufdat && buflen)
+  {
+    CapeUdc payload = cape_json_from_buf (bufdat, buflen);
+    
+    if (payload)
+    {
+      qbus_frame_udc_to_qmsg (payload, msg);
+    }
+    else
+    {
+      cape_log_msg (CAPE_LL_ERROR, "QBUS", "raw", "can't parse the raw payload");
+    }
+    
+    cape_udc_del (&payload);
+  }
+  
+  msg->mtype = mtype;
+}
+
+//-----------------------------------------------------------------------------
+
+static CapeString qbus_method__qmsg_to_raw (QBusM msg)
+{
+  // moves the content out of the message
+  CapeUdc payload = qbus_frame_qmsg_to_udc (msg, msg->err);
+  
+  CapeString h = cape_json_to_s (payload);
+  
+  cape_udc_del (&payload);
+  
+  return h;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_method_call_request__raw (QBusMethod self, QBus qbus, QBusFrame frame, CapeErr err)
+{
+  int res;
+  struct QBusRaw_s raw;
+  
+  raw.mtype = qbus_frame_get_mtype (frame);
+  raw.bufdat = qbus_frame_get_data (frame);
+  raw.buflen = qbus_frame_get_size (frame);
+  raw.chain_key = qbus_frame_get_chainkey (frame);
+  raw.sender = qbus_frame_get_sender (frame);
+  raw.reply = cape_stream_new ();
+  
+  res = self->onRaw (qbus, self->ptr, &raw, err);
+  
+  switch (res)
+  {
+    case CAPE_ERR_NONE:
+    {
+      qbus_frame_set_raw (frame, raw.mtype, cape_stream_data (raw.reply), cape_stream_size (raw.reply));
+      break;
+    }
+    case CAPE_ERR_CONTINUE:
+    {
+      // the handler answers later with qbus_response_raw
+      break;
+    }
+    default:
+    {
+      qbus_frame_set_err (frame, err);
+      break;
+    }
+  }
+  
+  cape_stream_del (&(raw.reply));
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_method_call_request__payload (QBusMethod self, QBus qbus, QBusFrame frame, CapeErr err)
+{
+  int res;
+  
+  const char* bufdat = NULL;
+  number_t buflen = 0;
+  
+  CapeStream reply = cape_stream_new ();
+  
+  // the input stays in the frame until the handler returns
+  qbus_frame_get_member (frame, "D", &bufdat, &buflen);
+  
+  res = self->onPayload (qbus, self->ptr, bufdat, buflen, reply, err);
+  
+  switch (res)
+  {
+    case CAPE_ERR_NONE:
+    {
+      qbus_frame_set_payload (frame, QBUS_MTYPE_JSON, cape_stream_data (reply), cape_stream_size (reply));
+      break;
+    }
+    case CAPE_ERR_CONTINUE:
+    {
+      // without a message object there is no chain key to continue with
+      res = cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "payload methods can't continue");
+      
+      qbus_frame_set_err (frame, err);
+      break;
+    }
+    default:
+    {
+      qbus_frame_set_err (frame, err);
+      break;
+    }
+  }
+  
+  cape_stream_del (&reply);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_method_call_request (QBusMethod self, QBus qbus, QBusFrame frame, CapeErr err)
 {
   int res = CAPE_ERR_NONE;
   
+  if (self->onRaw)
+  {
+    return qbus_method_call_request__raw (self, qbus, frame, err);
+  }
+  
+  if (self->onPayload)
+  {
+    return qbus_method_call_request__payload (self, qbus, frame, err);
+  }
+  
   if (self->onMsg)
   {
     CapeUdc rinfo = NULL;
@@ -127,10 +287,78 @@ int qbus_method_call_request (QBusMethod self, QBus qbus, QBusFrame frame, CapeE
 
 //-----------------------------------------------------------------------------
 
+int qbus_method_call_request__raw_msg (QBusMethod self, QBus qbus, QBusM qin, QBusM qout, CapeErr err)
+{
+  int res;
+  struct QBusRaw_s raw;
+  
+  // local requests carry message objects, the handler needs the bytes
+  CapeString h = qbus_method__qmsg_to_raw (qin);
+  
+  raw.mtype = qin->mtype;
+  raw.bufdat = h;
+  raw.buflen = cape_str_size (h);
+  raw.chain_key = qbus_message_chain_key (qin);
+  raw.sender = qin->sender;
+  raw.reply = cape_stream_new ();
+  
+  res = self->onRaw (qbus, self->ptr, &raw, err);
+  
+  if (res == CAPE_ERR_NONE)
+  {
+    qbus_method__raw_to_qmsg (qout, raw.mtype, cape_stream_data (raw.reply), cape_stream_size (raw.reply));
+  }
+  
+  cape_stream_del (&(raw.reply));
+  cape_str_del (&h);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_method_call_request__payload_msg (QBusMethod self, QBus qbus, QBusM qin, QBusM qout, CapeErr err)
+{
+  int res;
+  
+  // local requests carry a tree, the handler needs the text
+  CapeString h = qin->cdata ? cape_json_to_s (qin->cdata) : NULL;
+  
+  CapeStream reply = cape_stream_new ();
+  
+  res = self->onPayload (qbus, self->ptr, h, h ? cape_str_size (h) : 0, reply, err);
+  
+  if (res == CAPE_ERR_NONE && cape_stream_size (reply))
+  {
+    qout->cdata = cape_json_from_buf (cape_stream_data (reply), cape_stream_size (reply));
+  }
+  else if (res == CAPE_ERR_CONTINUE)
+  {
+    res = cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "payload methods can't continue");
+  }
+  
+  cape_stream_del (&reply);
+  cape_str_del (&h);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_method_call_request__msg (QBusMethod self, QBus qbus, QBusM qin, QBusM qout, CapeErr err)
 {
   int res = CAPE_ERR_NONE;
   
+  if (self->onRaw)
+  {
+    return qbus_method_call_request__raw_msg (self, qbus, qin, qout, err);
+  }
+  
+  if (self->onPayload)
+  {
+    return qbus_method_call_request__payload_msg (self, qbus, qin, qout, err);
+  }
+  
   if (self->onMsg)
   {    
     // call the original callback    
@@ -142,15 +370,11 @@ int qbus_method_call_request__msg (QBusMethod self, QBus qbus, QBusM qin, QBusM
 
 //-----------------------------------------------------------------------------
 
-int qbus_method_call_response__continue_chain (QBusMethod self, QBus qbus, QBusRoute route, QBusFrame frame_original, CapeErr err)
+int qbus_method_call_response__continue_chain (QBusMethod self, QBus qbus, QBusRoute route, QBusM qin, CapeErr err)
 {
   int res = CAPE_ERR_NONE;
  
   QBusM qout = NULL;
-  QBusM qin = NULL;
-
-  // convert the frame content into the input message (expensive)
-  qin = qbus_frame_qin (frame_original);
 
   if (qin->rinfo == NULL)
   {
@@ -186,7 +410,6 @@ int qbus_method_call_response__continue_chain (QBusMethod self, QBus qbus, QBusR
   }
 
   // cleanup
-  qbus_message_del (&qin);
   qbus_message_del (&qout);
 
   return res;
@@ -194,37 +417,47 @@ int qbus_method_call_response__continue_chain (QBusMethod self, QBus qbus, QBusR
 
 //-----------------------------------------------------------------------------
 
-int qbus_method_call_response__response (QBusMethod self, QBus qbus, QBusRoute route, QBusFrame frame, CapeErr err)
+int qbus_method_call_response__raw (QBusMethod self, QBus qbus, number_t mtype, const char* bufdat, number_t buflen, const char* chain_key, const char* sender, CapeErr err)
 {
-  int res;
+  struct QBusRaw_s raw;
   
-  // convert the frame content into the input message (expensive)
-  QBusM qin = qbus_frame_qin (frame);
-
-  // call the original callback
-  res = self->onMsg (qbus, self->ptr, qin, NULL, err);
-
-  // cleanup
-  qbus_message_del (&qin);
-
-  return res;
+  raw.mtype = mtype;
+  raw.bufdat = bufdat;
+  raw.buflen = buflen;
+  raw.chain_key = chain_key;
+  raw.sender = sender;
+  raw.reply = NULL;
+  
+  return self->onRaw (qbus, self->ptr, &raw, err);
 }
 
 //-----------------------------------------------------------------------------
 
-int qbus_method_call_response (QBusMethod self, QBus qbus, QBusRoute route, QBusFrame frame, CapeErr err)
+int qbus_method_call_response__msg (QBusMethod self, QBus qbus, QBusRoute route, QBusM qin, CapeErr err)
 {
   int res = CAPE_ERR_NONE;
   
+  if (self->onRaw)
+  {
+    CapeString h = qbus_method__qmsg_to_raw (qin);
+    
+    res = qbus_method_call_response__raw (self, qbus, qin->mtype, h, cape_str_size (h), qin->chain_key, qin->sender, err);
+    
+    cape_str_del (&h);
+    
+    return res;
+  }
+  
   if (self->onMsg)
   {
     if (self->chain_key)
     {
-      return qbus_method_call_response__continue_chain (self, qbus, route, frame, err);
+      return qbus_method_call_response__continue_chain (self, qbus, route, qin, err);
     }
     else
     {
-      return qbus_method_call_response__response (self, qbus, route, frame, err);
+      // call the original callback
+      return self->onMsg (qbus, self->ptr, qin, NULL, err);
     }
   }
   
@@ -233,6 +466,32 @@ int qbus_method_call_response (QBusMethod self, QBus qbus, QBusRoute route, QBus
 
 //-----------------------------------------------------------------------------
 
+int qbus_method_call_response (QBusMethod self, QBus qbus, QBusRoute route, QBusFrame frame, CapeErr err)
+{
+  int res = CAPE_ERR_NONE;
+  
+  if (self->onRaw)
+  {
+    // no conversion at all
+    return qbus_method_call_response__raw (self, qbus, qbus_frame_get_mtype (frame), qbus_frame_get_data (frame), qbus_frame_get_size (frame), qbus_frame_get_chainkey (frame), qbus_frame_get_sender (frame), err);
+  }
+  
+  if (self->onMsg)
+  {
+    // convert the frame content into the input message (expensive)
+    QBusM qin = qbus_frame_qin (frame);
+    
+    res = qbus_method_call_response__msg (self, qbus, route, qin, err);
+    
+    // cleanup
+    qbus_message_del (&qin);
+  }
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
 struct QBusOnChangeCallback_s
 {
   fct_qbus_on_route_change fct;
@@ -260,12 +519,36 @@ struct QBusRoute_s
   
   CapeMap methods;
   
+  CapeMutex methods_mutex;    // methods are only added, the method objects stay valid
+  
+  CapeQueue queue_shared;     // worker pool for all methods with the shared policy
+  
+  QBusSubmit submit;          // reference, passes the results of the worker pools to the I/O thread
+  
   CapeMap chains;
   
+  CapeMap chains_parked;      // local calls in flight, with the response if it arrived before the chain was registered
+  
   CapeMutex chain_mutex;
   
   QBusRouteItems route_items;  
   
+  // for publish / subscribe
+  
+  CapeMap subscriptions;      // topic -> list of methods
+  
+  CapeMutex subscriptions_mutex;
+  
+  CapeString publish_prefix;  // unique for this instance, publishes get the id <prefix>.<sequence>
+  
+  number_t publish_seq;
+  
+  CapeMap publish_seen;       // ids of the last publishes which arrived here
+  
+  CapeList publish_order;     // the same ids, the oldest first
+  
+  CapeMutex publish_mutex;
+  
   // for on change
   
   CapeList on_changes_callbacks;
@@ -288,6 +571,50 @@ void __STDCALL qbus_route_methods_del (void* key, void* val)
 
 //-----------------------------------------------------------------------------
 
+void __STDCALL qbus_route_chains_parked_del (void* key, void* val)
+{
+  {
+    CapeString h = key; cape_str_del (&h);
+  }
+  {
+    QBusM msg = val;
+    
+    // a call in flight has no response yet
+    if (msg)
+    {
+      qbus_message_del (&msg);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_route_subscriptions_method_del (void* ptr)
+{
+  QBusMethod qmeth = ptr; qbus_method_del (&qmeth);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_route_subscriptions_del (void* key, void* val)
+{
+  {
+    CapeString h = key; cape_str_del (&h);
+  }
+  {
+    CapeList h = val; cape_list_del (&h);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_route_publish_seen_del (void* key, void* val)
+{
+  CapeString h = key; cape_str_del (&h);
+}
+
+//-----------------------------------------------------------------------------
+
 QBusRoute qbus_route_new (QBus qbus, const CapeString name)
 {
   QBusRoute self = CAPE_NEW (struct QBusRoute_s);
@@ -296,12 +623,25 @@ QBusRoute qbus_route_new (QBus qbus, const CapeString name)
   
   self->name = cape_str_cp (name);
   self->methods = cape_map_new (NULL, qbus_route_methods_del, NULL);
+  self->methods_mutex = cape_mutex_new ();
+  self->queue_shared = NULL;
+  self->submit = NULL;
   
   self->chain_mutex = cape_mutex_new ();
   self->chains = cape_map_new (NULL, qbus_route_methods_del, NULL);
+  self->chains_parked = cape_map_new (NULL, qbus_route_chains_parked_del, NULL);
   
   self->route_items = qbus_route_items_new ();
   
+  self->subscriptions = cape_map_new (NULL, qbus_route_subscriptions_del, NULL);
+  self->subscriptions_mutex = cape_mutex_new ();
+  
+  self->publish_prefix = cape_str_uuid ();
+  self->publish_seq = 0;
+  self->publish_seen = cape_map_new (NULL, qbus_route_publish_seen_del, NULL);
+  self->publish_order = cape_list_new (NULL);
+  self->publish_mutex = cape_mutex_new ();
+  
   self->on_changes_callbacks = cape_list_new (qbus_route_callbacks_on_del);
   self->on_changes_mutex = cape_mutex_new ();
   
@@ -310,18 +650,60 @@ QBusRoute qbus_route_new (QBus qbus, const CapeString name)
 
 //-----------------------------------------------------------------------------
 
+static void qbus_route_del__workers (QBusRoute self)
+{
+  // running methods still use the route, join all pools before anything is released
+  CapeMapCursor* cursor = cape_map_cursor_create (self->methods, CAPE_DIRECTION_FORW);
+  
+  while (cape_map_cursor_next (cursor))
+  {
+    QBusMethod qmeth = cape_map_node_value (cursor->node);
+    
+    if (qmeth->queue_owned)
+    {
+      // wait until all worker threads are done
+      cape_queue_del (&(qmeth->queue));
+      qmeth->queue_owned = FALSE;
+    }
+    
+    qmeth->queue = NULL;
+  }
+  
+  cape_map_cursor_destroy (&cursor);
+  
+  if (self->queue_shared)
+  {
+    cape_queue_del (&(self->queue_shared));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_route_del (QBusRoute* p_self)
 {
   QBusRoute self = *p_self;
   
+  qbus_route_del__workers (self);
+  
   cape_str_del (&(self->name));
+  
   cape_map_del (&(self->methods));
+  cape_mutex_del (&(self->methods_mutex));
   
   cape_mutex_del (&(self->chain_mutex));
   cape_map_del (&(self->chains));
+  cape_map_del (&(self->chains_parked));
   
   qbus_route_items_del (&(self->route_items));
   
+  cape_map_del (&(self->subscriptions));
+  cape_mutex_del (&(self->subscriptions_mutex));
+  
+  cape_list_del (&(self->publish_order));
+  cape_map_del (&(self->publish_seen));
+  cape_mutex_del (&(self->publish_mutex));
+  cape_str_del (&(self->publish_prefix));
+  
   cape_list_del (&(self->on_changes_callbacks));
   cape_mutex_del (&(self->on_changes_mutex));
   
@@ -330,48 +712,75 @@ void qbus_route_del (QBusRoute* p_self)
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_conn_reg (QBusRoute self, QBusConnection conn)
+void qbus_route_set_submit (QBusRoute self, QBusSubmit submit)
 {
-  // log
-  cape_log_msg (CAPE_LL_TRACE, "QBUS", "conn reg", "new connection");
-  
-  // send first frame
-  {
-    QBusFrame frame = qbus_frame_new ();
-        
-    qbus_frame_set (frame, QBUS_FRAME_TYPE_ROUTE_REQ, NULL, NULL, NULL, self->name);
-    
-    // finally send the frame
-    qbus_connection_send (conn, &frame);
-  }
+  self->submit = submit;
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_send_updates (QBusRoute self, QBusConnection conn_origin)
+void qbus_route_send_frame (QBusRoute self, const char* module, QBusFrame* p_frame)
 {
-  CapeList list_of_all_connections = qbus_route_items_conns (self->route_items, conn_origin);
+  // the connection might be gone meanwhile, find it again by the module
+  QBusConnection conn = qbus_route_items_get (self->route_items, module);
   
+  if (conn)
   {
-    CapeListCursor* cursor = cape_list_cursor_create (list_of_all_connections, CAPE_DIRECTION_FORW);
+    qbus_connection_send (conn, p_frame);
     
-    while (cape_list_cursor_next (cursor))
-    {
-      CapeUdc route_nodes;
+    qbus_connection_dec (&conn);
+  }
+  else
+  {
+    cape_log_fmt (CAPE_LL_WARN, "QBUS", "send frame", "frame can't be sent to %s", module);
+    
+    qbus_frame_del (p_frame);
+  }
+}
 
-      QBusConnection conn = cape_list_node_data (cursor->node);
+//-----------------------------------------------------------------------------
+
+void qbus_route_conn_reg (QBusRoute self, QBusConnection conn)
+{
+  // log
+  cape_log_msg (CAPE_LL_TRACE, "QBUS", "conn reg", "new connection");
+  
+  // send first frame
+  {
+    QBusFrame frame = qbus_frame_new ();
+        
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_ROUTE_REQ, NULL, NULL, NULL, self->name);
+    
+    // finally send the frame
+    qbus_connection_send (conn, &frame);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_send_updates (QBusRoute self, QBusConnection conn_origin)
+{
+  CapeList list_of_all_connections = qbus_route_items_conns (self->route_items, conn_origin);
+  
+  if (cape_list_size (list_of_all_connections))
+  {
+    QBusShared shared;
+    
+    // all connections get the same nodes, encode the frame only once
+    {
+      CapeStream cs = cape_stream_new ();
       
       QBusFrame frame = qbus_frame_new ();
       
-      qbus_frame_set (frame, QBUS_FRAME_TYPE_ROUTE_UPD, NULL, NULL, NULL, self->name);
+      CapeUdc route_nodes = qbus_route_items_nodes (self->route_items);
       
-      route_nodes = qbus_route_items_nodes (self->route_items);
+      qbus_frame_set (frame, QBUS_FRAME_TYPE_ROUTE_UPD, NULL, NULL, NULL, self->name);
       
       {
         CapeString h = cape_json_to_s (route_nodes);
         
         // log
-        cape_log_fmt (CAPE_LL_TRACE, "QBUS", "route update", "send route update: %s -> %s", h, qbus_connection_get (conn));
+        cape_log_fmt (CAPE_LL_TRACE, "QBUS", "route update", "send route update: %s -> %li connections", h, cape_list_size (list_of_all_connections));
         
         cape_str_del(&h);
       }
@@ -382,8 +791,79 @@ void qbus_route_send_updates (QBusRoute self, QBusConnection conn_origin)
         qbus_frame_set_udc (frame, QBUS_MTYPE_JSON, &route_nodes);
       }
       
-      // finally send the frame
-      qbus_connection_send (conn, &frame);
+      qbus_frame_encode (frame, cs);
+      
+      qbus_frame_del (&frame);
+      
+      shared = qbus_shared_new (&cs);
+    }
+    
+    {
+      CapeListCursor* cursor = cape_list_cursor_create (list_of_all_connections, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (cursor))
+      {
+        // finally send the frame
+        qbus_connection_send_shared (cape_list_node_data (cursor->node), shared);
+      }
+      
+      cape_list_cursor_destroy (&cursor);
+    }
+    
+    qbus_shared_del (&shared);
+  }
+  
+  cape_list_del (&list_of_all_connections);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_send_topics (QBusRoute self, QBusConnection conn)
+{
+  QBusFrame frame;
+  
+  // all topics which can be reached without the connection
+  CapeUdc topics = qbus_route_items_topics (self->route_items, conn);
+  
+  cape_mutex_lock (self->subscriptions_mutex);
+  
+  // add our own subscriptions
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (self->subscriptions, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
+    {
+      cape_udc_add_s_cp (topics, NULL, cape_map_node_key (cursor->node));
+    }
+    
+    cape_map_cursor_destroy (&cursor);
+  }
+  
+  cape_mutex_unlock (self->subscriptions_mutex);
+  
+  frame = qbus_frame_new ();
+  
+  qbus_frame_set (frame, QBUS_FRAME_TYPE_TOPICS_UPD, NULL, NULL, NULL, self->name);
+  
+  // set the payload frame
+  qbus_frame_set_udc (frame, QBUS_MTYPE_JSON, &topics);
+  
+  // finally send the frame
+  qbus_connection_send (conn, &frame);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_send_topic_updates (QBusRoute self, QBusConnection conn_origin)
+{
+  CapeList list_of_all_connections = qbus_route_items_conns (self->route_items, conn_origin);
+  
+  {
+    CapeListCursor* cursor = cape_list_cursor_create (list_of_all_connections, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (cursor))
+    {
+      qbus_route_send_topics (self, cape_list_node_data (cursor->node));
     }
     
     cape_list_cursor_destroy (&cursor);
@@ -403,7 +883,7 @@ void qbus_route_conn_rm (QBusRoute self, QBusConnection conn)
   
   if (module)
   {
-    qbus_route_items_rm (self->route_items, module);    
+    qbus_route_items_rm (self->route_items, module, conn);    
   }
   else
   {
@@ -412,6 +892,9 @@ void qbus_route_conn_rm (QBusRoute self, QBusConnection conn)
   
   qbus_route_send_updates (self, conn);  
   
+  // the subscriptions of the connection are gone
+  qbus_route_send_topic_updates (self, conn);
+  
   {
     CapeUdc modules = qbus_route_items_nodes (self->route_items);
 
@@ -421,13 +904,82 @@ void qbus_route_conn_rm (QBusRoute self, QBusConnection conn)
 
 //-----------------------------------------------------------------------------
 
-QBusConnection const qbus_route_module_find (QBusRoute self, const char* module_origin)
+QBusConnection qbus_route_module_find (QBusRoute self, const char* module_origin)
 {
   return qbus_route_items_get (self->route_items, module_origin);
 }
 
 //-----------------------------------------------------------------------------
 
+void qbus_route_heartbeat (QBusRoute self, number_t max_missed)
+{
+  // the snapshot holds references, connections dropped meanwhile stay valid
+  CapeList conns = qbus_route_items_conns_all (self->route_items);
+  
+  {
+    CapeListCursor* cursor = cape_list_cursor_create (conns, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (cursor))
+    {
+      QBusConnection conn = cape_list_node_data (cursor->node);
+      
+      number_t stamp;
+      number_t missed = qbus_connection_hb_next (conn, &stamp);
+      
+      if (missed > max_missed)
+      {
+        cape_log_fmt (CAPE_LL_WARN, "QBUS", "heartbeat", "no data from %s since %li heartbeats, drop connection", qbus_connection_get (conn), missed - 1);
+        
+        // removes the routes and fails over to other connections
+        qbus_connection_close (conn);
+      }
+      else
+      {
+        QBusFrame frame = qbus_frame_new ();
+        
+        // the stamp comes back with the pong
+        CapeString h = cape_str_fmt ("%li", stamp);
+        
+        qbus_frame_set (frame, QBUS_FRAME_TYPE_PING, h, NULL, NULL, self->name);
+        
+        cape_str_del (&h);
+        
+        qbus_connection_send (conn, &frame);
+      }
+    }
+    
+    cape_list_cursor_destroy (&cursor);
+  }
+  
+  cape_list_del (&conns);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_ping (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+{
+  // return the frame as it is
+  qbus_frame_set_type (*p_frame, QBUS_FRAME_TYPE_PONG, self->name);
+  
+  qbus_connection_send (conn, p_frame);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_pong (QBusRoute self, QBusConnection conn, QBusFrame frame)
+{
+  const CapeString chain_key = qbus_frame_get_chainkey (frame);
+  
+  if (chain_key)
+  {
+    qbus_connection_hb_pong (conn, strtol (chain_key, NULL, 10));
+    
+    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "heartbeat", "rtt to %s: %li ms", qbus_connection_get (conn), qbus_connection_rtt (conn));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_route_on_route_request (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
 {
   CapeUdc route_nodes;
@@ -459,6 +1011,9 @@ void qbus_route_on_route_response (QBusRoute self, QBusConnection conn, QBusFram
   // tell the others the new nodes
   qbus_route_send_updates (self, conn);  
 
+  // tell the new connection which topics can be reached
+  qbus_route_send_topics (self, conn);
+
   {
     CapeUdc modules = qbus_route_items_nodes (self->route_items);
     
@@ -491,17 +1046,6 @@ void qbus_route_on_route_update (QBusRoute self, QBusConnection conn, QBusFrame
 
 //-----------------------------------------------------------------------------
 
-typedef struct
-{
-  
-  CapeString chain_key;
-  
-  CapeString sender;
-  
-} QBusForwardData;
-
-//-----------------------------------------------------------------------------
-
 typedef struct
 {
   void* ptr;
@@ -512,45 +1056,54 @@ typedef struct
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_msg_foward (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+void qbus_route_frame__push_hop (QBusRoute self, QBusFrame frame)
 {
-  QBusFrame frame = *p_frame;
-
-  CapeString chain_key;
-
-  QBusForwardData* qbus_fd = CAPE_NEW (QBusForwardData);
-  
-  // create a copy of the chain key
-  qbus_fd->chain_key = cape_str_cp (qbus_frame_get_chainkey  (frame));
-  qbus_fd->sender = cape_str_cp (qbus_frame_get_sender  (frame));
-
-  // create a new chain key
-  chain_key = cape_str_uuid();
-  
-  cape_mutex_lock (self->chain_mutex);
-  
-  {
-    QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__FORWARD, qbus_fd, NULL, NULL);
-    
-    // transfer ownership of chain_key to the map
-    cape_map_insert (self->chains, (void*)chain_key, (void*)qmeth);
-  }
-  
-  cape_mutex_unlock (self->chain_mutex);
+  const CapeString chain_key = qbus_frame_get_chainkey (frame);
+  const CapeString sender = qbus_frame_get_sender (frame);
   
-  // chain key
+  // push the previous hop onto the hop stack of the chain key
+  // the response finds its way back without any state kept here
   {
-    CapeString h = cape_str_cp (chain_key);
+    CapeString h = cape_str_fmt ("%s%c%s", chain_key ? chain_key : "", QBUS_FRAME_HOP_SEPARATOR, sender ? sender : "");
     
     qbus_frame_set_chainkey (frame, &h);
   }
     
   // sender
   {
-    CapeString sender = cape_str_cp (self->name);
+    CapeString h = cape_str_cp (self->name);
     
-    qbus_frame_set_sender (frame, &sender);
+    qbus_frame_set_sender (frame, &h);
   }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_frame__pop_hop (QBusRoute self, QBusFrame frame, const char* hop)
+{
+  // pop the hop from the stack
+  CapeString sender = cape_str_cp (hop + 1);
+  CapeString chain_key = cape_str_cp (qbus_frame_get_chainkey (frame));
+  
+  chain_key[hop - qbus_frame_get_chainkey (frame)] = '\0';
+  
+  qbus_frame_set_chainkey (frame, &chain_key);
+  qbus_frame_set_sender (frame, &sender);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusConnection qbus_route_frame__hop_conn (QBusRoute self, const char* hop)
+{
+  // try to find a connection which might reach the previous hop
+  return qbus_route_items_get (self->route_items, hop + 1);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_foward (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+{
+  qbus_route_frame__push_hop (self, *p_frame);
     
   // forward the frame
   qbus_connection_send (conn, p_frame);
@@ -558,73 +1111,205 @@ void qbus_route_on_msg_foward (QBusRoute self, QBusConnection conn, QBusFrame* p
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_msg_method (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+int qbus_route_request__find_method_and_call (QBusRoute self, const char* method_origin, QBusM msg, QBusM qout, CapeErr err)
 {
-  QBusFrame frame = *p_frame;
+  int res;
   
+  // const local objects
   CapeMapNode n;
-  CapeString method = cape_str_cp (qbus_frame_get_method (frame));
+  QBusMethod qmeth;
+  
+  // local objects
+  CapeString method = cape_str_cp (method_origin);
   
+  // convert into lower case
   cape_str_to_lower (method);
   
+  // try to find the method
+  cape_mutex_lock (self->methods_mutex);
+  
   n = cape_map_find (self->methods, method);    
-  if (n)
-  {
-    QBusMethod qmeth = cape_map_node_value (n);
-    
-    switch (qmeth->type)
-    {
-      case QBUS_METHOD_TYPE__REQUEST:
-      {
-        CapeErr err = cape_err_new ();
-        
-        switch (qbus_method_call_request (qmeth, self->qbus, frame, err))
-        {
-          case CAPE_ERR_CONTINUE:
-          {
-            break;
-          }
-          default:
-          {
-            qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
-            
-            // finally send the frame
-            qbus_connection_send (conn, p_frame);
-          }
-        }
-        
-        cape_err_del (&err);        
-       
-        break;
-      }
-    }    
-  }
-  else
+  
+  cape_mutex_unlock (self->methods_mutex);
+  
+  if (n == NULL)
   {
-    CapeErr err = cape_err_new ();
-    
-    cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", qbus_frame_get_method (frame));
-    
-    qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
-    
-    qbus_frame_set_err (frame, err);
-    
-    cape_err_del (&err);
-    
-    // finally send the frame
-    qbus_connection_send (conn, p_frame);
+    res = cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", method);
+    goto exit_and_cleanup;
   }
   
-  cape_str_del (&method);
-}
-
-//-----------------------------------------------------------------------------
-
-void qbus_route_on_msg_request (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
-{
-  QBusFrame frame = *p_frame;
-  
-  const CapeString module = qbus_frame_get_module (frame);
+  // get the methods object
+  qmeth = cape_map_node_value (n);
+  
+  switch (qmeth->type)
+  {
+    case QBUS_METHOD_TYPE__REQUEST:
+    {
+      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call method '%s'", method_origin);
+      
+      res = qbus_method_call_request__msg (qmeth, self->qbus, msg, qout, err);
+      break;
+    }
+    default:
+    {
+      res = cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", method);
+      break;
+    }
+  }
+  
+exit_and_cleanup:
+  
+  cape_str_del (&method);  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusRoute route;
+  
+  QBusMethod qmeth;
+  
+  QBusFrame frame;
+  
+} QBusMethodTask;
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_route_on_msg_method__on_event (void* ptr, number_t pos, number_t queue_size)
+{
+  QBusMethodTask* task = ptr;
+  QBusRoute self = task->route;
+  
+  CapeErr err = cape_err_new ();
+  
+  switch (qbus_method_call_request (task->qmeth, self->qbus, task->frame, err))
+  {
+    case CAPE_ERR_CONTINUE:
+    {
+      break;
+    }
+    default:
+    {
+      CapeString sender = cape_str_cp (qbus_frame_get_sender (task->frame));
+      
+      qbus_frame_set_type (task->frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+      
+      // the I/O thread sends the response in the same way as all other frames
+      qbus_submit_frame (self->submit, sender, &(task->frame));
+      
+      cape_str_del (&sender);
+      
+      break;
+    }
+  }
+  
+  cape_err_del (&err);
+  
+  qbus_frame_del (&(task->frame));
+  
+  CAPE_DEL (&task, QBusMethodTask);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_method__queue (QBusRoute self, QBusMethod qmeth, QBusFrame* p_frame)
+{
+  QBusMethodTask* task = CAPE_NEW (QBusMethodTask);
+  
+  task->route = self;
+  task->qmeth = qmeth;
+  
+  // transfer ownership
+  task->frame = *p_frame;
+  *p_frame = NULL;
+  
+  cape_queue_add (qmeth->queue, NULL, qbus_route_on_msg_method__on_event, NULL, task, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_method (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+{
+  QBusFrame frame = *p_frame;
+  
+  CapeMapNode n;
+  CapeString method = cape_str_cp (qbus_frame_get_method (frame));
+  
+  cape_str_to_lower (method);
+  
+  cape_mutex_lock (self->methods_mutex);
+  
+  n = cape_map_find (self->methods, method);    
+  
+  cape_mutex_unlock (self->methods_mutex);
+  
+  if (n)
+  {
+    QBusMethod qmeth = cape_map_node_value (n);
+    
+    switch (qmeth->type)
+    {
+      case QBUS_METHOD_TYPE__REQUEST:
+      {
+        CapeErr err;
+        
+        if (qmeth->queue)
+        {
+          qbus_route_on_msg_method__queue (self, qmeth, p_frame);
+          break;
+        }
+        
+        err = cape_err_new ();
+        
+        switch (qbus_method_call_request (qmeth, self->qbus, frame, err))
+        {
+          case CAPE_ERR_CONTINUE:
+          {
+            break;
+          }
+          default:
+          {
+            qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+            
+            // finally send the frame
+            qbus_connection_send (conn, p_frame);
+          }
+        }
+        
+        cape_err_del (&err);        
+       
+        break;
+      }
+    }    
+  }
+  else
+  {
+    CapeErr err = cape_err_new ();
+    
+    cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", qbus_frame_get_method (frame));
+    
+    qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+    
+    qbus_frame_set_err (frame, err);
+    
+    cape_err_del (&err);
+    
+    // finally send the frame
+    qbus_connection_send (conn, p_frame);
+  }
+  
+  cape_str_del (&method);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_request (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+{
+  QBusFrame frame = *p_frame;
+  
+  const CapeString module = qbus_frame_get_module (frame);
   
   // check if the message was sent to us
   if (cape_str_equal (module, self->name))
@@ -633,191 +1318,1757 @@ void qbus_route_on_msg_request (QBusRoute self, QBusConnection conn, QBusFrame*
   }
   else  // the message was not send to us -> forward it 
   {
-    // try to find a connection which might reach the destination module
-    QBusConnection conn_forward = qbus_route_items_get (self->route_items, module);
-    if (conn_forward)
+    // try to find a connection which might reach the destination module
+    QBusConnection conn_forward = qbus_route_items_get (self->route_items, module);
+    if (conn_forward)
+    {
+      qbus_route_on_msg_foward (self, conn_forward, p_frame);
+      
+      qbus_connection_dec (&conn_forward);
+    }
+    else
+    {
+      CapeErr err = cape_err_new ();
+      
+      cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "no route to %s", module);
+      
+      qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+      
+      qbus_frame_set_err (frame, err);
+      
+      cape_err_del (&err);
+      
+      // finally send the frame
+      qbus_connection_send (conn, p_frame);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_forward (QBusRoute self, QBusFrame* p_frame, const char* hop)
+{
+  QBusConnection conn_forward = qbus_route_frame__hop_conn (self, hop);
+  if (conn_forward)
+  {
+    qbus_route_frame__pop_hop (self, *p_frame, hop);
+    
+    // forward the frame
+    qbus_connection_send (conn_forward, p_frame);
+    
+    qbus_connection_dec (&conn_forward);
+  }
+  else
+  {
+    // log
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "msg forward", "forward message can't be returned");
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_methods (QBusRoute self, QBusFrame* p_frame, QBusMethodsData** p_qbus_methods)
+{
+  QBusFrame frame = *p_frame;
+
+  QBusMethodsData* qbus_methods = *p_qbus_methods;
+  
+  if (qbus_methods->on_methods)
+  {
+    CapeErr err = cape_err_new ();
+    
+    CapeUdc methods = qbus_frame_get_udc (frame);
+    
+    qbus_methods->on_methods (self->qbus, qbus_methods->ptr, methods, err);
+
+    cape_udc_del (&methods);
+    
+    cape_err_del (&err);
+  }
+  
+  CAPE_DEL(p_qbus_methods, QBusMethodsData);
+}
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusRoute route;        // reference
+  
+  CapeUdc* results;       // one result node per call
+  
+  number_t size;
+  
+  number_t pending;       // outstanding frames and local calls
+  
+  CapeMutex mutex;
+  
+  // caller side
+  
+  void* ptr;
+  
+  fct_qbus_onMessage onMsg;
+  
+  // callee side
+  
+  CapeString chain_key;
+  
+  CapeString sender;
+  
+  // local calls get the key <key>.<position>
+  
+  CapeString key;
+  
+} QBusBatchData;
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusBatchData* batch;   // reference, released when the results were set
+  
+  number_t* positions;    // positions of the calls in the batch
+  
+  number_t size;
+  
+} QBusBatchGroup;
+
+//-----------------------------------------------------------------------------
+
+QBusBatchData* qbus_route_batch_data_new (QBusRoute route, number_t size)
+{
+  QBusBatchData* self = CAPE_NEW (QBusBatchData);
+  
+  self->route = route;
+  self->size = size;
+  
+  self->results = CAPE_ALLOC (sizeof(CapeUdc) * (size + 1));
+  memset (self->results, 0, sizeof(CapeUdc) * (size + 1));
+  
+  // guard, released when all calls were dispatched
+  self->pending = 1;
+  self->mutex = cape_mutex_new ();
+  
+  self->ptr = NULL;
+  self->onMsg = NULL;
+  
+  self->chain_key = NULL;
+  self->sender = NULL;
+  
+  self->key = NULL;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_batch_data_del (QBusBatchData** p_self)
+{
+  QBusBatchData* self = *p_self;
+  
+  number_t i;
+  
+  for (i = 0; i < self->size; i++)
+  {
+    cape_udc_del (&(self->results[i]));
+  }
+  
+  CAPE_FREE (self->results);
+  
+  cape_mutex_del (&(self->mutex));
+  
+  cape_str_del (&(self->chain_key));
+  cape_str_del (&(self->sender));
+  
+  cape_str_del (&(self->key));
+  
+  CAPE_DEL (p_self, QBusBatchData);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusBatchGroup* qbus_route_batch_group_new (QBusBatchData* batch, number_t size)
+{
+  QBusBatchGroup* self = CAPE_NEW (QBusBatchGroup);
+  
+  self->batch = batch;
+  self->size = size;
+  self->positions = CAPE_ALLOC (sizeof(number_t) * (size + 1));
+  
+  // one more outstanding response
+  cape_mutex_lock (batch->mutex);
+  
+  batch->pending++;
+  
+  cape_mutex_unlock (batch->mutex);
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_batch_group_del (QBusBatchGroup** p_self)
+{
+  QBusBatchGroup* self = *p_self;
+  
+  CAPE_FREE (self->positions);
+  
+  CAPE_DEL (p_self, QBusBatchGroup);
+}
+
+//-----------------------------------------------------------------------------
+
+CapeUdc qbus_route_batch__err_node (number_t err_code, const CapeString err_text)
+{
+  CapeUdc node = cape_udc_new (CAPE_UDC_NODE, NULL);
+  
+  cape_udc_add_s_cp (node, "err_text", err_text);
+  cape_udc_add_n (node, "err_code", err_code);
+  
+  return node;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_batch__set (QBusBatchData* self, number_t position, CapeUdc* p_node)
+{
+  if (position < self->size)
+  {
+    cape_udc_replace_mv (&(self->results[position]), p_node);
+  }
+  
+  cape_udc_del (p_node);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_batch__finish (QBusBatchData* self)
+{
+  QBusRoute route = self->route;
+  
+  number_t i;
+  
+  CapeUdc results = cape_udc_new (CAPE_UDC_LIST, NULL);
+  
+  // keep the order of the calls
+  for (i = 0; i < self->size; i++)
+  {
+    if (self->results[i])
+    {
+      cape_udc_add (results, &(self->results[i]));
+    }
+    else
+    {
+      CapeUdc h = qbus_route_batch__err_node (CAPE_ERR_NO_OBJECT, "no result");
+      
+      cape_udc_add (results, &h);
+    }
+  }
+  
+  if (self->chain_key)
+  {
+    // callee side: send all results back in one frame
+    QBusConnection conn = qbus_route_module_find (route, self->sender);
+    
+    if (conn)
+    {
+      CapeUdc rinfo;
+      
+      QBusFrame frame = qbus_frame_new ();
+      
+      qbus_frame_set (frame, QBUS_FRAME_TYPE_BATCH_RES, self->chain_key, self->sender, NULL, route->name);
+      
+      rinfo = qbus_frame_set_udc (frame, QBUS_MTYPE_JSON, &results);
+      
+      // finally send the frame
+      qbus_connection_send (conn, &frame);
+      
+      qbus_connection_dec (&conn);
+      
+      cape_udc_del (&rinfo);
+    }
+    else
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "batch", "no route for response '%s'", self->sender);
+    }
+  }
+  else if (self->onMsg)
+  {
+    // caller side: one callback for all calls
+    CapeErr err = cape_err_new ();
+    
+    QBusM qin = qbus_message_new (NULL, route->name);
+    
+    qin->mtype = QBUS_MTYPE_JSON;
+    qin->clist = results;
+    
+    results = NULL;
+    
+    self->onMsg (route->qbus, self->ptr, qin, NULL, err);
+    
+    qbus_message_del (&qin);
+    cape_err_del (&err);
+  }
+  
+  cape_udc_del (&results);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_batch__done (QBusBatchData** p_self)
+{
+  QBusBatchData* self = *p_self;
+  
+  int last;
+  
+  cape_mutex_lock (self->mutex);
+  
+  self->pending--;
+  
+  last = (self->pending == 0);
+  
+  cape_mutex_unlock (self->mutex);
+  
+  if (last)
+  {
+    qbus_route_batch__finish (self);
+    
+    qbus_route_batch_data_del (p_self);
+  }
+  
+  *p_self = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_route_batch_group__on_removed (void* ptr)
+{
+  QBusBatchGroup* group = ptr;
+  
+  if (group->batch)
+  {
+    number_t k;
+    
+    // no response arrived, the calls of the group are failed
+    for (k = 0; k < group->size; k++)
+    {
+      CapeUdc h = qbus_route_batch__err_node (CAPE_ERR_NO_OBJECT, "no response");
+      
+      qbus_route_batch__set (group->batch, group->positions[k], &h);
+    }
+    
+    // the last group finishes the batch
+    qbus_route_batch__done (&(group->batch));
+  }
+  
+  qbus_route_batch_group_del (&group);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_batch_response (QBusRoute self, QBusFrame frame, QBusBatchGroup* group)
+{
+  CapeUdc payload = qbus_frame_get_udc (frame);
+  
+  if (payload && cape_udc_type (payload) == CAPE_UDC_LIST)
+  {
+    number_t k = 0;
+    
+    CapeUdcCursor* cursor = cape_udc_cursor_new (payload, CAPE_DIRECTION_FORW);
+    
+    while (cape_udc_cursor_next (cursor) && k < group->size)
+    {
+      CapeUdc h = cape_udc_cp (cursor->item);
+      
+      qbus_route_batch__set (group->batch, group->positions[k], &h);
+      
+      k++;
+    }
+    
+    cape_udc_cursor_del (&cursor);
+  }
+  else
+  {
+    // the whole frame failed, e.g. no route
+    number_t k;
+    
+    number_t err_code = payload ? cape_udc_get_n (payload, "err_code", CAPE_ERR_RUNTIME) : CAPE_ERR_RUNTIME;
+    const CapeString err_text = payload ? cape_udc_get_s (payload, "err_text", "batch failed") : "batch failed";
+    
+    for (k = 0; k < group->size; k++)
+    {
+      CapeUdc h = qbus_route_batch__err_node (err_code, err_text);
+      
+      qbus_route_batch__set (group->batch, group->positions[k], &h);
+    }
+  }
+  
+  cape_udc_del (&payload);
+  
+  // the group itself is released with the chain
+  qbus_route_batch__done (&(group->batch));
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_response (QBusRoute self, QBusFrame* p_frame)
+{
+  QBusFrame frame = *p_frame;
+  
+  const CapeString chain_key = qbus_frame_get_chainkey (frame);
+  
+  if (chain_key)
+  {
+    CapeMapNode n;
+    
+    // check the hop stack, if the frame was forwarded by us
+    const char* hop = strrchr (chain_key, QBUS_FRAME_HOP_SEPARATOR);
+    
+    if (hop)
+    {
+      qbus_route_on_msg_forward (self, p_frame, hop);
+      return;
+    }
+   
+    cape_mutex_lock (self->chain_mutex);
+    
+    n = cape_map_find (self->chains, (void*)chain_key);
+    
+    if (n)
+    {
+      cape_map_extract (self->chains, n);
+    }
+    
+    cape_mutex_unlock (self->chain_mutex);
+
+    if (n)
+    {
+      QBusMethod qmeth = cape_map_node_value (n);
+      
+      switch (qmeth->type)
+      {
+        case QBUS_METHOD_TYPE__REQUEST:
+        {
+          // this should not happen
+          
+          break;
+        }
+        case QBUS_METHOD_TYPE__RESPONSE:
+        {
+          CapeErr err = cape_err_new ();
+          
+          qbus_method_call_response (qmeth, self->qbus, self, frame, err);
+
+          cape_err_del (&err);
+          
+          break;
+        }
+        case QBUS_METHOD_TYPE__METHODS:
+        {
+          QBusMethodsData* qbus_methods = qmeth->ptr;
+          
+          qbus_route_on_msg_methods (self, p_frame, &qbus_methods);
+         
+          break;
+        }
+        case QBUS_METHOD_TYPE__BATCH:
+        {
+          qbus_route_on_msg_batch_response (self, frame, qmeth->ptr);
+          
+          break;
+        }
+      }
+      
+      // cleanup
+      cape_map_del_node (self->chains, &n);
+    }
+    else
+    {
+      
+      
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+CapeUdc qbus_route__generate_modules_list (QBusRoute self)
+{
+  // encode methods into list
+  CapeUdc method_list = cape_udc_new (CAPE_UDC_LIST, NULL);
+
+  cape_mutex_lock (self->methods_mutex);
+  
+  // iterate through all methods
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (self->methods, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
+    {
+      //QBusMethod qmeth = cape_map_node_value (cursor->node);
+     
+      //CapeUdc method_node = cape_udc_new (CAPE_UDC_NODE, NULL);
+      
+      //cape_udc_add_s_cp (method_node, "name", cape_map_node_key (cursor->node));
+      
+      //cape_udc_add (method_list, &method_node);
+      
+      cape_udc_add_s_cp (method_list, NULL, cape_map_node_key (cursor->node));
+    }
+    
+    cape_map_cursor_destroy (&cursor);
+  }
+  
+  cape_mutex_unlock (self->methods_mutex);
+
+  return method_list;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+{
+  QBusFrame frame = *p_frame;
+  
+  const CapeString module = qbus_frame_get_module (frame);
+  
+  // check if the message was sent to us
+  if (cape_str_equal (module, self->name))
+  {
+    // encode methods into list
+    CapeUdc method_list = qbus_route__generate_modules_list (self);
+
+    /*
+    {
+      CapeString h = cape_json_to_s (method_list);
+      
+      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "methods req", "send methods: %s", h);
+      
+      cape_str_del(&h);
+    }
+    */
+
+    qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+    qbus_frame_set_udc (frame, QBUS_FRAME_TYPE_MSG_RES, &method_list);
+    
+    // send the frame back
+    qbus_connection_send (conn, p_frame);
+  }
+  else  // the message was not send to us -> forward it 
+  {
+    // try to find a connection which might reach the destination module
+    QBusConnection conn_forward = qbus_route_items_get (self->route_items, module);
+    if (conn_forward)
+    {
+      qbus_route_on_msg_foward (self, conn_forward, p_frame);
+      
+      qbus_connection_dec (&conn_forward);
+    }
+    else
+    {
+      CapeErr err = cape_err_new ();
+      
+      cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "no route to %s", module);
+      
+      qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+      
+      qbus_frame_set_err (frame, err);
+      
+      cape_err_del (&err);
+      
+      // finally send the frame
+      qbus_connection_send (conn, p_frame);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_notify__local (QBusRoute self, const char* method, QBusM qin)
+{
+  int res;
+  CapeErr err = cape_err_new ();
+  
+  // the output is never sent back
+  QBusM qout = qbus_message_new (NULL, NULL);
+  
+  // without chain key a continue won't produce a response
+  cape_str_del (&(qin->chain_key));
+  
+  res = qbus_route_request__find_method_and_call (self, method, qin, qout, err);
+  
+  switch (res)
+  {
+    case CAPE_ERR_NONE:
+    case CAPE_ERR_CONTINUE:
+    {
+      break;
+    }
+    default:
+    {
+      cape_log_fmt (CAPE_LL_WARN, "QBUS", "notify", "method '%s' returned an error: %s", method, cape_err_text (err));
+      break;
+    }
+  }
+  
+  qbus_message_del (&qout);
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_notify (QBusRoute self, QBusFrame* p_frame)
+{
+  QBusFrame frame = *p_frame;
+  
+  const CapeString module = qbus_frame_get_module (frame);
+  
+  // check if the message was sent to us
+  if (cape_str_equal (module, self->name))
+  {
+    // convert the frame content into the input message (expensive)
+    QBusM qin = qbus_frame_qin (frame);
+    
+    qbus_route_notify__local (self, qbus_frame_get_method (frame), qin);
+    
+    qbus_message_del (&qin);
+  }
+  else  // the message was not send to us -> forward it 
+  {
+    // try to find a connection which might reach the destination module
+    QBusConnection conn_forward = qbus_route_items_get (self->route_items, module);
+    if (conn_forward)
+    {
+      // no response will come back, so no chain entry is needed
+      qbus_connection_send (conn_forward, p_frame);
+      
+      qbus_connection_dec (&conn_forward);
+    }
+    else
+    {
+      cape_log_fmt (CAPE_LL_WARN, "QBUS", "notify", "no route to module %s, message dropped", module);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_topics_update (QBusRoute self, QBusConnection conn, QBusFrame frame)
+{
+  // only accept subscriptions from registered connections
+  if (qbus_connection_get (conn))
+  {
+    CapeUdc topics = qbus_frame_get_udc (frame);
+    
+    if (qbus_route_items_topics_set (self->route_items, conn, topics))
+    {
+      // spread the subscriptions, only if something has changed
+      // otherwise redundant links would send updates forever
+      qbus_route_send_topic_updates (self, conn);
+    }
+    
+    cape_udc_del (&topics);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route__local_copy (QBusM dest, QBusM src)
+{
+  if (src->clist)
+  {
+    dest->clist = cape_udc_cp (src->clist);
+  }
+  
+  if (src->cdata)
+  {
+    dest->cdata = cape_udc_cp (src->cdata);
+  }
+  
+  if (src->pdata)
+  {
+    dest->pdata = cape_udc_cp (src->pdata);
+  }
+  
+  if (src->rinfo)
+  {
+    dest->rinfo = cape_udc_cp (src->rinfo);
+  }
+  
+  if (src->files)
+  {
+    dest->files = cape_udc_cp (src->files);
+  }
+  
+  dest->mtype = src->mtype;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_publish__local (QBusRoute self, const CapeString topic_origin, QBusM msg)
+{
+  CapeList methods = cape_list_new (NULL);
+  
+  CapeString topic = cape_str_cp (topic_origin);
+  
+  cape_str_to_lower (topic);
+  
+  cape_mutex_lock (self->subscriptions_mutex);
+  
+  {
+    CapeMapNode n = cape_map_find (self->subscriptions, (void*)topic);
+    if (n)
+    {
+      CapeListCursor cursor; cape_list_cursor_init (cape_map_node_value (n), &cursor, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (&cursor))
+      {
+        cape_list_push_back (methods, cape_list_node_data (cursor.node));
+      }
+    }
+  }
+  
+  cape_mutex_unlock (self->subscriptions_mutex);
+  
+  // call the subscribers outside of the monitor
+  {
+    CapeListCursor cursor; cape_list_cursor_init (methods, &cursor, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (&cursor))
+    {
+      QBusMethod qmeth = cape_list_node_data (cursor.node);
+      
+      CapeErr err = cape_err_new ();
+      
+      // each subscriber gets its own copy, the output is never sent back
+      QBusM qin = qbus_message_new (NULL, msg->sender);
+      QBusM qout = qbus_message_new (NULL, NULL);
+      
+      // qin has no chain key, a continue won't produce a response
+      qbus_route__local_copy (qin, msg);
+      
+      switch (qbus_method_call_request__msg (qmeth, self->qbus, qin, qout, err))
+      {
+        case CAPE_ERR_NONE:
+        case CAPE_ERR_CONTINUE:
+        {
+          break;
+        }
+        default:
+        {
+          cape_log_fmt (CAPE_LL_WARN, "QBUS", "publish", "subscriber of '%s' returned an error: %s", topic, cape_err_text (err));
+          break;
+        }
+      }
+      
+      qbus_message_del (&qin);
+      qbus_message_del (&qout);
+      
+      cape_err_del (&err);
+    }
+  }
+  
+  cape_list_del (&methods);
+  cape_str_del (&topic);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_publish__forward (QBusRoute self, QBusFrame frame, CapeList conns)
+{
+  QBusShared shared;
+  
+  // encode the frame only once for all connections
+  {
+    CapeStream cs = cape_stream_new ();
+    
+    qbus_frame_encode (frame, cs);
+    
+    shared = qbus_shared_new (&cs);
+  }
+  
+  {
+    CapeListCursor cursor; cape_list_cursor_init (conns, &cursor, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (&cursor))
+    {
+      qbus_connection_send_shared (cape_list_node_data (cursor.node), shared);
+    }
+  }
+  
+  qbus_shared_del (&shared);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_route_publish__seen (QBusRoute self, QBusFrame frame)
+{
+  int res = FALSE;
+  
+  const CapeString chain_key = qbus_frame_get_chainkey (frame);
+  const char* hop;
+  
+  if (chain_key == NULL)
+  {
+    // older nodes don't send an id
+    return FALSE;
+  }
+  
+  // the hops behind the id, a loop brings the publish back to a node it passed already
+  for (hop = strchr (chain_key, QBUS_FRAME_HOP_SEPARATOR); hop; hop = strchr (hop + 1, QBUS_FRAME_HOP_SEPARATOR))
+  {
+    const char* end = strchr (hop + 1, QBUS_FRAME_HOP_SEPARATOR);
+    number_t len = end ? end - hop - 1 : (number_t)strlen (hop + 1);
+    
+    if (len == cape_str_size (self->name) && strncmp (hop + 1, self->name, len) == 0)
+    {
+      return TRUE;
+    }
+  }
+  
+  // different paths of the mesh deliver the same publish more than once
+  {
+    CapeString id;
+    
+    hop = strchr (chain_key, QBUS_FRAME_HOP_SEPARATOR);
+    
+    id = hop ? cape_str_sub (chain_key, hop - chain_key) : cape_str_cp (chain_key);
+    
+    cape_mutex_lock (self->publish_mutex);
+    
+    if (cape_map_find (self->publish_seen, (void*)id))
+    {
+      res = TRUE;
+      
+      cape_str_del (&id);
+    }
+    else
+    {
+      cape_list_push_back (self->publish_order, (void*)id);
+      
+      // transfer ownership of id to the map
+      cape_map_insert (self->publish_seen, (void*)id, NULL);
+      
+      if (cape_list_size (self->publish_order) > QBUS_ROUTE_PUBLISH_SEEN)
+      {
+        CapeMapNode n = cape_map_find (self->publish_seen, cape_list_pop_front (self->publish_order));
+        
+        if (n)
+        {
+          cape_map_erase (self->publish_seen, n);
+        }
+      }
+    }
+    
+    cape_mutex_unlock (self->publish_mutex);
+  }
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_on_msg_publish (QBusRoute self, QBusConnection conn, QBusFrame frame)
+{
+  CapeString topic;
+  CapeList conns;
+  QBusM qin;
+  
+  if (qbus_route_publish__seen (self, frame))
+  {
+    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "publish", "drop duplicate of '%s' from %s", qbus_frame_get_module (frame), qbus_frame_get_sender (frame));
+    return;
+  }
+  
+  // the sender is rewritten by the forwarding
+  qin = qbus_frame_qin (frame);
+  
+  if (qin->chain_key)
+  {
+    // the first hop is the origin of the publish
+    const char* hop = strchr (qin->chain_key, QBUS_FRAME_HOP_SEPARATOR);
+    
+    if (hop)
+    {
+      const char* end = strchr (hop + 1, QBUS_FRAME_HOP_SEPARATOR);
+      
+      CapeString h = end ? cape_str_sub (hop + 1, end - hop - 1) : cape_str_cp (hop + 1);
+      
+      cape_str_replace_mv (&(qin->sender), &h);
+    }
+    
+    // the id is only used for routing
+    cape_str_del (&(qin->chain_key));
+  }
+  
+  topic = cape_str_cp (qbus_frame_get_module (frame));
+  
+  // forward only to connections with subscribers, but never back
+  conns = qbus_route_items_topic_conns (self->route_items, topic, conn);
+  
+  if (cape_list_size (conns))
+  {
+    // the next nodes see which nodes the publish has passed already
+    qbus_route_frame__push_hop (self, frame);
+    
+    qbus_route_publish__forward (self, frame, conns);
+  }
+  
+  // deliver to our own subscribers
+  qbus_route_publish__local (self, topic, qin);
+  
+  qbus_message_del (&qin);
+  
+  cape_str_del (&topic);
+  cape_list_del (&conns);
+}
+
+//-----------------------------------------------------------------------------
+
+CapeQueue qbus_route_meth_reg__queue (number_t workers, CapeErr err)
+{
+  CapeQueue queue = cape_queue_new (0);
+  
+  if (cape_queue_start (queue, workers < 1 ? 1 : workers, err))
+  {
+    cape_queue_del (&queue);
+  }
+  
+  return queue;
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_route_meth_reg__add (QBusRoute self, const char* method_origin, QBusMethod qmeth, number_t policy, number_t workers, CapeErr err)
+{
+  CapeString method = cape_str_cp (method_origin);
+  
+  cape_str_to_lower (method);
+  
+  switch (policy)
+  {
+    case QBUS_EXEC_SHARED:
+    {
+      cape_mutex_lock (self->methods_mutex);
+      
+      // the shared pool is created with the first method using it
+      if (self->queue_shared == NULL)
+      {
+        self->queue_shared = qbus_route_meth_reg__queue (workers, err);
+      }
+      
+      qmeth->queue = self->queue_shared;
+      
+      cape_mutex_unlock (self->methods_mutex);
+      
+      break;
+    }
+    case QBUS_EXEC_DEDICATED:
+    {
+      qmeth->queue = qbus_route_meth_reg__queue (workers, err);
+      qmeth->queue_owned = TRUE;
+      
+      break;
+    }
+  }
+  
+  if (policy != QBUS_EXEC_INLINE && qmeth->queue == NULL)
+  {
+    qmeth->onRm = NULL;
+    
+    qbus_method_del (&qmeth);
+    cape_str_del (&method);
+    
+    return cape_err_code (err);
+  }
+  
+  cape_mutex_lock (self->methods_mutex);
+  
+  cape_map_insert (self->methods, (void*)method, (void*)qmeth);
+  
+  cape_mutex_unlock (self->methods_mutex);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_meth_reg (QBusRoute self, const char* method_origin, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__REQUEST, ptr, onMsg, onRm);
+  
+  return qbus_route_meth_reg__add (self, method_origin, qmeth, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_meth_reg_raw (QBusRoute self, const char* method_origin, void* ptr, fct_qbus_onRaw onRaw, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__REQUEST, ptr, NULL, onRm);
+  
+  qmeth->onRaw = onRaw;
+  
+  return qbus_route_meth_reg__add (self, method_origin, qmeth, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_meth_reg_payload (QBusRoute self, const char* method_origin, void* ptr, fct_qbus_onPayload onPayload, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__REQUEST, ptr, NULL, onRm);
+  
+  qmeth->onPayload = onPayload;
+  
+  return qbus_route_meth_reg__add (self, method_origin, qmeth, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_no_route (QBusRoute self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm)
+{
+  // log
+  cape_log_fmt (CAPE_LL_WARN, "QBUS", "msg forward", "no route to module %s", module);
+  
+  if (onMsg)
+  {
+    if (msg->err)
+    {
+      cape_err_del (&(msg->err));
+    }
+    
+    // create a new error object
+    msg->err = cape_err_new ();
+    
+    // set the error
+    cape_err_set (msg->err, CAPE_ERR_NOT_FOUND, "no route to module");
+    
+    {
+      // create a temporary error object
+      CapeErr err = cape_err_new ();
+      
+      int res = onMsg (self->qbus, ptr, msg, NULL, err);
+      if (res)
+      {
+        // TODO: handle error
+        
+      }
+      
+      cape_err_del (&err);
+    }      
+  }  
+  
+  // no response method was created, release the handler here
+  if (onRm)
+  {
+    onRm (ptr);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_conn_request (QBusRoute self, QBusConnection const conn, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, int cont)
+{
+  // create a new frame
+  QBusFrame frame = qbus_frame_new ();
+  
+  {
+    // releases the handler with the chain, after the response or on shutdown
+    QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__RESPONSE, ptr, onMsg, onRm);
+    
+    CapeString h = cape_str_uuid();
+
+    // add default content
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_REQ, h, module, method, self->name);
+    
+    // add message content
+    msg->rinfo = qbus_frame_set_qmsg (frame, msg, NULL);
+
+    if (cont && msg->chain_key)
+    {
+      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "add chainkey '%s' for continue", msg->chain_key);
+      
+      qbus_method_continue (qmeth, msg->chain_key, &(msg->sender), &(msg->rinfo));
+    }
+    
+    cape_mutex_lock (self->chain_mutex);
+    
+    cape_map_insert (self->chains, (void*)h, (void*)qmeth);
+
+    cape_mutex_unlock (self->chain_mutex);
+  }
+  
+  // finally send the frame
+  qbus_connection_send (conn, &frame);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route__local_transfer (QBusM dest, QBusM src)
+{
+  // transfer ownership, the remote path consumes the content as well
+  cape_udc_replace_mv (&(dest->clist), &(src->clist));
+  cape_udc_replace_mv (&(dest->cdata), &(src->cdata));
+  cape_udc_replace_mv (&(dest->pdata), &(src->pdata));
+  cape_udc_replace_mv (&(dest->files), &(src->files));
+  
+  // the received files follow their paths
+  qbus_blobs_del (&(dest->blobs));
+  
+  dest->blobs = src->blobs;
+  src->blobs = NULL;
+  
+  dest->mtype = src->mtype;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route__local_set_err (QBusM msg, CapeErr err)
+{
+  // the same rule as in the frame: only errors with a code are transported
+  if (err && cape_err_code (err))
+  {
+    cape_err_del (&(msg->err));
+    
+    msg->err = cape_err_new ();
+    
+    cape_err_set (msg->err, cape_err_code (err), cape_err_text (err));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route__local_deliver (QBusRoute self, QBusMethod qmeth, QBusM qin)
+{
+  CapeErr err = cape_err_new ();
+  
+  // the response was sent from us
+  cape_str_replace_cp (&(qin->sender), self->name);
+
+  qbus_method_call_response__msg (qmeth, self->qbus, self, qin, err);
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_request__local_chains (QBusRoute self, CapeString* p_chain_key, QBusMethod* p_qmeth)
+{
+  CapeMapNode n;
+  QBusM parked = NULL;
+  
+  cape_mutex_lock (self->chain_mutex);
+  
+  // the call is not in flight anymore
+  n = cape_map_find (self->chains_parked, (void*)*p_chain_key);
+  
+  if (n)
+  {
+    cape_map_extract (self->chains_parked, n);
+    
+    // the method might have finished already by a local continue
+    parked = cape_map_node_value (n);
+  }
+  
+  if (parked == NULL)
+  {
+    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "add chainkey '%s' for continue", *p_chain_key);
+
+    // transfer ownership of chain_key and the method to the map
+    cape_map_insert (self->chains, (void*)*p_chain_key, (void*)*p_qmeth);
+    
+    *p_chain_key = NULL;
+    *p_qmeth = NULL;
+  }
+  
+  cape_mutex_unlock (self->chain_mutex);
+  
+  if (parked)
+  {
+    qbus_route__local_deliver (self, *p_qmeth, parked);
+  }
+  
+  if (n)
+  {
+    // cleanup
+    cape_map_del_node (self->chains_parked, &n);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_route_request__local_flight (QBusRoute self, const CapeString chain_key, int active)
+{
+  cape_mutex_lock (self->chain_mutex);
+  
+  if (active)
+  {
+    // a response which arrives before the chain was registered will be parked
+    cape_map_insert (self->chains_parked, (void*)cape_str_cp (chain_key), NULL);
+  }
+  else
+  {
+    CapeMapNode n = cape_map_find (self->chains_parked, (void*)chain_key);
+    
+    if (n)
+    {
+      cape_map_erase (self->chains_parked, n);
+    }
+  }
+  
+  cape_mutex_unlock (self->chain_mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_request__local_response (QBusRoute self, QBusMethod qmeth, QBusM qout, CapeErr err)
+{
+  cape_log_msg (CAPE_LL_TRACE, "QBUS", "request", "call method callback");
+  
+  qbus_route__local_set_err (qout, err);
+  
+  qbus_route__local_deliver (self, qmeth, qout);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_request__local_call (QBusRoute self, const char* method_origin, QBusM msg, QBusMethod qmeth, int cont, const CapeString key)
+{
+  int res;
+  CapeErr err = cape_err_new ();
+  CapeString chain_key;
+  
+  QBusM qin = qbus_message_new (key, self->name);
+  QBusM qout = qbus_message_new (NULL, NULL);
+  
+  // the method might continue and respond from another thread before it returns
+  chain_key = cape_str_cp (qbus_message_chain_key (qin));
+  
+  qbus_route_request__local_flight (self, chain_key, TRUE);
+  
+  qbus_route__local_transfer (qin, msg);
+
+  // both sides keep the rinfo
+  if (msg->rinfo)
+  {
+    qin->rinfo = cape_udc_cp (msg->rinfo);
+  }
+  
+  if (cont && msg->chain_key)
+  {
+    qbus_method_continue (qmeth, msg->chain_key, &(msg->sender), &(msg->rinfo));
+  }
+  
+  // set default message type
+  qout->mtype = QBUS_MTYPE_JSON;
+  
+  res = qbus_route_request__find_method_and_call (self, method_origin, qin, qout, err);
+  
+  switch (res)
+  {
+    case CAPE_ERR_CONTINUE:
+    {
+      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call returned a continued state");
+      
+      // the response will be delivered by qbus_route_response
+      qbus_route_request__local_chains (self, &chain_key, &qmeth);
+      
+      break;
+    }
+    default:
+    {
+      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call returned a terminated state");
+      
+      qbus_route_request__local_flight (self, chain_key, FALSE);
+      
+      // this requests ends here, now send the results back
+      qbus_route_request__local_response (self, qmeth, qout, err);
+      
+      break;
+    }
+  }
+  
+  // cleanup
+  if (qmeth)
+  {
+    qbus_method_del (&qmeth);
+  }
+  
+  qbus_message_del (&qin);
+  qbus_message_del (&qout);
+  
+  cape_str_del (&chain_key);
+  cape_err_del (&err);
+  
+  // the result was or will be delivered to the callback
+  return CAPE_ERR_CONTINUE;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_request__local_request (QBusRoute self, const char* method_origin, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, int cont, const CapeString key)
+{
+  // the response handler, it will be added to the chains only if needed
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__RESPONSE, ptr, onMsg, onRm);
+  
+  return qbus_route_request__local_call (self, method_origin, msg, qmeth, cont, key);
+}
+ 
+//-----------------------------------------------------------------------------
+
+int qbus_route_request (QBusRoute self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, int cont, CapeErr err)
+{
+  if (cape_str_equal (module, self->name))
+  {
+    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "execute local request on '%s'", module);
+    
+    return qbus_route_request__local_request (self, method, msg, ptr, onMsg, onRm, cont, NULL);
+  }
+  else
+  {
+    QBusConnection conn = qbus_route_module_find (self, module);
+    
+    if (conn)
+    {
+      qbus_route_conn_request (self, conn, module, method, msg, ptr, onMsg, onRm, cont);
+      
+      qbus_connection_dec (&conn);
+      
+      return CAPE_ERR_CONTINUE;
+    }
+    else
+    {
+      qbus_route_no_route (self, module, method, msg, ptr, onMsg, onRm);
+
+      return cape_err_set (err, CAPE_ERR_NOT_FOUND, "no route to module");
+    }
+  }  
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_response__local (QBusRoute self, QBusM msg, CapeErr err)
+{
+  CapeMapNode n;
+  
+  if (msg->chain_key == NULL)
+  {
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "route response", "local response without chain key");
+    return;
+  }
+  
+  cape_mutex_lock (self->chain_mutex);
+  
+  n = cape_map_find (self->chains, (void*)msg->chain_key);
+  
+  if (n)
+  {
+    cape_map_extract (self->chains, n);
+  }
+  else
+  {
+    CapeMapNode flight = cape_map_find (self->chains_parked, (void*)msg->chain_key);
+    
+    if (flight && cape_map_node_value (flight) == NULL)
+    {
+      // the method continued and finished before the chain was registered
+      // park the response until qbus_route_request__local_chains picks it up
+      QBusM parked = qbus_message_new (msg->chain_key, self->name);
+      
+      qbus_route__local_transfer (parked, msg);
+      qbus_route__local_set_err (parked, err);
+      
+      cape_udc_replace_mv (&(parked->rinfo), &(msg->rinfo));
+      
+      // replace the marker of the call by the response
+      cape_map_erase (self->chains_parked, flight);
+      cape_map_insert (self->chains_parked, (void*)cape_str_cp (msg->chain_key), (void*)parked);
+    }
+    else
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "route response", "no chain found for key '%s'", msg->chain_key);
+    }
+  }
+  
+  cape_mutex_unlock (self->chain_mutex);
+  
+  if (n)
+  {
+    qbus_route__local_set_err (msg, err);
+    
+    qbus_route__local_deliver (self, cape_map_node_value (n), msg);
+    
+    // cleanup
+    cape_map_del_node (self->chains, &n);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_response (QBusRoute self, const char* module, QBusM msg, CapeErr err)
+{
+  QBusConnection conn;
+  
+  if (cape_str_equal (module, self->name))
+  {
+    qbus_route_response__local (self, msg, err);
+    return;
+  }
+  
+  conn = qbus_route_module_find (self, module);
+  
+  if (conn)
+  {
+    CapeUdc rinfo = NULL;
+    
+    // create a new frame
+    QBusFrame frame = qbus_frame_new ();
+    
+    // add default content
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_RES, msg->chain_key, module, NULL, self->name);
+    
+    // add message content
+    rinfo = qbus_frame_set_qmsg (frame, msg, err);
+    
+    // finally send the frame
+    qbus_connection_send (conn, &frame);
+    
+    qbus_connection_dec (&conn);
+    
+    cape_udc_del (&rinfo);
+  }
+  else
+  {
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "route response", "no route for response '%s'", module);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_request_raw (QBusRoute self, const char* module, const char* method, number_t mtype, const char* bufdat, number_t buflen, void* ptr, fct_qbus_onRaw onRaw, fct_qbus_onRemoved onRm, CapeErr err)
+{
+  QBusConnection conn;
+  
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__RESPONSE, ptr, NULL, onRm);
+  
+  qmeth->onRaw = onRaw;
+  
+  if (cape_str_equal (module, self->name))
+  {
+    int res;
+    
+    // local methods work on message objects
+    QBusM msg = qbus_message_new (NULL, NULL);
+    
+    qbus_method__raw_to_qmsg (msg, mtype, bufdat, buflen);
+    
+    res = qbus_route_request__local_call (self, method, msg, qmeth, FALSE, NULL);
+    
+    qbus_message_del (&msg);
+    
+    return res;
+  }
+  
+  conn = qbus_route_module_find (self, module);
+  
+  if (conn)
+  {
+    QBusFrame frame = qbus_frame_new ();
+    
+    CapeString h = cape_str_uuid ();
+    
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_REQ, h, module, method, self->name);
+    
+    // the payload is passed as it is
+    qbus_frame_set_raw (frame, mtype, bufdat, buflen);
+    
+    cape_mutex_lock (self->chain_mutex);
+    
+    // transfer ownership of h and the method to the map
+    cape_map_insert (self->chains, (void*)h, (void*)qmeth);
+    
+    cape_mutex_unlock (self->chain_mutex);
+    
+    qbus_connection_send (conn, &frame);
+    
+    qbus_connection_dec (&conn);
+    
+    return CAPE_ERR_CONTINUE;
+  }
+  
+  cape_log_fmt (CAPE_LL_WARN, "QBUS", "msg forward", "no route to module %s", module);
+  
+  // deliver the error in the same way as a remote error
+  {
+    QBusFrame frame = qbus_frame_new ();
+    CapeErr err_cb = cape_err_new ();
+    
+    cape_err_set (err, CAPE_ERR_NOT_FOUND, "no route to module");
+    
+    qbus_frame_set_err (frame, err);
+    
+    qbus_method_call_response (qmeth, self->qbus, self, frame, err_cb);
+    
+    cape_err_del (&err_cb);
+    qbus_frame_del (&frame);
+  }
+  
+  qbus_method_del (&qmeth);
+  
+  return cape_err_code (err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_response_raw (QBusRoute self, const char* module, const char* chain_key, number_t mtype, const char* bufdat, number_t buflen, CapeErr err)
+{
+  QBusConnection conn;
+  
+  if (cape_str_equal (module, self->name))
+  {
+    QBusM msg = qbus_message_new (chain_key, NULL);
+    
+    qbus_method__raw_to_qmsg (msg, mtype, bufdat, buflen);
+    
+    // errors are part of the payload
+    qbus_route_response__local (self, msg, NULL);
+    
+    qbus_message_del (&msg);
+    
+    return CAPE_ERR_NONE;
+  }
+  
+  conn = qbus_route_module_find (self, module);
+  
+  if (conn)
+  {
+    QBusFrame frame = qbus_frame_new ();
+    
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_RES, chain_key, module, NULL, self->name);
+    
+    qbus_frame_set_raw (frame, mtype, bufdat, buflen);
+    
+    qbus_connection_send (conn, &frame);
+    
+    qbus_connection_dec (&conn);
+    
+    return CAPE_ERR_NONE;
+  }
+  
+  return cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "no route for response '%s'", module);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_notify (QBusRoute self, const char* module, const char* method, QBusM msg, CapeErr err)
+{
+  if (cape_str_equal (module, self->name))
+  {
+    QBusM qin = qbus_message_new (NULL, self->name);
+    
+    qbus_route__local_transfer (qin, msg);
+    
+    if (msg->rinfo)
+    {
+      qin->rinfo = cape_udc_cp (msg->rinfo);
+    }
+
+    qbus_route_notify__local (self, method, qin);
+    
+    qbus_message_del (&qin);
+  }
+  else
+  {
+    QBusConnection conn = qbus_route_module_find (self, module);
+    
+    if (conn)
+    {
+      // create a new frame
+      QBusFrame frame = qbus_frame_new ();
+      
+      // no chain key, nothing will be registered in the chains
+      qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_NOTIFY, NULL, module, method, self->name);
+      
+      // add message content
+      msg->rinfo = qbus_frame_set_qmsg (frame, msg, NULL);
+      
+      // finally send the frame
+      qbus_connection_send (conn, &frame);
+      
+      qbus_connection_dec (&conn);
+    }
+    else
+    {
+      cape_log_fmt (CAPE_LL_WARN, "QBUS", "notify", "no route to module %s", module);
+      
+      return cape_err_set (err, CAPE_ERR_NOT_FOUND, "no route to module");
+    }
+  }
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_subscribe (QBusRoute self, const char* topic_origin, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm)
+{
+  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__REQUEST, ptr, onMsg, onRm);
+  
+  CapeString topic = cape_str_cp (topic_origin);
+  
+  cape_str_to_lower (topic);
+  
+  cape_mutex_lock (self->subscriptions_mutex);
+  
+  {
+    CapeMapNode n = cape_map_find (self->subscriptions, (void*)topic);
+    if (n)
     {
-      qbus_route_on_msg_foward (self, conn_forward, p_frame);
+      cape_list_push_back (cape_map_node_value (n), (void*)qmeth);
+      
+      cape_str_del (&topic);
     }
     else
     {
-      CapeErr err = cape_err_new ();
-      
-      cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "no route to %s", module);
-      
-      qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
-      
-      qbus_frame_set_err (frame, err);
+      CapeList methods = cape_list_new (qbus_route_subscriptions_method_del);
       
-      cape_err_del (&err);
+      cape_list_push_back (methods, (void*)qmeth);
       
-      // finally send the frame
-      qbus_connection_send (conn, p_frame);
+      // transfer ownership of topic to the map
+      cape_map_insert (self->subscriptions, (void*)topic, (void*)methods);
     }
   }
+  
+  cape_mutex_unlock (self->subscriptions_mutex);
+  
+  // tell all connections about the new subscription
+  qbus_route_send_topic_updates (self, NULL);
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_msg_forward (QBusRoute self, QBusFrame* p_frame, QBusForwardData** p_qbus_fd)
+int qbus_route_publish (QBusRoute self, const char* topic, QBusM msg, CapeErr err)
 {
-  QBusFrame frame = *p_frame;
+  CapeList conns = qbus_route_items_topic_conns (self->route_items, topic, NULL);
   
-  QBusForwardData* qbus_fd = *p_qbus_fd;
+  // local subscribers get copies, because the frame consumes the content
+  qbus_route_publish__local (self, topic, msg);
   
-  // try to find a connection which might reach the destination module
-  QBusConnection conn_forward = qbus_route_items_get (self->route_items, qbus_fd->sender);
-  if (conn_forward)
+  if (cape_list_size (conns))
   {
-    qbus_frame_set_chainkey (frame, &(qbus_fd->chain_key));
-    qbus_frame_set_sender (frame, &(qbus_fd->sender));
+    // create a new frame
+    QBusFrame frame = qbus_frame_new ();
     
-    // forward the frame
-    qbus_connection_send (conn_forward, p_frame);
-  }
-  else
-  {
-    // log
-    cape_log_msg (CAPE_LL_ERROR, "QBUS", "msg forward", "forward message can't be returned");
+    // the chain key is only an id, nothing will be registered in the chains
+    CapeString id = cape_str_fmt ("%s.%lu", self->publish_prefix, __atomic_add_fetch (&(self->publish_seq), 1, __ATOMIC_RELAXED));
+    
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_PUBLISH, id, topic, NULL, self->name);
+    
+    cape_str_del (&id);
+    
+    // add message content
+    msg->rinfo = qbus_frame_set_qmsg (frame, msg, NULL);
+    
+    qbus_route_publish__forward (self, frame, conns);
+    
+    qbus_frame_del (&frame);
   }
   
-  cape_str_del (&(qbus_fd->chain_key));
-  cape_str_del (&(qbus_fd->sender));
+  cape_list_del (&conns);
   
-  CAPE_DEL(p_qbus_fd, QBusForwardData);
+  return CAPE_ERR_NONE;
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_msg_methods (QBusRoute self, QBusFrame* p_frame, QBusMethodsData** p_qbus_methods)
+static int __STDCALL qbus_route_batch__on_local (QBus qbus, void* ptr, QBusM qin, QBusM qout, CapeErr err)
 {
-  QBusFrame frame = *p_frame;
-
-  QBusMethodsData* qbus_methods = *p_qbus_methods;
+  QBusBatchGroup* group = ptr;
   
-  if (qbus_methods->on_methods)
-  {
-    CapeErr err = cape_err_new ();
-    
-    CapeUdc methods = qbus_frame_get_udc (frame);
-    
-    qbus_methods->on_methods (self->qbus, qbus_methods->ptr, methods, err);
-
-    cape_udc_del (&methods);
-    
-    cape_err_del (&err);
-  }
+  CapeUdc node = qbus_frame_qmsg_to_udc (qin, qin->err);
   
-  CAPE_DEL(p_qbus_methods, QBusMethodsData);
+  qbus_route_batch__set (group->batch, group->positions[0], &node);
+  
+  // the group itself is released with the response method
+  qbus_route_batch__done (&(group->batch));
+  
+  return CAPE_ERR_NONE;
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_msg_response (QBusRoute self, QBusFrame* p_frame)
+void qbus_route_batch__local_call (QBusRoute self, QBusBatchData* batch, number_t position, const char* method, QBusM msg)
 {
-  QBusFrame frame = *p_frame;
-  
-  const CapeString chain_key = qbus_frame_get_chainkey (frame);
+  QBusBatchGroup* group;
+  CapeString key;
   
-  if (chain_key)
+  if (method == NULL)
   {
-    CapeMapNode n;
-   
-    cape_mutex_lock (self->chain_mutex);
-    
-    n = cape_map_find (self->chains, (void*)chain_key);
-    
-    if (n)
-    {
-      cape_map_extract (self->chains, n);
-    }
+    CapeUdc h = qbus_route_batch__err_node (CAPE_ERR_WRONG_VALUE, "no method");
     
-    cape_mutex_unlock (self->chain_mutex);
-
-    if (n)
-    {
-      QBusMethod qmeth = cape_map_node_value (n);
-      
-      switch (qmeth->type)
-      {
-        case QBUS_METHOD_TYPE__REQUEST:
-        {
-          // this should not happen
-          
-          break;
-        }
-        case QBUS_METHOD_TYPE__RESPONSE:
-        {
-          CapeErr err = cape_err_new ();
-          
-          qbus_method_call_response (qmeth, self->qbus, self, frame, err);
-
-          cape_err_del (&err);
-          
-          break;
-        }
-        case QBUS_METHOD_TYPE__FORWARD:
-        {
-          QBusForwardData* qbus_fd = qmeth->ptr;
-          
-          qbus_route_on_msg_forward (self, p_frame, &qbus_fd);
-          
-          break;
-        }
-        case QBUS_METHOD_TYPE__METHODS:
-        {
-          QBusMethodsData* qbus_methods = qmeth->ptr;
-          
-          qbus_route_on_msg_methods (self, p_frame, &qbus_methods);
-         
-          break;
-        }
-      }
-      
-      // cleanup
-      cape_map_del_node (self->chains, &n);
-    }
-    else
-    {
-      
-      
-    }
+    qbus_route_batch__set (batch, position, &h);
+    return;
+  }
+  
+  if (batch->key == NULL)
+  {
+    // one unique key for the whole batch
+    batch->key = cape_str_uuid ();
   }
+  
+  key = cape_str_fmt ("%s.%li", batch->key, position);
+  
+  group = qbus_route_batch_group_new (batch, 1);
+  
+  group->positions[0] = position;
+  
+  // the result is always delivered to the callback, even if the method continues
+  qbus_route_request__local_request (self, method, msg, group, qbus_route_batch__on_local, qbus_route_batch_group__on_removed, FALSE, key);
+  
+  cape_str_del (&key);
 }
 
 //-----------------------------------------------------------------------------
 
-CapeUdc qbus_route__generate_modules_list (QBusRoute self)
+void qbus_route_on_msg_batch__local (QBusRoute self, QBusFrame frame)
 {
-  // encode methods into list
-  CapeUdc method_list = cape_udc_new (CAPE_UDC_LIST, NULL);
-
-  // iterate through all methods
+  CapeUdc payload = qbus_frame_get_udc (frame);
+  
+  QBusBatchData* batch = qbus_route_batch_data_new (self, (payload && cape_udc_type (payload) == CAPE_UDC_LIST) ? cape_udc_size (payload) : 0);
+  
+  batch->chain_key = cape_str_cp (qbus_frame_get_chainkey (frame));
+  batch->sender = cape_str_cp (qbus_frame_get_sender (frame));
+  
+  if (batch->size)
   {
-    CapeMapCursor* cursor = cape_map_cursor_create (self->methods, CAPE_DIRECTION_FORW);
+    number_t k = 0;
     
-    while (cape_map_cursor_next (cursor))
+    CapeUdcCursor* cursor = cape_udc_cursor_new (payload, CAPE_DIRECTION_FORW);
+    
+    while (cape_udc_cursor_next (cursor))
     {
-      //QBusMethod qmeth = cape_map_node_value (cursor->node);
-     
-      //CapeUdc method_node = cape_udc_new (CAPE_UDC_NODE, NULL);
+      QBusM msg = qbus_message_new (NULL, NULL);
       
-      //cape_udc_add_s_cp (method_node, "name", cape_map_node_key (cursor->node));
+      qbus_frame_udc_to_qmsg (cursor->item, msg);
       
-      //cape_udc_add (method_list, &method_node);
+      qbus_route_batch__local_call (self, batch, k, cape_udc_get_s (cursor->item, "N", NULL), msg);
       
-      cape_udc_add_s_cp (method_list, NULL, cape_map_node_key (cursor->node));
+      qbus_message_del (&msg);
+      
+      k++;
     }
     
-    cape_map_cursor_destroy (&cursor);
+    cape_udc_cursor_del (&cursor);
   }
-
-  return method_list;
+  
+  cape_udc_del (&payload);
+  
+  // release the guard
+  qbus_route_batch__done (&batch);
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
+void qbus_route_on_msg_batch (QBusRoute self, QBusConnection conn, QBusFrame* p_frame)
 {
   QBusFrame frame = *p_frame;
   
@@ -826,24 +3077,7 @@ void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, Q
   // check if the message was sent to us
   if (cape_str_equal (module, self->name))
   {
-    // encode methods into list
-    CapeUdc method_list = qbus_route__generate_modules_list (self);
-
-    /*
-    {
-      CapeString h = cape_json_to_s (method_list);
-      
-      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "methods req", "send methods: %s", h);
-      
-      cape_str_del(&h);
-    }
-    */
-
-    qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
-    qbus_frame_set_udc (frame, QBUS_FRAME_TYPE_MSG_RES, &method_list);
-    
-    // send the frame back
-    qbus_connection_send (conn, p_frame);
+    qbus_route_on_msg_batch__local (self, frame);
   }
   else  // the message was not send to us -> forward it 
   {
@@ -852,6 +3086,8 @@ void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, Q
     if (conn_forward)
     {
       qbus_route_on_msg_foward (self, conn_forward, p_frame);
+      
+      qbus_connection_dec (&conn_forward);
     }
     else
     {
@@ -859,7 +3095,7 @@ void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, Q
       
       cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "no route to %s", module);
       
-      qbus_frame_set_type (frame, QBUS_FRAME_TYPE_MSG_RES, self->name);
+      qbus_frame_set_type (frame, QBUS_FRAME_TYPE_BATCH_RES, self->name);
       
       qbus_frame_set_err (frame, err);
       
@@ -873,384 +3109,334 @@ void qbus_route_on_route_methods_request (QBusRoute self, QBusConnection conn, Q
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_conn_onFrame (QBusRoute self, QBusConnection connection, QBusFrame* p_frame)
+static void __STDCALL qbus_route_batch_groups_del (void* key, void* val)
 {
-  QBusFrame frame = *p_frame;
-  
-  switch (qbus_frame_get_type (frame))
   {
-    case QBUS_FRAME_TYPE_ROUTE_REQ:
-    {
-      qbus_route_on_route_request (self, connection, p_frame);
-      break;
-    }
-    case QBUS_FRAME_TYPE_ROUTE_RES:
-    {
-      qbus_route_on_route_response (self, connection, frame);
-      break;
-    }
-    case QBUS_FRAME_TYPE_ROUTE_UPD:
-    {
-      qbus_route_on_route_update (self, connection, frame);
-      break;
-    }
-    case QBUS_FRAME_TYPE_MSG_REQ:
-    {
-      qbus_route_on_msg_request (self, connection, p_frame);
-      break;
-    }
-    case QBUS_FRAME_TYPE_MSG_RES:
-    {
-      qbus_route_on_msg_response (self, p_frame);
-      break;
-    }
-    case QBUS_FRAME_TYPE_METHODS:
-    {
-      qbus_route_on_route_methods_request (self, connection, p_frame);
-      break;
-    }
+    CapeString h = key; cape_str_del (&h);
+  }
+  {
+    CapeList h = val; cape_list_del (&h);
   }
-  
-  qbus_frame_del (p_frame);    
-}
-
-//-----------------------------------------------------------------------------
-
-void qbus_route_meth_reg (QBusRoute self, const char* method_origin, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm)
-{
-  QBusMethod qmeth;
-  CapeString method = cape_str_cp (method_origin);
-  
-  cape_str_to_lower (method);
-
-  qmeth = qbus_method_new (QBUS_METHOD_TYPE__REQUEST, ptr, onMsg, onRm);
-  
-  cape_map_insert (self->methods, (void*)method, (void*)qmeth);
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_no_route (QBusRoute self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg)
+void qbus_route_request_batch__group (QBusRoute self, QBusBatchData* batch, const CapeString module, CapeList positions, QBusBatchItem* items)
 {
-  // log
-  cape_log_fmt (CAPE_LL_WARN, "QBUS", "msg forward", "no route to module %s", module);
+  QBusConnection conn = qbus_route_module_find (self, module);
   
-  if (onMsg)
+  if (conn)
   {
-    if (msg->err)
-    {
-      cape_err_del (&(msg->err));
-    }
+    number_t k = 0;
     
-    // create a new error object
-    msg->err = cape_err_new ();
+    CapeString chain_key = cape_str_uuid ();
     
-    // set the error
-    cape_err_set (msg->err, CAPE_ERR_NOT_FOUND, "no route to module");
+    CapeUdc calls = cape_udc_new (CAPE_UDC_LIST, NULL);
+    
+    QBusFrame frame = qbus_frame_new ();
+    
+    QBusBatchGroup* group = qbus_route_batch_group_new (batch, cape_list_size (positions));
     
     {
-      // create a temporary error object
-      CapeErr err = cape_err_new ();
-      
-      int res = onMsg (self->qbus, ptr, msg, NULL, err);
-      if (res)
-      {
-        // TODO: handle error
-        
-      }
+      CapeListCursor cursor; cape_list_cursor_init (positions, &cursor, CAPE_DIRECTION_FORW);
       
-      cape_err_del (&err);
-    }      
-  }  
-}
-
-//-----------------------------------------------------------------------------
-
-void qbus_route_conn_request (QBusRoute self, QBusConnection const conn, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, int cont)
-{
-  // create a new frame
-  QBusFrame frame = qbus_frame_new ();
-  
-  {
-    QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__RESPONSE, ptr, onMsg, NULL);
+      while (cape_list_cursor_next (&cursor))
+      {
+        number_t position = (number_t)cape_list_node_data (cursor.node);
+        
+        QBusBatchItem item = items[position];
+        
+        CapeUdc call = qbus_frame_qmsg_to_udc (item->msg, NULL);
+        
+        cape_udc_add_s_cp (call, "N", item->method);
+        
+        cape_udc_add (calls, &call);
+        
+        group->positions[k] = position;
+        
+        k++;
+      }
+    }
     
-    CapeString h = cape_str_uuid();
-
-    // add default content
-    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_REQ, h, module, method, self->name);
+    // one frame for all calls
+    qbus_frame_set (frame, QBUS_FRAME_TYPE_BATCH_REQ, chain_key, module, NULL, self->name);
     
-    // add message content
-    msg->rinfo = qbus_frame_set_qmsg (frame, msg, NULL);
-
-    if (cont && msg->chain_key)
     {
-      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "add chainkey '%s' for continue", msg->chain_key);
+      CapeUdc rinfo = qbus_frame_set_udc (frame, QBUS_MTYPE_JSON, &calls);
       
-      qbus_method_continue (qmeth, &(msg->chain_key), &(msg->sender), &(msg->rinfo));
+      cape_udc_del (&rinfo);
     }
     
     cape_mutex_lock (self->chain_mutex);
     
-    cape_map_insert (self->chains, (void*)h, (void*)qmeth);
-
+    {
+      // if no response arrives, the group is failed when the chain is removed
+      QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__BATCH, group, NULL, qbus_route_batch_group__on_removed);
+      
+      // transfer ownership of chain_key to the map
+      cape_map_insert (self->chains, (void*)chain_key, (void*)qmeth);
+    }
+    
     cape_mutex_unlock (self->chain_mutex);
+    
+    // finally send the frame
+    qbus_connection_send (conn, &frame);
+    
+    qbus_connection_dec (&conn);
+  }
+  else
+  {
+    CapeListCursor cursor; cape_list_cursor_init (positions, &cursor, CAPE_DIRECTION_FORW);
+    
+    cape_log_fmt (CAPE_LL_WARN, "QBUS", "batch", "no route to module %s", module);
+    
+    while (cape_list_cursor_next (&cursor))
+    {
+      CapeUdc h = qbus_route_batch__err_node (CAPE_ERR_NOT_FOUND, "no route to module");
+      
+      qbus_route_batch__set (batch, (number_t)cape_list_node_data (cursor.node), &h);
+    }
   }
-  
-  // finally send the frame
-  qbus_connection_send (conn, &frame);
 }
 
 //-----------------------------------------------------------------------------
 
-int qbus_route_request__find_method_and_call (QBusRoute self, const char* method_origin, QBusM msg, QBusM qout, CapeErr err)
+int qbus_route_request_batch (QBusRoute self, QBusBatch* p_batch, void* ptr, fct_qbus_onMessage onMsg, CapeErr err)
 {
-  int res;
+  QBusBatch batch_items = *p_batch;
   
-  // const local objects
-  CapeMapNode n;
-  QBusMethod qmeth;
+  number_t i = 0;
   
-  // local objects
-  CapeString method = cape_str_cp (method_origin);
+  QBusBatchData* batch = qbus_route_batch_data_new (self, cape_list_size (batch_items->items));
   
-  // convert into lower case
-  cape_str_to_lower (method);
+  // to access the items by position
+  QBusBatchItem* items = CAPE_ALLOC (sizeof(QBusBatchItem) * (batch->size + 1));
   
-  // try to find the method
-  n = cape_map_find (self->methods, method);    
-  if (n == NULL)
-  {
-    res = cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", method);
-    goto exit_and_cleanup;
-  }
+  // module -> list of positions
+  CapeMap groups = cape_map_new (NULL, qbus_route_batch_groups_del, NULL);
   
-  // get the methods object
-  qmeth = cape_map_node_value (n);
+  batch->ptr = ptr;
+  batch->onMsg = onMsg;
   
-  switch (qmeth->type)
   {
-    case QBUS_METHOD_TYPE__REQUEST:
+    CapeListCursor cursor; cape_list_cursor_init (batch_items->items, &cursor, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (&cursor))
     {
-      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call method '%s'", method_origin);
+      QBusBatchItem item = cape_list_node_data (cursor.node);
       
-      res = qbus_method_call_request__msg (qmeth, self->qbus, msg, qout, err);
-      break;
+      items[i] = item;
+      
+      if (item->method == NULL)
+      {
+        CapeUdc h = qbus_route_batch__err_node (CAPE_ERR_WRONG_VALUE, "no method");
+        
+        cape_log_fmt (CAPE_LL_WARN, "QBUS", "batch", "call %li to module %s has no method", i, item->module);
+        
+        qbus_route_batch__set (batch, i, &h);
+      }
+      else if (cape_str_equal (item->module, self->name))
+      {
+        // local calls don't need a frame
+        qbus_route_batch__local_call (self, batch, i, item->method, item->msg);
+      }
+      else
+      {
+        CapeMapNode n;
+        CapeString module = cape_str_cp (item->module);
+        
+        cape_str_to_upper (module);
+        
+        n = cape_map_find (groups, (void*)module);
+        if (n)
+        {
+          cape_str_del (&module);
+        }
+        else
+        {
+          // transfer ownership of module to the map
+          n = cape_map_insert (groups, (void*)module, (void*)cape_list_new (NULL));
+        }
+        
+        cape_list_push_back (cape_map_node_value (n), (void*)i);
+      }
+      
+      i++;
     }
-    default:
+  }
+  
+  // one frame per module, a forwarding node in between gets several frames
+  // with striped connections all calls to a module take the same stripe
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (groups, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
     {
-      res = cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "method [%s] not found", method);
-      break;
+      qbus_route_request_batch__group (self, batch, cape_map_node_key (cursor->node), cape_map_node_value (cursor->node), items);
     }
+    
+    cape_map_cursor_destroy (&cursor);
   }
   
-exit_and_cleanup:
-  
-  cape_str_del (&method);  
-  return res;
-}
-
-//-----------------------------------------------------------------------------
-
-void qbus_route_request__local_chains (QBusRoute self, QBusM msg, void* ptr, fct_qbus_onMessage onMsg)
-{
-  QBusMethod qmeth = qbus_method_new (QBUS_METHOD_TYPE__RESPONSE, ptr, onMsg, NULL);
-
-  CapeString h = cape_str_uuid();
+  cape_map_del (&groups);
   
-  cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "add chainkey '%s' for continue", h);
+  CAPE_FREE (items);
   
-  qbus_method_continue (qmeth, &(msg->chain_key), &(msg->sender), &(msg->rinfo));
+  // release the guard
+  qbus_route_batch__done (&batch);
   
-  cape_mutex_lock (self->chain_mutex);
-  
-  cape_map_insert (self->chains, (void*)h, (void*)qmeth);
+  qbus_batch_del (p_batch);
   
-  cape_mutex_unlock (self->chain_mutex);
+  return CAPE_ERR_NONE;
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_request__local_response (QBusRoute self, QBusM msg, QBusM qin, void* ptr, fct_qbus_onMessage onMsg)
+void qbus_route_conn_onFrame (QBusRoute self, QBusConnection connection, QBusFrame* p_frame)
 {
-  CapeErr err = cape_err_new ();
-  QBusM qout = qbus_message_new (NULL, NULL);
-  
-  int res = CAPE_ERR_NONE;
+  QBusFrame frame = *p_frame;
   
-  if (onMsg)
+  switch (qbus_frame_get_type (frame))
   {
-    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call method callback");
-    
-    // debug
-    if (qin->cdata)
+    case QBUS_FRAME_TYPE_ROUTE_REQ:
     {
-      CapeString h = cape_json_to_s (qin->cdata);
-      
-      printf ("QIN CDATA: %s\n", h);
-
-      cape_str_del(&h);
+      qbus_route_on_route_request (self, connection, p_frame);
+      break;
     }
-    // debug
-    if (msg->cdata)
+    case QBUS_FRAME_TYPE_ROUTE_RES:
     {
-      CapeString h = cape_json_to_s (msg->cdata);
-      
-      printf ("MSG CDATA: %s\n", h);
-      
-      cape_str_del(&h);
+      qbus_route_on_route_response (self, connection, frame);
+      break;
     }
-    
-    // TODO: workaround
-    if (qin->cdata)
+    case QBUS_FRAME_TYPE_ROUTE_UPD:
     {
-      cape_udc_merge_cp (qin->cdata, msg->cdata);
+      qbus_route_on_route_update (self, connection, frame);
+      break;
     }
-    else
+    case QBUS_FRAME_TYPE_MSG_REQ:
     {
-      cape_udc_replace_cp (&(qin->cdata), msg->cdata);
+      qbus_route_on_msg_request (self, connection, p_frame);
+      break;
     }
-    
-    res = onMsg (self->qbus, ptr, qin, qout, err);
-  }
-  
-  switch (res)
-  {
-    case CAPE_ERR_CONTINUE:
+    case QBUS_FRAME_TYPE_MSG_RES:
+    case QBUS_FRAME_TYPE_BATCH_RES:
     {
-      //cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request callback", "call returned a continued state");
-      
-      // don't do anything
+      qbus_route_on_msg_response (self, p_frame);
       break;
     }
-    default:
+    case QBUS_FRAME_TYPE_BATCH_REQ:
     {
-      // transfer ownership
-      cape_udc_replace_mv (&(msg->cdata), &(qout->cdata));
-      
-      // TODO:
-      
-      //cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request callback", "call returned a terminated state with chais key = '%s'", msg->chain_key);
-      
+      qbus_route_on_msg_batch (self, connection, p_frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_METHODS:
+    {
+      qbus_route_on_route_methods_request (self, connection, p_frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_MSG_NOTIFY:
+    {
+      qbus_route_on_msg_notify (self, p_frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_TOPICS_UPD:
+    {
+      qbus_route_on_topics_update (self, connection, frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_MSG_PUBLISH:
+    {
+      qbus_route_on_msg_publish (self, connection, frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_PING:
+    {
+      qbus_route_on_ping (self, connection, p_frame);
+      break;
+    }
+    case QBUS_FRAME_TYPE_PONG:
+    {
+      qbus_route_on_pong (self, connection, frame);
       break;
     }
   }
   
-  // cleanup
-  qbus_message_del (&qout);
-  cape_err_del (&err);
+  qbus_frame_del (p_frame);    
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_request__local_request (QBusRoute self, const char* method_origin, QBusM msg, void* ptr, fct_qbus_onMessage onMsg)
+QBusConnection qbus_route_conn_onHead (QBusRoute self, QBusConnection connection, QBusFrame frame)
 {
-  int res;
-  CapeErr err = cape_err_new ();
-  QBusM qout = qbus_message_new (NULL, NULL);
+  QBusConnection conn_forward = NULL;
+  const char* hop = NULL;
   
-  // set default message type
-  qout->mtype = QBUS_MTYPE_JSON;
-  
-  res = qbus_route_request__find_method_and_call (self, method_origin, msg, qout, err);
-  
-  switch (res)
+  switch (qbus_frame_get_type (frame))
   {
-    case CAPE_ERR_CONTINUE:
+    case QBUS_FRAME_TYPE_MSG_REQ:
+    case QBUS_FRAME_TYPE_MSG_NOTIFY:
+    case QBUS_FRAME_TYPE_BATCH_REQ:
     {
-      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call returned a continued state");
+      const CapeString module = qbus_frame_get_module (frame);
       
-      // this request shall not continue and another request was created instead
-      // we need to add the callback and ptr to the chains list, for response
-      qbus_route_request__local_chains (self, msg, ptr, onMsg);
+      // frames for us need the full payload
+      if (!cape_str_equal (module, self->name))
+      {
+        conn_forward = qbus_route_items_get (self->route_items, module);
+      }
       
       break;
     }
-    default:
+    case QBUS_FRAME_TYPE_MSG_RES:
+    case QBUS_FRAME_TYPE_BATCH_RES:
     {
-      cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "call returned a terminated state");
+      const CapeString chain_key = qbus_frame_get_chainkey (frame);
       
-      if (res)
+      // only responses on the way back through us
+      if (chain_key)
       {
-        // tranfer ownership
-        qout->err = err;
+        hop = strrchr (chain_key, QBUS_FRAME_HOP_SEPARATOR);
         
-        // create an empty error object
-        err = cape_err_new ();
+        if (hop)
+        {
+          conn_forward = qbus_route_frame__hop_conn (self, hop);
+        }
       }
       
-      // this requests ends here, now send the results back
-      qbus_route_request__local_response (self, msg, qout, ptr, onMsg);
-      
       break;
     }
   }
   
-  // cleanup
-  qbus_message_del (&qout);
-  cape_err_del (&err);
-}
- 
-//-----------------------------------------------------------------------------
-
-int qbus_route_request (QBusRoute self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, int cont, CapeErr err)
-{
-  /*
-  if (cape_str_compare (module, self->name))
+  if (conn_forward == NULL)
   {
-    cape_log_fmt (CAPE_LL_TRACE, "QBUS", "request", "execute local request on '%s'", module);
-    
-    qbus_route_request__local_request (self, method, msg, ptr, onMsg);
-    
-    return CAPE_ERR_NONE;
+    return NULL;
   }
-  else
-  */
+  
+  // the outgoing connection might be busy with another cut-through frame
+  if (!qbus_connection_cut_lock (conn_forward))
   {
-    QBusConnection const conn = qbus_route_module_find (self, module);
-    
-    if (conn)
+    qbus_connection_dec (&conn_forward);
+    return NULL;
+  }
+  
+  // rewrite the header in the same way as the full frame would be forwarded
+  switch (qbus_frame_get_type (frame))
+  {
+    case QBUS_FRAME_TYPE_MSG_REQ:
+    case QBUS_FRAME_TYPE_BATCH_REQ:
     {
-      qbus_route_conn_request (self, conn, module, method, msg, ptr, onMsg, cont);
-      
-      return CAPE_ERR_CONTINUE;
+      qbus_route_frame__push_hop (self, frame);
+      break;
     }
-    else
+    case QBUS_FRAME_TYPE_MSG_RES:
+    case QBUS_FRAME_TYPE_BATCH_RES:
     {
-      qbus_route_no_route (self, module, method, msg, ptr, onMsg);
-
-      return cape_err_set (err, CAPE_ERR_NOT_FOUND, "no route to module");
+      qbus_route_frame__pop_hop (self, frame, hop);
+      break;
     }
-  }  
-}
-
-//-----------------------------------------------------------------------------
-
-void qbus_route_response (QBusRoute self, const char* module, QBusM msg, CapeErr err)
-{
-  QBusConnection const conn = qbus_route_module_find (self, module);
-  
-  if (conn)
-  {
-    CapeUdc rinfo = NULL;
-    
-    // create a new frame
-    QBusFrame frame = qbus_frame_new ();
-    
-    // add default content
-    qbus_frame_set (frame, QBUS_FRAME_TYPE_MSG_RES, msg->chain_key, module, NULL, self->name);
-    
-    // add message content
-    rinfo = qbus_frame_set_qmsg (frame, msg, err);
-    
-    // finally send the frame
-    qbus_connection_send (conn, &frame);
-    
-    cape_udc_del (&rinfo);
-  }
-  else
-  {
-    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "route response", "no route for response '%s'", module);
   }
+  
+  return conn_forward;
 }
 
 //-----------------------------------------------------------------------------
@@ -1324,7 +3510,7 @@ void qbus_route_rm_on_change (QBusRoute self, void* obj)
 
 void qbus_route_methods (QBusRoute self, const char* module, void* ptr, fct_qbus_on_methods on_methods)
 {
-  QBusConnection const conn = qbus_route_module_find (self, module);
+  QBusConnection conn = qbus_route_module_find (self, module);
   
   if (conn)
   {
@@ -1354,6 +3540,8 @@ void qbus_route_methods (QBusRoute self, const char* module, void* ptr, fct_qbus
         
     // send the frame
     qbus_connection_send (conn, &frame);
+    
+    qbus_connection_dec (&conn);
   }
   else
   {
@@ -14,12 +14,20 @@ struct QBusFrame_s; typedef struct QBusFrame_s* QBusFrame;
 
 struct QBusRoute_s; typedef struct QBusRoute_s* QBusRoute;
 
+struct QBusSubmit_s; typedef struct QBusSubmit_s* QBusSubmit;
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   QBusRoute         qbus_route_new           (QBus qbus, const CapeString name);
 
 __CAPE_LIBEX   void              qbus_route_del           (QBusRoute*);
 
+                 // worker threads hand their responses to the I/O thread through the submit queue
+__CAPE_LIBEX   void              qbus_route_set_submit    (QBusRoute, QBusSubmit submit);
+
+                 // sends a frame to the connection of the module, used by the I/O thread
+__CAPE_LIBEX   void              qbus_route_send_frame    (QBusRoute, const char* module, QBusFrame*);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   void              qbus_route_conn_reg      (QBusRoute, QBusConnection);
@@ -28,23 +36,48 @@ __CAPE_LIBEX   void              qbus_route_conn_rm       (QBusRoute, QBusConnec
 
 __CAPE_LIBEX   void              qbus_route_conn_onFrame  (QBusRoute, QBusConnection, QBusFrame*);
 
+                 // returns a reference of the connection the payload of a large frame can be passed through, rewrites the header
+__CAPE_LIBEX   QBusConnection    qbus_route_conn_onHead   (QBusRoute, QBusConnection, QBusFrame);
+
+                 // pings all direct connections, drops those without any data for more than max_missed intervals
+__CAPE_LIBEX   void              qbus_route_heartbeat     (QBusRoute, number_t max_missed);
+
 //-----------------------------------------------------------------------------
 
-__CAPE_LIBEX   void              qbus_route_meth_reg      (QBusRoute, const char* method, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm);
+__CAPE_LIBEX   int               qbus_route_meth_reg      (QBusRoute, const char* method, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err);
+
+__CAPE_LIBEX   int               qbus_route_meth_reg_payload  (QBusRoute, const char* method, void* ptr, fct_qbus_onPayload onPayload, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err);
+
+__CAPE_LIBEX   int               qbus_route_meth_reg_raw  (QBusRoute, const char* method, void* ptr, fct_qbus_onRaw onRaw, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err);
+
+__CAPE_LIBEX   int               qbus_route_request_raw   (QBusRoute, const char* module, const char* method, number_t mtype, const char* bufdat, number_t buflen, void* ptr, fct_qbus_onRaw, fct_qbus_onRemoved, CapeErr err);
 
-__CAPE_LIBEX   int               qbus_route_request       (QBusRoute, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage, int cont, CapeErr err);
+__CAPE_LIBEX   int               qbus_route_response_raw  (QBusRoute, const char* module, const char* chain_key, number_t mtype, const char* bufdat, number_t buflen, CapeErr err);
+
+__CAPE_LIBEX   int               qbus_route_request       (QBusRoute, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage, fct_qbus_onRemoved, int cont, CapeErr err);
 
 __CAPE_LIBEX   void              qbus_route_response      (QBusRoute, const char* module, QBusM msg, CapeErr err);
 
+__CAPE_LIBEX   int               qbus_route_request_batch (QBusRoute, QBusBatch* p_batch, void* ptr, fct_qbus_onMessage, CapeErr err);
+
+__CAPE_LIBEX   int               qbus_route_notify        (QBusRoute, const char* module, const char* method, QBusM msg, CapeErr err);
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   void              qbus_route_subscribe     (QBusRoute, const char* topic, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm);
+
+__CAPE_LIBEX   int               qbus_route_publish       (QBusRoute, const char* topic, QBusM msg, CapeErr err);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   CapeUdc           qbus_route_modules       (QBusRoute);
 
 //-----------------------------------------------------------------------------
 
-__CAPE_LIBEX   QBusConnection const  qbus_route_module_find (QBusRoute, const char* module_origin);
+                 // returns a reference, the caller must release it with qbus_connection_dec
+__CAPE_LIBEX   QBusConnection    qbus_route_module_find   (QBusRoute, const char* module_origin);
 
-__CAPE_LIBEX   void              qbus_route_conn_request  (QBusRoute, QBusConnection const, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, int cont);
+__CAPE_LIBEX   void              qbus_route_conn_request  (QBusRoute, QBusConnection const, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, int cont);
 
 __CAPE_LIBEX   void*             qbus_route_add_on_change     (QBusRoute, void* ptr, fct_qbus_on_route_change);
 
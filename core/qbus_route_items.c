@@ -3,6 +3,7 @@
 // cape includes
 #include <sys/cape_types.h>
 #include <sys/cape_mutex.h>
+#include <sys/cape_log.h>
 #include <stc/cape_map.h>
 #include <fmt/cape_json.h>
 
@@ -12,9 +13,11 @@ struct QBusRouteItems_s
 {
   CapeMutex mutex;
   
-  CapeMap routes_direct;
+  CapeMap routes_direct;  // module -> list of connections, a link can have several stripes
 
   CapeMap routes_node;
+  
+  CapeMap topics;       // topic -> list of connections with subscribers
 };
 
 //-----------------------------------------------------------------------------
@@ -24,6 +27,9 @@ void __STDCALL qbus_route_routes_direct_del (void* key, void* val)
   {
     CapeString h = key; cape_str_del (&h);
   }
+  {
+    CapeList h = val; cape_list_del (&h);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -37,12 +43,25 @@ void __STDCALL qbus_route_routes_nodes_del (void* key, void* val)
 
 //-----------------------------------------------------------------------------
 
+void __STDCALL qbus_route_topics_del (void* key, void* val)
+{
+  {
+    CapeString h = key; cape_str_del (&h);
+  }
+  {
+    CapeList h = val; cape_list_del (&h);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 QBusRouteItems qbus_route_items_new (void)
 {
   QBusRouteItems self = CAPE_NEW (struct QBusRouteItems_s);
   
   self->routes_direct = cape_map_new (NULL, qbus_route_routes_direct_del, NULL);
   self->routes_node = cape_map_new (NULL, qbus_route_routes_nodes_del, NULL);
+  self->topics = cape_map_new (NULL, qbus_route_topics_del, NULL);
   
   self->mutex = cape_mutex_new ();
 
@@ -57,6 +76,7 @@ void qbus_route_items_del (QBusRouteItems* p_self)
   
   cape_map_del (&(self->routes_direct));
   cape_map_del (&(self->routes_node));
+  cape_map_del (&(self->topics));
 
   cape_mutex_del (&(self->mutex));
 
@@ -131,6 +151,203 @@ void qbus_route_items_nodes_remove_all (QBusRouteItems self, QBusConnection conn
 
 //-----------------------------------------------------------------------------
 
+void qbus_route_items_topics_remove_all (QBusRouteItems self, QBusConnection conn, CapeMap removed)
+{
+  CapeMapCursor* cursor = cape_map_cursor_create (self->topics, CAPE_DIRECTION_FORW);
+  
+  while (cape_map_cursor_next (cursor))
+  {
+    CapeList conns = cape_map_node_value (cursor->node);
+    
+    CapeListCursor* list_cursor = cape_list_cursor_create (conns, CAPE_DIRECTION_FORW);
+    
+    while (cape_list_cursor_next (list_cursor))
+    {
+      if (cape_list_node_data (list_cursor->node) == conn)
+      {
+        if (removed)
+        {
+          cape_map_insert (removed, (void*)cape_str_cp (cape_map_node_key (cursor->node)), NULL);
+        }
+        
+        cape_list_cursor_erase (conns, list_cursor);
+      }
+    }
+    
+    cape_list_cursor_destroy (&list_cursor);
+    
+    if (cape_list_size (conns) == 0)
+    {
+      cape_map_cursor_erase (self->topics, cursor);
+    }
+  }
+  
+  cape_map_cursor_destroy (&cursor);
+}
+
+//-----------------------------------------------------------------------------
+
+static CapeListNode qbus_route_items__link_find (CapeList link, QBusConnection conn)
+{
+  CapeListCursor cursor; cape_list_cursor_init (link, &cursor, CAPE_DIRECTION_FORW);
+  
+  while (cape_list_cursor_next (&cursor))
+  {
+    if (cape_list_node_data (cursor.node) == conn)
+    {
+      return cursor.node;
+    }
+  }
+  
+  return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+static QBusConnection qbus_route_items__link_front (CapeList link)
+{
+  CapeListCursor cursor; cape_list_cursor_init (link, &cursor, CAPE_DIRECTION_FORW);
+  
+  // the first connection of a link is its primary
+  return cape_list_cursor_next (&cursor) ? cape_list_node_data (cursor.node) : NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_items_nodes_replace (QBusRouteItems self, QBusConnection conn, QBusConnection conn_new)
+{
+  CapeList modules = cape_list_new (NULL);
+  
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (self->routes_node, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
+    {
+      if (cape_map_node_value (cursor->node) == conn)
+      {
+        cape_list_push_back (modules, (void*)cape_str_cp (cape_map_node_key (cursor->node)));
+        
+        cape_map_cursor_erase (self->routes_node, cursor);
+      }
+    }
+    
+    cape_map_cursor_destroy (&cursor);
+  }
+  
+  {
+    CapeString module;
+    
+    // transfer ownership of the module names back to the map
+    while ((module = cape_list_pop_front (modules)))
+    {
+      cape_map_insert (self->routes_node, (void*)module, (void*)conn_new);
+    }
+  }
+  
+  cape_list_del (&modules);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_route_items_topics_replace (QBusRouteItems self, QBusConnection conn, QBusConnection conn_new)
+{
+  CapeMapCursor* cursor = cape_map_cursor_create (self->topics, CAPE_DIRECTION_FORW);
+  
+  while (cape_map_cursor_next (cursor))
+  {
+    CapeList conns = cape_map_node_value (cursor->node);
+    CapeListNode node = qbus_route_items__link_find (conns, conn);
+    
+    if (node)
+    {
+      cape_list_node_erase (conns, node);
+      
+      if (qbus_route_items__link_find (conns, conn_new) == NULL)
+      {
+        cape_list_push_back (conns, (void*)conn_new);
+      }
+    }
+  }
+  
+  cape_map_cursor_destroy (&cursor);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_route_items__same_link (QBusConnection conn, QBusConnection exception)
+{
+  if (conn == exception)
+  {
+    return TRUE;
+  }
+  
+  if (conn && exception)
+  {
+    // all stripes of a link share the module name of the peer
+    const CapeString ident_a = qbus_connection_get (conn);
+    const CapeString ident_b = qbus_connection_get (exception);
+    
+    return ident_a && ident_b && cape_str_equal (ident_a, ident_b);
+  }
+  
+  return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+
+static QBusConnection qbus_route_items__link_primary (QBusRouteItems self, QBusConnection conn)
+{
+  const CapeString ident = qbus_connection_get (conn);
+  
+  if (ident)
+  {
+    CapeMapNode n = cape_map_find (self->routes_direct, (void*)ident);
+    if (n)
+    {
+      QBusConnection primary = qbus_route_items__link_front (cape_map_node_value (n));
+      
+      if (primary)
+      {
+        return primary;
+      }
+    }
+  }
+  
+  return conn;
+}
+
+//-----------------------------------------------------------------------------
+
+static QBusConnection qbus_route_items__link_select (CapeList link)
+{
+  QBusConnection ret = NULL;
+  number_t ret_queued = 0;
+  
+  CapeListCursor cursor; cape_list_cursor_init (link, &cursor, CAPE_DIRECTION_FORW);
+  
+  // stripe to the connection with the fewest frames waiting to be sent
+  while (cape_list_cursor_next (&cursor))
+  {
+    QBusConnection conn = cape_list_node_data (cursor.node);
+    number_t queued = qbus_connection_queued (conn);
+    
+    if (ret == NULL || queued < ret_queued)
+    {
+      ret = conn;
+      ret_queued = queued;
+      
+      if (queued == 0)
+      {
+        break;
+      }
+    }
+  }
+  
+  return ret;
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_route_items_add (QBusRouteItems self, const CapeString module_origin, QBusConnection conn, CapeUdc* p_nodes)
 {
   cape_mutex_lock (self->mutex);
@@ -140,9 +357,38 @@ void qbus_route_items_add (QBusRouteItems self, const CapeString module_origin,
     
     cape_str_to_upper (module);
     
-    cape_map_insert (self->routes_direct, (void*)module, (void*)conn);
+    CapeMapNode n = cape_map_find (self->routes_direct, (void*)module);
     
     qbus_connection_set (conn, module);
+    
+    if (n)
+    {
+      CapeList link = cape_map_node_value (n);
+      
+      // another stripe of an existing link
+      if (qbus_route_items__link_find (link, conn) == NULL)
+      {
+        cape_list_push_back (link, (void*)conn);
+      }
+      
+      cape_str_del (&module);
+      
+      // the nodes are always assigned to the primary connection
+      conn = qbus_route_items__link_front (link);
+      
+      if (*p_nodes)
+      {
+        qbus_route_items_nodes_remove_all (self, conn);
+      }
+    }
+    else
+    {
+      CapeList link = cape_list_new (NULL);
+      
+      cape_list_push_back (link, (void*)conn);
+      
+      cape_map_insert (self->routes_direct, (void*)module, (void*)link);
+    }
   }
   
   if (*p_nodes)
@@ -170,7 +416,7 @@ void qbus_route_items_update (QBusRouteItems self, const CapeString module_origi
     CapeMapNode n = cape_map_find (self->routes_direct, (void*)module);
     if (n)
     {
-      QBusConnection conn = cape_map_node_value (n);
+      QBusConnection conn = qbus_route_items__link_front (cape_map_node_value (n));
       
       qbus_route_items_nodes_remove_all (self, conn);
       
@@ -205,7 +451,7 @@ QBusConnection qbus_route_items_get (QBusRouteItems self, const CapeString modul
     CapeMapNode n = cape_map_find (self->routes_direct, (void*)module);
     if (n)
     {
-      ret = cape_map_node_value (n);
+      ret = qbus_route_items__link_select (cape_map_node_value (n));
       
       goto exit_and_cleanup;
     }
@@ -215,7 +461,12 @@ QBusConnection qbus_route_items_get (QBusRouteItems self, const CapeString modul
     CapeMapNode n = cape_map_find (self->routes_node, (void*)module);    
     if (n)
     {
-      ret = cape_map_node_value (n);
+      const CapeString ident = qbus_connection_get (cape_map_node_value (n));
+      
+      // the node is reached through a link, use all of its stripes
+      CapeMapNode n_link = ident ? cape_map_find (self->routes_direct, (void*)ident) : NULL;
+      
+      ret = n_link ? qbus_route_items__link_select (cape_map_node_value (n_link)) : cape_map_node_value (n);
       
       goto exit_and_cleanup;
     }
@@ -224,6 +475,12 @@ QBusConnection qbus_route_items_get (QBusRouteItems self, const CapeString modul
   
 exit_and_cleanup:
 
+  if (ret)
+  {
+    // the connection might be removed as soon as the lock is released
+    qbus_connection_inc (ret);
+  }
+  
   cape_str_del (&module);
 
   cape_mutex_unlock (self->mutex);
@@ -233,7 +490,7 @@ exit_and_cleanup:
 
 //-----------------------------------------------------------------------------
 
-void qbus_route_items_rm (QBusRouteItems self, const CapeString module)
+void qbus_route_items_rm (QBusRouteItems self, const CapeString module, QBusConnection conn)
 {
   cape_mutex_lock (self->mutex);
   
@@ -242,15 +499,39 @@ void qbus_route_items_rm (QBusRouteItems self, const CapeString module)
     
     if (n)
     {
-      QBusConnection conn = cape_map_node_value (n);
+      CapeList link = cape_map_node_value (n);
       
-      // remove all indirect nodes with this connection
-      qbus_route_items_nodes_remove_all (self, conn);
-
-      printf ("qbus connection removed: %s\n", module);
+      {
+        CapeListNode node = qbus_route_items__link_find (link, conn);
+        if (node)
+        {
+          cape_list_node_erase (link, node);
+        }
+      }
       
-      // remove the connection
-      cape_map_erase (self->routes_direct, n);
+      if (cape_list_size (link))
+      {
+        QBusConnection primary = qbus_route_items__link_front (link);
+        
+        // the link is still alive, move everything to the remaining stripes
+        qbus_route_items_nodes_replace (self, conn, primary);
+        qbus_route_items_topics_replace (self, conn, primary);
+        
+        cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "route rm", "connection removed: %s, %lu stripes left", module, cape_list_size (link));
+      }
+      else
+      {
+        // remove all indirect nodes with this connection
+        qbus_route_items_nodes_remove_all (self, conn);
+        
+        // remove all subscriptions with this connection
+        qbus_route_items_topics_remove_all (self, conn, NULL);
+        
+        cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "route rm", "connection removed: %s", module);
+        
+        // remove the link
+        cape_map_erase (self->routes_direct, n);
+      }
     }      
   }
   
@@ -296,9 +577,18 @@ CapeUdc qbus_route_items_nodes (QBusRouteItems self)
 
 //-----------------------------------------------------------------------------
 
+static void __STDCALL qbus_route_items__conns_onDel (void* ptr)
+{
+  QBusConnection conn = ptr;
+  
+  qbus_connection_dec (&conn);
+}
+
+//-----------------------------------------------------------------------------
+
 CapeList qbus_route_items_conns (QBusRouteItems self, QBusConnection exception)
 {
-  CapeList conns = cape_list_new (NULL);
+  CapeList conns = cape_list_new (qbus_route_items__conns_onDel);
   
   cape_mutex_lock (self->mutex);
   
@@ -308,11 +598,13 @@ CapeList qbus_route_items_conns (QBusRouteItems self, QBusConnection exception)
     
     while (cape_map_cursor_next (cursor))
     {
-      QBusConnection conn = cape_map_node_value (cursor->node);
+      // one connection per link is enough for route and topic updates
+      QBusConnection conn = qbus_route_items__link_front (cape_map_node_value (cursor->node));
       
-      if (conn != exception)
+      if (!qbus_route_items__same_link (conn, exception))
       {
-        cape_list_push_back (conns, (void*)conn);
+        // the list keeps the connection valid after the lock was released
+        cape_list_push_back (conns, (void*)qbus_connection_inc (conn));
       }
     }
     
@@ -326,3 +618,175 @@ CapeList qbus_route_items_conns (QBusRouteItems self, QBusConnection exception)
 
 //-----------------------------------------------------------------------------
 
+CapeList qbus_route_items_conns_all (QBusRouteItems self)
+{
+  CapeList conns = cape_list_new (qbus_route_items__conns_onDel);
+  
+  cape_mutex_lock (self->mutex);
+  
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (self->routes_direct, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
+    {
+      CapeListCursor list_cursor; cape_list_cursor_init (cape_map_node_value (cursor->node), &list_cursor, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (&list_cursor))
+      {
+        cape_list_push_back (conns, (void*)qbus_connection_inc (cape_list_node_data (list_cursor.node)));
+      }
+    }
+    
+    cape_map_cursor_destroy (&cursor);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return conns;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_route_items_topics_set (QBusRouteItems self, QBusConnection conn, CapeUdc topics)
+{
+  int changed = FALSE;
+  number_t added = 0;
+  
+  // collects all topics which were assigned to the connection before
+  CapeMap removed = cape_map_new (NULL, qbus_route_routes_nodes_del, NULL);
+  
+  cape_mutex_lock (self->mutex);
+  
+  // topics can arrive on any stripe, keep them on the primary connection
+  conn = qbus_route_items__link_primary (self, conn);
+  
+  qbus_route_items_topics_remove_all (self, conn, removed);
+
+  if (topics && cape_udc_type (topics) == CAPE_UDC_LIST)
+  {
+    CapeUdcCursor* cursor = cape_udc_cursor_new (topics, CAPE_DIRECTION_FORW);
+    
+    while (cape_udc_cursor_next (cursor))
+    {
+      const CapeString topic_origin = cape_udc_s (cursor->item, NULL);
+      
+      if (topic_origin)
+      {
+        CapeMapNode n;
+        CapeString topic = cape_str_cp (topic_origin);
+        
+        cape_str_to_lower (topic);
+        
+        n = cape_map_find (self->topics, (void*)topic);
+        if (n)
+        {
+          cape_list_push_back (cape_map_node_value (n), (void*)conn);
+          
+          cape_str_del (&topic);
+        }
+        else
+        {
+          CapeList conns = cape_list_new (NULL);
+          
+          cape_list_push_back (conns, (void*)conn);
+          
+          // transfer ownership of topic to the map
+          n = cape_map_insert (self->topics, (void*)topic, (void*)conns);
+        }
+        
+        if (cape_map_find (removed, cape_map_node_key (n)) == NULL)
+        {
+          changed = TRUE;
+        }
+        
+        added++;
+      }
+    }
+    
+    cape_udc_cursor_del (&cursor);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  if (added != cape_map_size (removed))
+  {
+    changed = TRUE;
+  }
+  
+  cape_map_del (&removed);
+  
+  return changed;
+}
+
+//-----------------------------------------------------------------------------
+
+CapeUdc qbus_route_items_topics (QBusRouteItems self, QBusConnection exception)
+{
+  CapeUdc topics = cape_udc_new (CAPE_UDC_LIST, NULL);
+  
+  cape_mutex_lock (self->mutex);
+  
+  {
+    CapeMapCursor* cursor = cape_map_cursor_create (self->topics, CAPE_DIRECTION_FORW);
+    
+    while (cape_map_cursor_next (cursor))
+    {
+      CapeListCursor list_cursor; cape_list_cursor_init (cape_map_node_value (cursor->node), &list_cursor, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (&list_cursor))
+      {
+        // don't tell a connection about its own subscriptions
+        if (!qbus_route_items__same_link (cape_list_node_data (list_cursor.node), exception))
+        {
+          cape_udc_add_s_cp (topics, NULL, cape_map_node_key (cursor->node));
+          break;
+        }
+      }
+    }
+    
+    cape_map_cursor_destroy (&cursor);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return topics;
+}
+
+//-----------------------------------------------------------------------------
+
+CapeList qbus_route_items_topic_conns (QBusRouteItems self, const CapeString topic_origin, QBusConnection exception)
+{
+  CapeList conns = cape_list_new (qbus_route_items__conns_onDel);
+  
+  CapeString topic = cape_str_cp (topic_origin);
+  
+  cape_str_to_lower (topic);
+  
+  cape_mutex_lock (self->mutex);
+  
+  {
+    CapeMapNode n = cape_map_find (self->topics, (void*)topic);
+    if (n)
+    {
+      CapeListCursor cursor; cape_list_cursor_init (cape_map_node_value (n), &cursor, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (&cursor))
+      {
+        QBusConnection conn = cape_list_node_data (cursor.node);
+        
+        if (!qbus_route_items__same_link (conn, exception))
+        {
+          cape_list_push_back (conns, (void*)qbus_connection_inc (conn));
+        }
+      }
+    }
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  cape_str_del (&topic);
+  
+  return conns;
+}
+
+//-----------------------------------------------------------------------------
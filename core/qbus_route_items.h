@@ -22,16 +22,35 @@ __CAPE_LIBEX   void              qbus_route_items_del     (QBusRouteItems*);
 
 __CAPE_LIBEX   void              qbus_route_items_add        (QBusRouteItems, const CapeString module, QBusConnection conn, CapeUdc*);
 
+                 // returns a reference, the caller must release it with qbus_connection_dec
 __CAPE_LIBEX   QBusConnection    qbus_route_items_get        (QBusRouteItems, const CapeString module);
 
-__CAPE_LIBEX   void              qbus_route_items_rm         (QBusRouteItems, const CapeString module);
+                 // removes one stripe of the link, the link is removed with its last connection
+__CAPE_LIBEX   void              qbus_route_items_rm         (QBusRouteItems, const CapeString module, QBusConnection conn);
 
 __CAPE_LIBEX   void              qbus_route_items_update     (QBusRouteItems, const CapeString module, CapeUdc*);
 
 __CAPE_LIBEX   CapeUdc           qbus_route_items_nodes      (QBusRouteItems);
 
+                 // returns the primary connection of each link, except the link of the exception
+                 // the list holds references which are released when the list is deleted
 __CAPE_LIBEX   CapeList          qbus_route_items_conns      (QBusRouteItems, QBusConnection exception);
 
+                 // returns every connection of all links
+                 // the list holds references which are released when the list is deleted
+__CAPE_LIBEX   CapeList          qbus_route_items_conns_all  (QBusRouteItems);
+
+//-----------------------------------------------------------------------------
+
+                 // returns TRUE if the topics of the connection have changed
+__CAPE_LIBEX   int               qbus_route_items_topics_set (QBusRouteItems, QBusConnection conn, CapeUdc topics);
+
+                 // returns a list of all topics reachable without the exception
+__CAPE_LIBEX   CapeUdc           qbus_route_items_topics     (QBusRouteItems, QBusConnection exception);
+
+                 // the list holds references which are released when the list is deleted
+__CAPE_LIBEX   CapeList          qbus_route_items_topic_conns (QBusRouteItems, const CapeString topic, QBusConnection exception);
+
 //=============================================================================
 
 #endif
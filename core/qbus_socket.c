@@ -0,0 +1,321 @@
+#include "qbus_socket.h"
+
+// cape includes
+#include "sys/cape_log.h"
+#include "sys/cape_socket.h"
+
+// c includes
+#if defined __LINUX_OS || defined __BSD_OS
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+void qbus_socket_options_init (QBusSocketOptions* options)
+{
+  options->nodelay = TRUE;
+  options->sndbuf = 0;
+  options->rcvbuf = 0;
+  options->keepalive = 0;
+  options->keepalive_interval = 0;
+  options->keepalive_count = 0;
+  options->user_timeout = 0;
+  
+#if defined __LINUX_OS || defined __BSD_OS
+  options->backlog = SOMAXCONN;
+#else
+  options->backlog = 128;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_socket_options_read (QBusSocketOptions* options, CapeUdc config)
+{
+  CapeUdc node = cape_udc_get (config, "tcp");
+  
+  if (node == NULL)
+  {
+    return;
+  }
+  
+  options->nodelay = cape_udc_get_b (node, "nodelay", options->nodelay);
+  options->sndbuf = cape_udc_get_n (node, "sndbuf", options->sndbuf);
+  options->rcvbuf = cape_udc_get_n (node, "rcvbuf", options->rcvbuf);
+  options->keepalive = cape_udc_get_n (node, "keepalive", options->keepalive);
+  options->keepalive_interval = cape_udc_get_n (node, "keepalive_interval", options->keepalive_interval);
+  options->keepalive_count = cape_udc_get_n (node, "keepalive_count", options->keepalive_count);
+  options->user_timeout = cape_udc_get_n (node, "user_timeout", options->user_timeout);
+  options->backlog = cape_udc_get_n (node, "backlog", options->backlog);
+}
+
+//-----------------------------------------------------------------------------
+
+#if defined __LINUX_OS || defined __BSD_OS
+
+static void qbus_socket__set (int sock, int level, int name, int value, const char* text)
+{
+  if (setsockopt (sock, level, name, &value, sizeof(value)) < 0)
+  {
+    CapeErr err = cape_err_new ();
+    
+    cape_err_lastOSError (err);
+    
+    cape_log_fmt (CAPE_LL_WARN, "QBUS", "tcp options", "can't set %s: %s", text, cape_err_text (err));
+    
+    cape_err_del (&err);
+  }
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+void qbus_socket_options_apply (const QBusSocketOptions* options, void* handle)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  int sock = (int)(number_t)handle;
+  
+  qbus_socket__set (sock, IPPROTO_TCP, TCP_NODELAY, options->nodelay ? 1 : 0, "TCP_NODELAY");
+  
+  // the buffer sizes only affect the window scaling before connect or listen
+  if (options->sndbuf > 0)
+  {
+    qbus_socket__set (sock, SOL_SOCKET, SO_SNDBUF, (int)options->sndbuf, "SO_SNDBUF");
+  }
+  
+  if (options->rcvbuf > 0)
+  {
+    qbus_socket__set (sock, SOL_SOCKET, SO_RCVBUF, (int)options->rcvbuf, "SO_RCVBUF");
+  }
+  
+  if (options->keepalive > 0)
+  {
+    qbus_socket__set (sock, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+    
+#if defined TCP_KEEPIDLE
+    qbus_socket__set (sock, IPPROTO_TCP, TCP_KEEPIDLE, (int)options->keepalive, "TCP_KEEPIDLE");
+#endif
+    
+#if defined TCP_KEEPINTVL
+    if (options->keepalive_interval > 0)
+    {
+      qbus_socket__set (sock, IPPROTO_TCP, TCP_KEEPINTVL, (int)options->keepalive_interval, "TCP_KEEPINTVL");
+    }
+#endif
+    
+#if defined TCP_KEEPCNT
+    if (options->keepalive_count > 0)
+    {
+      qbus_socket__set (sock, IPPROTO_TCP, TCP_KEEPCNT, (int)options->keepalive_count, "TCP_KEEPCNT");
+    }
+#endif
+  }
+  
+#if defined TCP_USER_TIMEOUT
+  if (options->user_timeout > 0)
+  {
+    qbus_socket__set (sock, IPPROTO_TCP, TCP_USER_TIMEOUT, (int)options->user_timeout, "TCP_USER_TIMEOUT");
+  }
+#endif
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+#if defined __LINUX_OS || defined __BSD_OS
+
+static struct addrinfo* qbus_socket__resolve (const CapeString host, number_t port, int passive, CapeErr err)
+{
+  struct addrinfo hints;
+  struct addrinfo* addr = NULL;
+  
+  char port_text[16];
+  
+  memset (&hints, 0, sizeof(hints));
+  
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  
+  snprintf (port_text, sizeof(port_text), "%li", port);
+  
+  if (getaddrinfo (host, port_text, &hints, &addr) != 0 || addr == NULL)
+  {
+    cape_err_set_fmt (err, CAPE_ERR_NOT_FOUND, "can't resolve host %s", host);
+    return NULL;
+  }
+  
+  return addr;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+void* qbus_socket_srv_new (const CapeString host, number_t port, const QBusSocketOptions* options, int reuseport, CapeErr err)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  int sock = -1;
+  int opt = 1;
+  
+  struct addrinfo* addr = NULL;
+  
+#if !defined SO_REUSEPORT
+  if (reuseport)
+  {
+    cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "SO_REUSEPORT is not supported on this platform");
+    return NULL;
+  }
+#endif
+  
+  addr = qbus_socket__resolve (host, port, TRUE, err);
+  if (addr == NULL)
+  {
+    goto exit_and_cleanup;
+  }
+  
+  sock = socket (addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (sock < 0)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+  if (setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+#if defined SO_REUSEPORT
+  // all shards bind to the same address, the kernel spreads the connections
+  if (reuseport && setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+#endif
+  
+  // accepted sockets inherit the options of the listener
+  qbus_socket_options_apply (options, (void*)(number_t)sock);
+  
+  if (bind (sock, addr->ai_addr, addr->ai_addrlen) < 0 || listen (sock, (int)options->backlog) < 0)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+  // the AIO subsystem needs non blocking sockets
+  fcntl (sock, F_SETFL, fcntl (sock, F_GETFL, 0) | O_NONBLOCK);
+  
+  freeaddrinfo (addr);
+  
+  return (void*)(number_t)sock;
+  
+exit_and_cleanup:
+  
+  if (sock >= 0)
+  {
+    close (sock);
+  }
+  
+  if (addr)
+  {
+    freeaddrinfo (addr);
+  }
+  
+  return NULL;
+  
+#else
+  
+  if (reuseport)
+  {
+    cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "SO_REUSEPORT is not supported on this platform");
+    return NULL;
+  }
+  
+  // the system defaults are used
+  return cape_sock__tcp__srv_new (host, port, err);
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+void* qbus_socket_clt_new (const CapeString host, number_t port, const QBusSocketOptions* options, CapeErr err)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  int sock = -1;
+  
+  struct addrinfo* addr = qbus_socket__resolve (host, port, FALSE, err);
+  if (addr == NULL)
+  {
+    goto exit_and_cleanup;
+  }
+  
+  sock = socket (addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (sock < 0)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+  qbus_socket_options_apply (options, (void*)(number_t)sock);
+  
+  // the AIO subsystem needs non blocking sockets
+  fcntl (sock, F_SETFL, fcntl (sock, F_GETFL, 0) | O_NONBLOCK);
+  
+  // the connection completes in the background
+  if (connect (sock, addr->ai_addr, addr->ai_addrlen) < 0 && errno != EINPROGRESS)
+  {
+    cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+  freeaddrinfo (addr);
+  
+  return (void*)(number_t)sock;
+  
+exit_and_cleanup:
+  
+  if (sock >= 0)
+  {
+    close (sock);
+  }
+  
+  if (addr)
+  {
+    freeaddrinfo (addr);
+  }
+  
+  return NULL;
+  
+#else
+  
+  void* handle = cape_sock__tcp__clt_new (host, port, err);
+  
+  if (handle)
+  {
+    qbus_socket_options_apply (options, handle);
+  }
+  
+  return handle;
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
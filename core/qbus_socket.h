@@ -0,0 +1,53 @@
+#ifndef __QBUS__SOCKET__H
+#define __QBUS__SOCKET__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_types.h"
+#include "sys/cape_err.h"
+#include "stc/cape_str.h"
+#include "stc/cape_udc.h"
+
+//=============================================================================
+
+typedef struct
+{
+  int nodelay;                   // disable nagle, on by default for small frames
+  
+  number_t sndbuf;               // 0 keeps the system default
+  
+  number_t rcvbuf;               // 0 keeps the system default
+  
+  number_t keepalive;            // idle time in seconds before probing, 0 disables it
+  
+  number_t keepalive_interval;   // seconds between probes
+  
+  number_t keepalive_count;      // probes until the connection is dropped
+  
+  number_t user_timeout;         // ms unacknowledged data may stay, 0 keeps the system default
+  
+  number_t backlog;              // pending connections of a listener
+  
+} QBusSocketOptions;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   void              qbus_socket_options_init   (QBusSocketOptions*);
+
+                 // reads the 'tcp' node: nodelay, sndbuf, rcvbuf, keepalive, keepalive_interval, keepalive_count, user_timeout, backlog
+__CAPE_LIBEX   void              qbus_socket_options_read   (QBusSocketOptions*, CapeUdc config);
+
+                 // sets all options on a connection, failures are only logged
+__CAPE_LIBEX   void              qbus_socket_options_apply  (const QBusSocketOptions*, void* handle);
+
+//-----------------------------------------------------------------------------
+
+                 // creates a non blocking listener, the options are set before bind and listen
+                 // with reuseport several listeners can share the same address
+__CAPE_LIBEX   void*             qbus_socket_srv_new        (const CapeString host, number_t port, const QBusSocketOptions*, int reuseport, CapeErr);
+
+                 // creates a non blocking socket and starts to connect, the options are set before connect
+__CAPE_LIBEX   void*             qbus_socket_clt_new        (const CapeString host, number_t port, const QBusSocketOptions*, CapeErr);
+
+//-----------------------------------------------------------------------------
+
+#endif
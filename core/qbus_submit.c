@@ -0,0 +1,527 @@
+#include "qbus_submit.h"
+#include "qbus_frame.h"
+
+// cape includes
+#include "sys/cape_log.h"
+#include "aio/cape_aio_file.h"
+
+// c includes
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined __LINUX_OS
+#include <sys/eventfd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+typedef struct QBusSubmitItem_s
+{
+  struct QBusSubmitItem_s* next;
+  
+  QBusSubmit submit;       // reference
+  
+  CapeString module;
+  
+  CapeString method;
+  
+  QBusM msg;               // the request, later the response
+  
+  void* ptr;
+  
+  fct_qbus_onMessage onMsg;
+  
+  QBusCompletion cq;       // reference, if NULL the callback runs on the I/O thread
+  
+  QBusFrame frame;         // if set, the frame is sent to the module instead of a request
+  
+} QBusSubmitItem;
+
+//-----------------------------------------------------------------------------
+
+void qbus_submit_item_del (QBusSubmitItem** p_self)
+{
+  QBusSubmitItem* self = *p_self;
+  
+  cape_str_del (&(self->module));
+  cape_str_del (&(self->method));
+  
+  if (self->msg)
+  {
+    qbus_message_del (&(self->msg));
+  }
+  
+  qbus_frame_del (&(self->frame));
+  
+  CAPE_DEL (p_self, QBusSubmitItem);
+}
+
+//-----------------------------------------------------------------------------
+
+// lock free push, returns TRUE if the stack was empty
+static int qbus_submit__push (QBusSubmitItem** p_head, QBusSubmitItem* item)
+{
+  QBusSubmitItem* head = __atomic_load_n (p_head, __ATOMIC_RELAXED);
+  
+  do
+  {
+    item->next = head;
+  }
+  while (!__atomic_compare_exchange_n (p_head, &head, item, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  
+  return head == NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+// takes all items at once and returns them in the order they were pushed
+static QBusSubmitItem* qbus_submit__take (QBusSubmitItem** p_head)
+{
+  QBusSubmitItem* item = __atomic_exchange_n (p_head, NULL, __ATOMIC_ACQUIRE);
+  QBusSubmitItem* prev = NULL;
+  
+  while (item)
+  {
+    QBusSubmitItem* next = item->next;
+    
+    item->next = prev;
+    prev = item;
+    item = next;
+  }
+  
+  return prev;
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_submit__wake_new (int* p_fd_read, int* p_fd_write, CapeErr err)
+{
+#if defined __LINUX_OS
+  
+  int fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  *p_fd_read = fd;
+  *p_fd_write = fd;
+  
+#else
+  
+  int fds[2];
+  
+  if (pipe (fds) < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL, 0) | O_NONBLOCK);
+  
+  *p_fd_read = fds[0];
+  *p_fd_write = fds[1];
+  
+#endif
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_submit__wake_del (int fd_read, int fd_write)
+{
+  if (fd_write != fd_read && fd_write >= 0)
+  {
+    close (fd_write);
+  }
+  
+  if (fd_read >= 0)
+  {
+    close (fd_read);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_submit__wake (int fd_write)
+{
+#if defined __LINUX_OS
+  
+  uint64_t val = 1;
+  
+#else
+  
+  char val = 1;
+  
+#endif
+  
+  // if the counter or the pipe is full, a wakeup is already pending
+  if (write (fd_write, &val, sizeof(val)) < 0)
+  {
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_submit__wake_clr (int fd_read)
+{
+  char buf[64];
+  
+  while (read (fd_read, buf, sizeof(buf)) > 0)
+  {
+  }
+}
+
+//=============================================================================
+
+struct QBusCompletion_s
+{
+  QBusSubmitItem* head;
+  
+  int fd_read;
+  
+  int fd_write;
+  
+  QBus qbus;               // reference, set by the first submission
+};
+
+//-----------------------------------------------------------------------------
+
+QBusCompletion qbus_completion_new (CapeErr err)
+{
+  QBusCompletion self = CAPE_NEW (struct QBusCompletion_s);
+  
+  self->head = NULL;
+  self->qbus = NULL;
+  
+  if (qbus_submit__wake_new (&(self->fd_read), &(self->fd_write), err))
+  {
+    CAPE_DEL (&self, struct QBusCompletion_s);
+  }
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_completion_del (QBusCompletion* p_self)
+{
+  if (*p_self)
+  {
+    QBusCompletion self = *p_self;
+    
+    QBusSubmitItem* item = qbus_submit__take (&(self->head));
+    
+    while (item)
+    {
+      QBusSubmitItem* next = item->next;
+      
+      qbus_submit_item_del (&item);
+      
+      item = next;
+    }
+    
+    qbus_submit__wake_del (self->fd_read, self->fd_write);
+    
+    CAPE_DEL (p_self, struct QBusCompletion_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void* qbus_completion_handle (QBusCompletion self)
+{
+  return (void*)(number_t)self->fd_read;
+}
+
+//-----------------------------------------------------------------------------
+
+number_t qbus_completion_poll (QBusCompletion self)
+{
+  number_t cnt = 0;
+  QBusSubmitItem* item;
+  
+  // clear first, a later push will wake again
+  qbus_submit__wake_clr (self->fd_read);
+  
+  item = qbus_submit__take (&(self->head));
+  
+  while (item)
+  {
+    QBusSubmitItem* next = item->next;
+    
+    if (item->onMsg)
+    {
+      item->onMsg (self->qbus, item->ptr, item->msg, NULL, item->msg->err);
+    }
+    
+    qbus_submit_item_del (&item);
+    
+    cnt++;
+    item = next;
+  }
+  
+  return cnt;
+}
+
+//=============================================================================
+
+struct QBusSubmit_s
+{
+  QBus qbus;               // reference
+  
+  QBusRoute route;         // reference
+  
+  QBusSubmitItem* head;
+  
+  int fd_read;
+  
+  int fd_write;
+};
+
+//-----------------------------------------------------------------------------
+
+QBusSubmit qbus_submit_new (QBus qbus, QBusRoute route)
+{
+  QBusSubmit self = CAPE_NEW (struct QBusSubmit_s);
+  
+  self->qbus = qbus;
+  self->route = route;
+  
+  self->head = NULL;
+  
+  self->fd_read = -1;
+  self->fd_write = -1;
+  
+  {
+    CapeErr err = cape_err_new ();
+    
+    if (qbus_submit__wake_new (&(self->fd_read), &(self->fd_write), err))
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "submit", "can't create wakeup handle: %s", cape_err_text (err));
+    }
+    
+    cape_err_del (&err);
+  }
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_submit_del (QBusSubmit* p_self)
+{
+  QBusSubmit self = *p_self;
+  
+  QBusSubmitItem* item = qbus_submit__take (&(self->head));
+  
+  while (item)
+  {
+    QBusSubmitItem* next = item->next;
+    
+    qbus_submit_item_del (&item);
+    
+    item = next;
+  }
+  
+  qbus_submit__wake_del (self->fd_read, self->fd_write);
+  
+  CAPE_DEL (p_self, struct QBusSubmit_s);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_submit__deliver (QBusSubmitItem* item, QBusM qin, CapeErr err)
+{
+  if (item->cq == NULL)
+  {
+    int res = CAPE_ERR_NONE;
+    
+    if (item->onMsg)
+    {
+      res = item->onMsg (item->submit->qbus, item->ptr, qin, NULL, err);
+    }
+    
+    qbus_submit_item_del (&item);
+    
+    return res;
+  }
+  
+  // transfer the response, the original message will be deleted
+  item->msg = qbus_message_new (qin->chain_key, qin->sender);
+  
+  item->msg->mtype = qin->mtype;
+  
+  item->msg->cdata = qin->cdata;
+  qin->cdata = NULL;
+  
+  item->msg->pdata = qin->pdata;
+  qin->pdata = NULL;
+  
+  item->msg->clist = qin->clist;
+  qin->clist = NULL;
+  
+  item->msg->rinfo = qin->rinfo;
+  qin->rinfo = NULL;
+  
+  item->msg->files = qin->files;
+  qin->files = NULL;
+  
+  item->msg->blobs = qin->blobs;
+  qin->blobs = NULL;
+  
+  if (qin->err)
+  {
+    item->msg->err = qin->err;
+    qin->err = NULL;
+  }
+  else if (err && cape_err_code (err))
+  {
+    item->msg->err = cape_err_new ();
+    cape_err_set (item->msg->err, cape_err_code (err), cape_err_text (err));
+  }
+  
+  {
+    QBusCompletion cq = item->cq;
+    
+    cq->qbus = item->submit->qbus;
+    
+    if (qbus_submit__push (&(cq->head), item))
+    {
+      qbus_submit__wake (cq->fd_write);
+    }
+  }
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_submit__on_response (QBus qbus, void* ptr, QBusM qin, QBusM qout, CapeErr err)
+{
+  return qbus_submit__deliver (ptr, qin, err);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_submit__drain (QBusSubmit self)
+{
+  QBusSubmitItem* item = qbus_submit__take (&(self->head));
+  
+  while (item)
+  {
+    QBusSubmitItem* next = item->next;
+    
+    if (item->frame)
+    {
+      qbus_route_send_frame (self->route, item->module, &(item->frame));
+      
+      qbus_submit_item_del (&item);
+    }
+    else
+    {
+      CapeErr err = cape_err_new ();
+      
+      // the item might be gone when the request returns
+      QBusM msg = item->msg;
+      item->msg = NULL;
+      
+      // the route calls the response callback in every case, also if there is no route to the module
+      // the callback delivers and releases the item, it must not be touched here anymore
+      qbus_route_request (self->route, item->module, item->method, msg, item, qbus_submit__on_response, NULL, FALSE, err);
+      
+      qbus_message_del (&msg);
+      
+      cape_err_del (&err);
+    }
+    
+    item = next;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_submit__on_wake (void* ptr, CapeAioFileReader freader, const char* bufdat, number_t buflen)
+{
+  qbus_submit__drain (ptr);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_submit_open (QBusSubmit self, CapeAioContext aio, CapeErr err)
+{
+  CapeAioFileReader fr;
+  
+  if (self->fd_read < 0)
+  {
+    return cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "no wakeup handle");
+  }
+  
+  // the reader consumes the wakeup counter and drains the queue
+  fr = cape_aio_freader_new ((void*)(number_t)self->fd_read, self, qbus_submit__on_wake);
+  
+  if (cape_aio_freader_add (&fr, aio) == FALSE)
+  {
+    return cape_err_set (err, CAPE_ERR_OS, "can't add wakeup handle to the event loop");
+  }
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_submit_add (QBusSubmit self, const char* module, const char* method, QBusM* p_msg, void* ptr, fct_qbus_onMessage onMsg, QBusCompletion cq)
+{
+  QBusSubmitItem* item = CAPE_NEW (QBusSubmitItem);
+  
+  item->next = NULL;
+  item->submit = self;
+  
+  item->module = cape_str_cp (module);
+  item->method = cape_str_cp (method);
+  
+  // transfer ownership
+  item->msg = *p_msg;
+  *p_msg = NULL;
+  
+  item->ptr = ptr;
+  item->onMsg = onMsg;
+  item->cq = cq;
+  item->frame = NULL;
+  
+  if (qbus_submit__push (&(self->head), item))
+  {
+    qbus_submit__wake (self->fd_write);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_submit_frame (QBusSubmit self, const char* module, QBusFrame* p_frame)
+{
+  QBusSubmitItem* item = CAPE_NEW (QBusSubmitItem);
+  
+  item->next = NULL;
+  item->submit = self;
+  
+  item->module = cape_str_cp (module);
+  item->method = NULL;
+  
+  item->msg = NULL;
+  item->ptr = NULL;
+  item->onMsg = NULL;
+  item->cq = NULL;
+  
+  // transfer ownership
+  item->frame = *p_frame;
+  *p_frame = NULL;
+  
+  if (qbus_submit__push (&(self->head), item))
+  {
+    qbus_submit__wake (self->fd_write);
+  }
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,29 @@
+#ifndef __QBUS__SUBMIT__H
+#define __QBUS__SUBMIT__H 1
+
+#include "qbus_route.h"
+
+#include "sys/cape_export.h"
+#include "sys/cape_err.h"
+#include "aio/cape_aio_ctx.h"
+
+//=============================================================================
+
+__CAPE_LIBEX   QBusSubmit        qbus_submit_new          (QBus qbus, QBusRoute route);
+
+__CAPE_LIBEX   void              qbus_submit_del          (QBusSubmit*);
+
+                 // registers the wakeup handle at the event loop, all queued requests will be sent
+__CAPE_LIBEX   int               qbus_submit_open         (QBusSubmit, CapeAioContext aio, CapeErr err);
+
+//-----------------------------------------------------------------------------
+
+                 // can be called from any thread, takes ownership of the message
+__CAPE_LIBEX   void              qbus_submit_add          (QBusSubmit, const char* module, const char* method, QBusM* p_msg, void* ptr, fct_qbus_onMessage, QBusCompletion);
+
+                 // can be called from any thread, the frame is sent to the module by the I/O thread, takes ownership of the frame
+__CAPE_LIBEX   void              qbus_submit_frame        (QBusSubmit, const char* module, QBusFrame*);
+
+//=============================================================================
+
+#endif
@@ -0,0 +1,236 @@
+#include "engine_local.h"
+
+// cape includes
+#include "sys/cape_mutex.h"
+#include "sys/cape_log.h"
+
+// qbus core
+#include "qbus_core.h"
+
+//-----------------------------------------------------------------------------
+
+typedef struct EngineLocalPoint_s* EngineLocalPoint;
+
+struct EngineLocalPoint_s
+{
+  QBusConnection conn;
+  
+  QBusRoute route;
+  
+  EngineLocalPoint peer;
+  
+  CapeMutex mutex;
+  
+  int pumping;            // only one thread delivers at a time
+  
+  int again;              // the engine was marked while delivering
+  
+  void* sent;             // the stream which was delivered last
+  
+  int closed;             // the link was dropped, nothing is delivered anymore
+};
+
+
+//-----------------------------------------------------------------------------
+
+static EngineLocalPoint qbus_engine_local_point_new (QBusRoute route)
+{
+  EngineLocalPoint self = CAPE_NEW (struct EngineLocalPoint_s);
+  
+  self->conn = qbus_connection_new (route, 0);
+  self->route = route;
+  self->peer = NULL;
+  
+  self->mutex = cape_mutex_new ();
+  
+  self->pumping = FALSE;
+  self->again = FALSE;
+  self->sent = NULL;
+  self->closed = FALSE;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_local_point_del (EngineLocalPoint* p_self)
+{
+  EngineLocalPoint self = *p_self;
+  
+  qbus_connection_del (&(self->conn));
+  
+  cape_mutex_del (&(self->mutex));
+  
+  CAPE_DEL (p_self, struct EngineLocalPoint_s);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_local_point__pump (EngineLocalPoint self)
+{
+  cape_mutex_lock (self->mutex);
+  
+  if (self->pumping)
+  {
+    // the delivering thread will pick it up
+    self->again = TRUE;
+    
+    cape_mutex_unlock (self->mutex);
+    return;
+  }
+  
+  self->pumping = TRUE;
+  
+  do
+  {
+    self->again = FALSE;
+    
+    if (__atomic_load_n (&(self->closed), __ATOMIC_SEQ_CST))
+    {
+      // the queue is released with the connection
+      break;
+    }
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // deliver frame objects and encoded streams of the connection queue in send order
+    qbus_connection_onSent (self->conn, NULL);
+    
+    while (self->sent)
+    {
+      void* userdata = self->sent;
+      
+      self->sent = NULL;
+      
+      // releases the stream and delivers the next one
+      qbus_connection_onSent (self->conn, userdata);
+    }
+    
+    cape_mutex_lock (self->mutex);
+  }
+  while (self->again);
+  
+  self->pumping = FALSE;
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_local_send (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata)
+{
+  EngineLocalPoint self = ptr1;
+  
+  // only called within the pump, the peer has no concurrent reader
+  qbus_connection_onRecv (self->peer->conn, bufdat, buflen);
+  
+  self->sent = userdata;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_local_mark (void* ptr1, void* ptr2)
+{
+  qbus_engine_local_point__pump (ptr1);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_local_close (void* ptr1, void* ptr2)
+{
+  EngineLocalPoint self = ptr1;
+  
+  // both directions are dropped at once, like a closed socket
+  if (__atomic_exchange_n (&(self->closed), TRUE, __ATOMIC_SEQ_CST) == FALSE)
+  {
+    __atomic_store_n (&(self->peer->closed), TRUE, __ATOMIC_SEQ_CST);
+    
+    cape_log_msg (CAPE_LL_DEBUG, "QBUS", "engine local", "link dropped");
+    
+    // remove the routes on both sides, the connections are released with the engine
+    qbus_route_conn_rm (self->route, self->conn);
+    qbus_route_conn_rm (self->peer->route, self->peer->conn);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_local_frame (void* ptr1, void* ptr2, QBusFrame* p_frame)
+{
+  EngineLocalPoint self = ptr1;
+  
+  // only called within the pump, the frame object is taken over as it is
+  qbus_connection_onFrame (self->peer->conn, p_frame);
+}
+
+//-----------------------------------------------------------------------------
+
+struct EngineLocal_s
+{
+  EngineLocalPoint point_a;
+  
+  EngineLocalPoint point_b;
+  
+  int connected;
+};
+
+//-----------------------------------------------------------------------------
+
+EngineLocal qbus_engine_local_new (QBusRoute route_a, QBusRoute route_b)
+{
+  EngineLocal self = CAPE_NEW (struct EngineLocal_s);
+  
+  self->point_a = qbus_engine_local_point_new (route_a);
+  self->point_b = qbus_engine_local_point_new (route_b);
+  
+  self->point_a->peer = self->point_b;
+  self->point_b->peer = self->point_a;
+  
+  self->connected = FALSE;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_local_del (EngineLocal* p_self)
+{
+  if (*p_self)
+  {
+    EngineLocal self = *p_self;
+    
+    qbus_engine_local_point_del (&(self->point_a));
+    qbus_engine_local_point_del (&(self->point_b));
+    
+    CAPE_DEL (p_self, struct EngineLocal_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_local_connect (EngineLocal self, CapeErr err)
+{
+  if (self->connected)
+  {
+    return cape_err_set (err, CAPE_ERR_WRONG_STATE, "routes are already linked");
+  }
+  
+  qbus_connection_cb (self->point_a->conn, self->point_a, NULL, qbus_engine_local_send, qbus_engine_local_mark);
+  qbus_connection_cb (self->point_b->conn, self->point_b, NULL, qbus_engine_local_send, qbus_engine_local_mark);
+  
+  qbus_connection_cb_frame (self->point_a->conn, qbus_engine_local_frame);
+  qbus_connection_cb_frame (self->point_b->conn, qbus_engine_local_frame);
+  
+  qbus_connection_cb_close (self->point_a->conn, qbus_engine_local_close);
+  qbus_connection_cb_close (self->point_b->conn, qbus_engine_local_close);
+  
+  self->connected = TRUE;
+  
+  // both connections must be able to receive before the routes are exchanged
+  qbus_connection_reg (self->point_a->conn);
+  qbus_connection_reg (self->point_b->conn);
+  
+  cape_log_msg (CAPE_LL_DEBUG, "QBUS", "engine local", "routes linked");
+  
+  return CAPE_ERR_NONE;
+}
@@ -0,0 +1,25 @@
+#ifndef __QBUS__ENGINE__LOCAL__H
+#define __QBUS__ENGINE__LOCAL__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_err.h"
+
+#include "qbus_route.h"
+
+//=============================================================================
+
+struct EngineLocal_s; typedef struct EngineLocal_s* EngineLocal;
+
+//-----------------------------------------------------------------------------
+
+                 // links two routes of the same process without sockets
+__CAPE_LIBEX   EngineLocal       qbus_engine_local_new        (QBusRoute route_a, QBusRoute route_b);
+
+                 // both routes must still exist and must be idle
+__CAPE_LIBEX   void              qbus_engine_local_del        (EngineLocal*);
+
+__CAPE_LIBEX   int               qbus_engine_local_connect    (EngineLocal, CapeErr);
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,1266 @@
+// memfd_create
+#define _GNU_SOURCE
+
+#include "engine_shm.h"
+
+// cape includes
+#include "sys/cape_log.h"
+#include "sys/cape_mutex.h"
+
+// qbus core
+#include "qbus_core.h"
+#include "qbus_backoff.h"
+
+// c includes
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+//-----------------------------------------------------------------------------
+
+// the header of a ring, each counter on its own cache line
+typedef struct
+{
+  uint64_t head;              // written by the producer
+  
+  char pad_head[56];
+  
+  uint64_t tail;              // written by the consumer
+  
+  char pad_tail[56];
+  
+  uint32_t reader_sleeping;   // the consumer needs a signal for new data
+  
+  uint32_t writer_waiting;    // the producer needs a signal for free space
+  
+  char pad_flags[56];
+  
+} EngineShmRingHead;
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  EngineShmRingHead* head;
+  
+  char* data;
+  
+} EngineShmRing;
+
+#define QBUS_ENGINE_SHM_MAP_SIZE   (2 * (sizeof(EngineShmRingHead) + QBUS_ENGINE_SHM_RING_SIZE))
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm__signal (int fd)
+{
+  uint64_t val = 1;
+  
+  // if the counter is full, a signal is already pending
+  if (write (fd, &val, sizeof(val)) < 0)
+  {
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm__signal_clr (int fd)
+{
+  uint64_t val;
+  
+  // resets the counter, the handle is non blocking
+  if (read (fd, &val, sizeof(val)) < 0)
+  {
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static number_t qbus_engine_shm__ring_write (EngineShmRing* ring, const char* bufdat, number_t buflen)
+{
+  uint64_t head = ring->head->head;
+  uint64_t tail = __atomic_load_n (&(ring->head->tail), __ATOMIC_ACQUIRE);
+  
+  number_t len = QBUS_ENGINE_SHM_RING_SIZE - (head - tail);
+  
+  if (len > buflen)
+  {
+    len = buflen;
+  }
+  
+  if (len > 0)
+  {
+    number_t pos = head % QBUS_ENGINE_SHM_RING_SIZE;
+    number_t part = QBUS_ENGINE_SHM_RING_SIZE - pos;
+    
+    if (part > len)
+    {
+      part = len;
+    }
+    
+    memcpy (ring->data + pos, bufdat, part);
+    memcpy (ring->data, bufdat + part, len - part);
+    
+    __atomic_store_n (&(ring->head->head), head + len, __ATOMIC_SEQ_CST);
+  }
+  
+  return len;
+}
+
+//-----------------------------------------------------------------------------
+
+// watches the signals of the peer, owned by the event loop
+typedef struct
+{
+  void* conn;                  // reference, NULL as soon as the connection was deleted
+  
+  CapeMutex mutex;
+  
+  int fd;
+  
+} EngineShmSignal;
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusConnection conn;
+  
+  CapeAioContext aio;          // reference
+  
+  void* map;
+  
+  EngineShmRing tx;
+  
+  EngineShmRing rx;
+  
+  EngineShmSignal* signal;     // reference, watches the signals for us
+  
+  int fd_peer;                 // signals for the peer
+  
+  int fd_blob;                 // passes the handles of files
+  
+  void* eout;                  // reference, only for outgoing connections
+  
+  CapeAioSocket sock;          // reference, watches the handshake socket
+  
+  // sending
+  
+  CapeMutex mutex;
+  
+  int pumping;
+  
+  int again;
+  
+  int pend_active;
+  
+  const char* pend_data;
+  
+  number_t pend_len;
+  
+  void* pend_userdata;
+  
+} EngineShmConn;
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm_conn__pump (EngineShmConn* self)
+{
+  cape_mutex_lock (self->mutex);
+  
+  if (self->pumping)
+  {
+    // the running pump will take care
+    self->again = TRUE;
+    
+    cape_mutex_unlock (self->mutex);
+    return;
+  }
+  
+  self->pumping = TRUE;
+  
+  cape_mutex_unlock (self->mutex);
+  
+  for (;;)
+  {
+    if (self->pend_active == FALSE)
+    {
+      // fetch the next buffer from the connection queue
+      qbus_connection_onSent (self->conn, NULL);
+    }
+    
+    if (self->pend_active)
+    {
+      number_t len = qbus_engine_shm__ring_write (&(self->tx), self->pend_data, self->pend_len);
+      
+      if (len > 0)
+      {
+        self->pend_data += len;
+        self->pend_len -= len;
+        
+        if (__atomic_load_n (&(self->tx.head->reader_sleeping), __ATOMIC_SEQ_CST))
+        {
+          qbus_engine_shm__signal (self->fd_peer);
+        }
+      }
+      
+      if (self->pend_len == 0)
+      {
+        void* userdata = self->pend_userdata;
+        
+        self->pend_active = FALSE;
+        self->pend_userdata = NULL;
+        
+        // release the buffer and fetch the next one
+        qbus_connection_onSent (self->conn, userdata);
+        
+        continue;
+      }
+      
+      // the ring is full, ask the peer for a signal
+      __atomic_store_n (&(self->tx.head->writer_waiting), 1, __ATOMIC_SEQ_CST);
+      
+      if (__atomic_load_n (&(self->tx.head->tail), __ATOMIC_SEQ_CST) != self->tx.head->head - QBUS_ENGINE_SHM_RING_SIZE)
+      {
+        // meanwhile space is available
+        continue;
+      }
+    }
+    
+    cape_mutex_lock (self->mutex);
+    
+    if (self->again)
+    {
+      self->again = FALSE;
+      
+      cape_mutex_unlock (self->mutex);
+      continue;
+    }
+    
+    self->pumping = FALSE;
+    
+    cape_mutex_unlock (self->mutex);
+    return;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm_conn__drain (EngineShmConn* self)
+{
+  EngineShmRingHead* h = self->rx.head;
+  
+  for (;;)
+  {
+    uint64_t tail = h->tail;
+    uint64_t head;
+    
+    __atomic_store_n (&(h->reader_sleeping), 0, __ATOMIC_SEQ_CST);
+    
+    head = __atomic_load_n (&(h->head), __ATOMIC_ACQUIRE);
+    
+    while (tail != head)
+    {
+      number_t pos = tail % QBUS_ENGINE_SHM_RING_SIZE;
+      number_t len = QBUS_ENGINE_SHM_RING_SIZE - pos;
+      
+      if (len > (number_t)(head - tail))
+      {
+        len = head - tail;
+      }
+      
+      // the connection copies the data into its frame
+      qbus_connection_onRecv (self->conn, self->rx.data + pos, len);
+      
+      tail += len;
+      
+      __atomic_store_n (&(h->tail), tail, __ATOMIC_SEQ_CST);
+      
+      if (__atomic_load_n (&(h->writer_waiting), __ATOMIC_SEQ_CST))
+      {
+        __atomic_store_n (&(h->writer_waiting), 0, __ATOMIC_SEQ_CST);
+        
+        qbus_engine_shm__signal (self->fd_peer);
+      }
+    }
+    
+    __atomic_store_n (&(h->reader_sleeping), 1, __ATOMIC_SEQ_CST);
+    
+    // check again, the producer might have missed the flag
+    if (__atomic_load_n (&(h->head), __ATOMIC_SEQ_CST) == tail)
+    {
+      break;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_shm_send (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata)
+{
+  EngineShmConn* self = ptr1;
+  
+  // will be written by the pump
+  self->pend_data = bufdat;
+  self->pend_len = buflen;
+  self->pend_userdata = userdata;
+  self->pend_active = TRUE;
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_shm_mark (void* ptr1, void* ptr2)
+{
+  qbus_engine_shm_conn__pump (ptr1);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_shm_close (void* ptr1, void* ptr2)
+{
+  EngineShmConn* self = ptr1;
+  
+  if (self->sock)
+  {
+    // the done callback of the socket cleans up the connection
+    cape_aio_socket_close (self->sock, self->aio);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+number_t __STDCALL qbus_engine_shm_blob (void* ptr, int fd, number_t offset, number_t size)
+{
+  EngineShmConn* self = ptr;
+  
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  char tag = 'B';
+  
+  memset (&msg, 0, sizeof(msg));
+  memset (cbuf, 0, sizeof(cbuf));
+  
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof(int));
+  
+  memcpy (CMSG_DATA (cmsg), &fd, sizeof(int));
+  
+  // the peer gets its own handle of the file, the content is not touched
+  if (sendmsg (self->fd_blob, &msg, MSG_NOSIGNAL) < 0)
+  {
+    return -1;
+  }
+  
+  return size;
+}
+
+//-----------------------------------------------------------------------------
+
+int __STDCALL qbus_engine_shm_fetch (void* ptr)
+{
+  EngineShmConn* self = ptr;
+  
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  char tag;
+  
+  int fd;
+  
+  memset (&msg, 0, sizeof(msg));
+  
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  
+  // the handle was sent before the header was written into the ring
+  if (recvmsg (self->fd_blob, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) <= 0)
+  {
+    return -1;
+  }
+  
+  cmsg = CMSG_FIRSTHDR (&msg);
+  
+  if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN (sizeof(int)))
+  {
+    return -1;
+  }
+  
+  memcpy (&fd, CMSG_DATA (cmsg), sizeof(int));
+  
+  return fd;
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_engine_shm_signal__on_event (void* ptr, int hflags, unsigned long events, unsigned long param1)
+{
+  EngineShmSignal* self = ptr;
+  
+  qbus_engine_shm__signal_clr (self->fd);
+  
+  cape_mutex_lock (self->mutex);
+  
+  if (self->conn)
+  {
+    // new data or free space
+    qbus_engine_shm_conn__drain (self->conn);
+    qbus_engine_shm_conn__pump (self->conn);
+  }
+  else
+  {
+    // the connection is gone, remove the handle from the event loop
+    hflags = CAPE_AIO_DONE;
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return hflags;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm_signal__del (EngineShmSignal** p_self)
+{
+  EngineShmSignal* self = *p_self;
+  
+  close (self->fd);
+  
+  cape_mutex_del (&(self->mutex));
+  
+  CAPE_DEL (p_self, EngineShmSignal);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_signal__on_unref (void* ptr, CapeAioHandle aioh, int force_close)
+{
+  EngineShmSignal* self = ptr;
+  
+  qbus_engine_shm_signal__del (&self);
+  
+  cape_aio_handle_del (&aioh);
+}
+
+//-----------------------------------------------------------------------------
+
+static EngineShmSignal* qbus_engine_shm_signal_new (CapeAioContext aio, void* conn, int fd)
+{
+  EngineShmSignal* self = CAPE_NEW (EngineShmSignal);
+  
+  self->conn = conn;
+  self->mutex = cape_mutex_new ();
+  self->fd = fd;
+  
+  {
+    CapeAioHandle aioh = cape_aio_handle_new (CAPE_AIO_READ, self, qbus_engine_shm_signal__on_event, qbus_engine_shm_signal__on_unref);
+    
+    if (cape_aio_context_add (aio, aioh, (void*)(number_t)fd, 0) == FALSE)
+    {
+      cape_log_msg (CAPE_LL_ERROR, "QBUS", "shm connection", "can't add signal handle to the event loop");
+      
+      cape_aio_handle_del (&aioh);
+      qbus_engine_shm_signal__del (&self);
+    }
+  }
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm_signal_detach (EngineShmSignal* self)
+{
+  if (self)
+  {
+    cape_mutex_lock (self->mutex);
+    
+    // a running signal handler finishes before the connection is released
+    self->conn = NULL;
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // the peer holds the same handle, closing ours would not remove it from the event loop
+    // the next signal lets the handler remove itself
+    qbus_engine_shm__signal (self->fd);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+// server side rings are [0] = tx, [1] = rx
+static EngineShmConn* qbus_engine_shm_conn_new (CapeAioContext aio, QBusRoute route, int fd_mem, int fd_own, int fd_peer, int fd_blob, int server, void* eout, CapeErr err)
+{
+  EngineShmConn* self;
+  EngineShmRing rings[2];
+  
+  void* map = mmap (NULL, QBUS_ENGINE_SHM_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_mem, 0);
+  
+  // the mapping stays valid without the handle
+  close (fd_mem);
+  
+  if (map == MAP_FAILED)
+  {
+    cape_err_lastOSError (err);
+    
+    close (fd_own);
+    close (fd_peer);
+    close (fd_blob);
+    
+    return NULL;
+  }
+  
+  rings[0].head = map;
+  rings[0].data = (char*)map + sizeof(EngineShmRingHead);
+  
+  rings[1].head = (EngineShmRingHead*)((char*)map + sizeof(EngineShmRingHead) + QBUS_ENGINE_SHM_RING_SIZE);
+  rings[1].data = (char*)rings[1].head + sizeof(EngineShmRingHead);
+  
+  self = CAPE_NEW (EngineShmConn);
+  
+  self->conn = qbus_connection_new (route, 0);
+  self->aio = aio;
+  self->map = map;
+  
+  self->tx = server ? rings[0] : rings[1];
+  self->rx = server ? rings[1] : rings[0];
+  
+  self->fd_peer = fd_peer;
+  self->fd_blob = fd_blob;
+  
+  self->eout = eout;
+  self->sock = NULL;
+  
+  self->mutex = cape_mutex_new ();
+  self->pumping = FALSE;
+  self->again = FALSE;
+  self->pend_active = FALSE;
+  self->pend_data = NULL;
+  self->pend_len = 0;
+  self->pend_userdata = NULL;
+  
+  // set qbus connection callbacks
+  qbus_connection_cb (self->conn, self, NULL, qbus_engine_shm_send, qbus_engine_shm_mark);
+  qbus_connection_cb_close (self->conn, qbus_engine_shm_close);
+  qbus_connection_cb_blob (self->conn, self, qbus_engine_shm_blob, qbus_engine_shm_fetch);
+  
+  // listen to the signals of the peer
+  self->signal = qbus_engine_shm_signal_new (aio, self, fd_own);
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm_conn_del (EngineShmConn** p_self)
+{
+  EngineShmConn* self = *p_self;
+  
+  qbus_engine_shm_signal_detach (self->signal);
+  
+  qbus_connection_del (&(self->conn));
+  
+  close (self->fd_peer);
+  close (self->fd_blob);
+  
+  munmap (self->map, QBUS_ENGINE_SHM_MAP_SIZE);
+  
+  cape_mutex_del (&(self->mutex));
+  
+  CAPE_DEL (p_self, EngineShmConn);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_shm__addr (struct sockaddr_un* addr, const CapeString file, CapeErr err)
+{
+  memset (addr, 0, sizeof(struct sockaddr_un));
+  
+  addr->sun_family = AF_UNIX;
+  
+  if (strlen (file) >= sizeof(addr->sun_path))
+  {
+    return cape_err_set_fmt (err, CAPE_ERR_WRONG_VALUE, "socket path is too long: %s", file);
+  }
+  
+  strcpy (addr->sun_path, file);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_shm__stale (struct sockaddr_un* addr, CapeErr err)
+{
+  int res = CAPE_ERR_NONE;
+  
+  int sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  if (connect (sock, (struct sockaddr*)addr, sizeof(struct sockaddr_un)) == 0 || errno == EAGAIN)
+  {
+    // another process still accepts connections on the socket
+    res = cape_err_set_fmt (err, CAPE_ERR_WRONG_STATE, "socket is in use: %s", addr->sun_path);
+  }
+  else if (errno == ECONNREFUSED)
+  {
+    // nobody listens anymore, remove the socket file of a previous run
+    unlink (addr->sun_path);
+  }
+  
+  close (sock);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm__sock_onSent (void* ptr, CapeAioSocket socket, void* userdata)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm__sock_onRecv (void* ptr, CapeAioSocket socket, const char* bufdat, number_t buflen)
+{
+  // the socket is only used to detect a closed peer
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_shm__watch (EngineShmConn* conn, void* handle, fct_cape_aio_socket_onDone on_done)
+{
+  CapeAioSocket sock = cape_aio_socket_new (handle);
+  
+  conn->sock = sock;
+  
+  cape_aio_socket_callback (sock, conn, qbus_engine_shm__sock_onSent, qbus_engine_shm__sock_onRecv, on_done);
+  
+  cape_aio_socket_listen (&sock, conn->aio);
+}
+
+//=============================================================================
+
+struct EngineShmInc_s
+{
+  CapeString file;
+  
+  int bound;            // the socket file was created by us
+  
+  CapeAioContext aio;   // reference
+  
+  QBusRoute route;      // reference
+  
+};
+
+//-----------------------------------------------------------------------------
+
+EngineShmInc qbus_engine_shm_inc_new (CapeAioContext aio, QBusRoute route, const CapeString path, const CapeString name)
+{
+  EngineShmInc self = CAPE_NEW (struct EngineShmInc_s);
+  
+  self->file = cape_str_fmt ("%s/%s", path, name);
+  self->bound = FALSE;
+  
+  self->aio = aio;
+  self->route = route;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_shm_inc_del (EngineShmInc* p_self)
+{
+  if (*p_self)
+  {
+    EngineShmInc self = *p_self;
+    
+    if (self->bound)
+    {
+      // remove the socket file, only if it is ours
+      unlink (self->file);
+    }
+    
+    cape_str_del (&(self->file));
+    
+    CAPE_DEL(p_self, struct EngineShmInc_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_inc_onDone (void* ptr, void* userdata)
+{
+  EngineShmConn* conn = ptr;
+  
+  qbus_engine_shm_conn_del (&conn);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_shm_inc__handshake (EngineShmInc self, int sock, CapeErr err)
+{
+  int res;
+  
+  int fds[4];
+  int fd_blob = -1;
+  
+  fds[0] = memfd_create ("qbus", MFD_CLOEXEC);
+  fds[1] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds[2] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds[3] = -1;
+  
+  if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0 || ftruncate (fds[0], QBUS_ENGINE_SHM_MAP_SIZE) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    goto exit_and_cleanup;
+  }
+  
+  // message boundaries keep every passed handle separate
+  {
+    int pair[2];
+    
+    if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+    {
+      res = cape_err_lastOSError (err);
+      goto exit_and_cleanup;
+    }
+    
+    fd_blob = pair[0];
+    fds[3] = pair[1];
+  }
+  
+  // initial state: both sides need a signal for new data
+  {
+    void* map = mmap (NULL, QBUS_ENGINE_SHM_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    
+    if (map == MAP_FAILED)
+    {
+      res = cape_err_lastOSError (err);
+      goto exit_and_cleanup;
+    }
+    
+    ((EngineShmRingHead*)map)->reader_sleeping = 1;
+    ((EngineShmRingHead*)((char*)map + sizeof(EngineShmRingHead) + QBUS_ENGINE_SHM_RING_SIZE))->reader_sleeping = 1;
+    
+    munmap (map, QBUS_ENGINE_SHM_MAP_SIZE);
+  }
+  
+  // pass the memory, both signal handles and the blob channel to the client
+  {
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    char tag = 'Q';
+    
+    memset (&msg, 0, sizeof(msg));
+    memset (cbuf, 0, sizeof(cbuf));
+    
+    iov.iov_base = &tag;
+    iov.iov_len = 1;
+    
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof(fds));
+    
+    memcpy (CMSG_DATA (cmsg), fds, sizeof(fds));
+    
+    if (sendmsg (sock, &msg, 0) < 0)
+    {
+      res = cape_err_lastOSError (err);
+      goto exit_and_cleanup;
+    }
+  }
+  
+  // the client has its own handle of the blob channel
+  close (fds[3]);
+  fds[3] = -1;
+  
+  {
+    EngineShmConn* conn = qbus_engine_shm_conn_new (self->aio, self->route, fds[0], fds[1], fds[2], fd_blob, TRUE, NULL, err);
+    
+    // handles are owned by the connection now
+    fds[0] = -1;
+    fds[1] = -1;
+    fds[2] = -1;
+    fd_blob = -1;
+    
+    if (conn == NULL)
+    {
+      res = cape_err_code (err);
+      goto exit_and_cleanup;
+    }
+    
+    qbus_engine_shm__watch (conn, (void*)(number_t)sock, qbus_engine_shm_inc_onDone);
+    
+    // activate routing
+    qbus_connection_reg (conn->conn);
+  }
+  
+  return CAPE_ERR_NONE;
+
+exit_and_cleanup:
+  
+  if (fds[0] >= 0) close (fds[0]);
+  if (fds[1] >= 0) close (fds[1]);
+  if (fds[2] >= 0) close (fds[2]);
+  if (fds[3] >= 0) close (fds[3]);
+  if (fd_blob >= 0) close (fd_blob);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_inc_onConnect (void* ptr, void* handle, const char* remote_addr)
+{
+  EngineShmInc self = ptr;
+  
+  if (handle == NULL)
+  {
+    return;
+  }
+  
+  cape_log_fmt (CAPE_LL_TRACE, "QBUS", "on connect", "new shm connection on %s", self->file);
+  
+  {
+    CapeErr err = cape_err_new ();
+    
+    if (qbus_engine_shm_inc__handshake (self, (int)(number_t)handle, err))
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "shm connect", "handshake failed: %s", cape_err_text (err));
+      
+      close ((int)(number_t)handle);
+    }
+    
+    cape_err_del (&err);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_inc_onAcceptDone (void* ptr)
+{
+  cape_log_msg (CAPE_LL_TRACE, "QBUS", "on accept done", "stopped listen");
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_shm_inc_listen (EngineShmInc self, CapeErr err)
+{
+  int res;
+  int sock;
+  
+  struct sockaddr_un addr;
+  
+  res = qbus_engine_shm__addr (&addr, self->file, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  // never take the socket file away from a running process
+  res = qbus_engine_shm__stale (&addr, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  sock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  if (bind (sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    
+    close (sock);
+    return res;
+  }
+  
+  self->bound = TRUE;
+  
+  if (listen (sock, SOMAXCONN) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    
+    close (sock);
+    return res;
+  }
+  
+  fcntl (sock, F_SETFL, fcntl (sock, F_GETFL, 0) | O_NONBLOCK);
+  
+  {
+    // create a new acceptor context for the AIO subsystem
+    CapeAioAccept accept_event_handler = cape_aio_accept_new ((void*)(number_t)sock);
+    
+    // set callbacks
+    cape_aio_accept_callback (accept_event_handler, self, qbus_engine_shm_inc_onConnect, qbus_engine_shm_inc_onAcceptDone);
+    
+    // register at AIO
+    cape_aio_accept_add (&accept_event_handler, self->aio);
+  }
+  
+  cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "shm listen", "listen on %s", self->file);
+  
+  return CAPE_ERR_NONE;
+}
+
+//=============================================================================
+
+struct EngineShmOut_s
+{
+  CapeString file;
+  
+  CapeAioContext aio;   // reference
+  
+  QBusRoute route;      // reference
+  
+  QBusBackoff backoff;
+};
+
+//-----------------------------------------------------------------------------
+
+EngineShmOut qbus_engine_shm_out_new (CapeAioContext aio, QBusRoute route, const CapeString path, const CapeString name)
+{
+  EngineShmOut self = CAPE_NEW (struct EngineShmOut_s);
+  
+  self->file = cape_str_fmt ("%s/%s", path, name);
+  
+  self->aio = aio;
+  self->route = route;
+  
+  self->backoff = qbus_backoff_new ();
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_shm_out_del (EngineShmOut* p_self)
+{
+  if (*p_self)
+  {
+    EngineShmOut self = *p_self;
+    
+    qbus_backoff_del (&(self->backoff));
+    cape_str_del (&(self->file));
+    
+    CAPE_DEL(p_self, struct EngineShmOut_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_shm_out_backoff (EngineShmOut self, CapeUdc remote)
+{
+  qbus_backoff_config (self->backoff, remote);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_shm_out_timer__onRetry (void* ptr)
+{
+  CapeErr err = cape_err_new ();
+  
+  qbus_engine_shm_out_reconnect (ptr, err);
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_shm_out_timer_enable (EngineShmOut self)
+{
+  CapeErr err = cape_err_new ();
+  
+  // the backoff drops the attempt if the engine is deleted before the timer fires
+  if (qbus_backoff_schedule (self->backoff, self->aio, self, qbus_engine_shm_out_timer__onRetry, err))
+  {
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "shm reconnect", "can't set timer: %s", cape_err_text (err));
+  }
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_out_onDone (void* ptr, void* userdata)
+{
+  EngineShmConn* conn = ptr;
+  EngineShmOut eout = conn->eout;
+  
+  qbus_engine_shm_conn_del (&conn);
+  
+  // add timer for reconnection
+  qbus_engine_shm_out_timer_enable (eout);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_shm_out__recv (int sock, int* fds, CapeErr err)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  
+  char cbuf[CMSG_SPACE(4 * sizeof(int))];
+  char tag;
+  
+  memset (&msg, 0, sizeof(msg));
+  
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  
+  switch (recvmsg (sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC))
+  {
+    case -1:
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      {
+        // the server has not sent the handles yet
+        return CAPE_ERR_CONTINUE;
+      }
+      
+      return cape_err_lastOSError (err);
+    }
+    case 0:
+    {
+      return cape_err_set (err, CAPE_ERR_EOF, "server closed the connection within the handshake");
+    }
+  }
+  
+  cmsg = CMSG_FIRSTHDR (&msg);
+  
+  if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN (4 * sizeof(int)))
+  {
+    return cape_err_set (err, CAPE_ERR_WRONG_VALUE, "invalid shm handshake");
+  }
+  
+  memcpy (fds, CMSG_DATA (cmsg), 4 * sizeof(int));
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_shm_out__connected (EngineShmOut self, int sock, int* fds, CapeErr err)
+{
+  EngineShmConn* conn;
+  
+  // the handshake handle leaves the event loop, the socket gets a new handle for the watch
+  int sock_watch = dup (sock);
+  
+  if (sock_watch < 0)
+  {
+    int i;
+    
+    for (i = 0; i < 4; i++)
+    {
+      close (fds[i]);
+    }
+    
+    return cape_err_lastOSError (err);
+  }
+  
+  // the server signals on the first handle, we on the second
+  conn = qbus_engine_shm_conn_new (self->aio, self->route, fds[0], fds[2], fds[1], fds[3], FALSE, self, err);
+  
+  if (conn == NULL)
+  {
+    close (sock_watch);
+    return cape_err_code (err);
+  }
+  
+  qbus_engine_shm__watch (conn, (void*)(number_t)sock_watch, qbus_engine_shm_out_onDone);
+  
+  // the handshake succeeded, next time start with an immediate retry
+  qbus_backoff_reset (self->backoff);
+  
+  // activate routing
+  qbus_connection_reg (conn->conn);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  EngineShmOut eout;           // reference
+  
+  int sock;
+  
+  int done;
+  
+} EngineShmHandshake;
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_engine_shm_out__on_handshake (void* ptr, int hflags, unsigned long events, unsigned long param1)
+{
+  EngineShmHandshake* self = ptr;
+  
+  CapeErr err = cape_err_new ();
+  
+  int fds[4];
+  
+  switch (qbus_engine_shm_out__recv (self->sock, fds, err))
+  {
+    case CAPE_ERR_NONE:
+    {
+      self->done = (qbus_engine_shm_out__connected (self->eout, self->sock, fds, err) == CAPE_ERR_NONE);
+      
+      if (!self->done)
+      {
+        cape_log_fmt (CAPE_LL_ERROR, "QBUS", "shm connect", "can't create connection: %s", cape_err_text (err));
+      }
+      
+      hflags = CAPE_AIO_DONE;
+      break;
+    }
+    case CAPE_ERR_CONTINUE:
+    {
+      // wait for the next event
+      break;
+    }
+    default:
+    {
+      cape_log_fmt (CAPE_LL_WARN, "QBUS", "shm connect", "handshake failed: %s", cape_err_text (err));
+      
+      hflags = CAPE_AIO_DONE;
+      break;
+    }
+  }
+  
+  cape_err_del (&err);
+  
+  return hflags;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_shm_out__on_handshake_unref (void* ptr, CapeAioHandle aioh, int force_close)
+{
+  EngineShmHandshake* self = ptr;
+  
+  // the watch uses its own handle
+  close (self->sock);
+  
+  if (!self->done && !force_close)
+  {
+    // try again later
+    qbus_engine_shm_out_timer_enable (self->eout);
+  }
+  
+  cape_aio_handle_del (&aioh);
+  
+  CAPE_DEL (&self, EngineShmHandshake);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_shm_out_reconnect (EngineShmOut self, CapeErr err)
+{
+  int res;
+  int sock;
+  
+  struct sockaddr_un addr;
+  
+  res = qbus_engine_shm__addr (&addr, self->file, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  // never block the event loop, the handshake continues as soon as the server has sent the handles
+  sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  // local sockets connect at once or fail, a full backlog is retried later
+  if (connect (sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    goto exit_and_retry;
+  }
+  
+  {
+    EngineShmHandshake* hs = CAPE_NEW (EngineShmHandshake);
+    
+    CapeAioHandle aioh = cape_aio_handle_new (CAPE_AIO_READ, hs, qbus_engine_shm_out__on_handshake, qbus_engine_shm_out__on_handshake_unref);
+    
+    hs->eout = self;
+    hs->sock = sock;
+    hs->done = FALSE;
+    
+    if (cape_aio_context_add (self->aio, aioh, (void*)(number_t)sock, 0) == FALSE)
+    {
+      res = cape_err_set (err, CAPE_ERR_OS, "can't add handshake socket to the event loop");
+      
+      cape_aio_handle_del (&aioh);
+      CAPE_DEL (&hs, EngineShmHandshake);
+      
+      goto exit_and_retry;
+    }
+  }
+  
+  return CAPE_ERR_NONE;
+
+exit_and_retry:
+  
+  close (sock);
+  
+  // try again later
+  qbus_engine_shm_out_timer_enable (self);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,45 @@
+#ifndef __QBUS__ENGINE__SHM__H
+#define __QBUS__ENGINE__SHM__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_err.h"
+#include "stc/cape_udc.h"
+#include "aio/cape_aio_sock.h"
+
+#include "qbus_route.h"
+
+//-----------------------------------------------------------------------------
+
+// size of each ring, one for every direction
+#define QBUS_ENGINE_SHM_RING_SIZE   1048576
+
+//=============================================================================
+
+struct EngineShmInc_s; typedef struct EngineShmInc_s* EngineShmInc;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   EngineShmInc      qbus_engine_shm_inc_new      (CapeAioContext aio, QBusRoute, const CapeString path, const CapeString name);
+
+__CAPE_LIBEX   void              qbus_engine_shm_inc_del      (EngineShmInc*);
+
+__CAPE_LIBEX   int               qbus_engine_shm_inc_listen   (EngineShmInc, CapeErr err);
+
+//=============================================================================
+
+struct EngineShmOut_s; typedef struct EngineShmOut_s* EngineShmOut;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   EngineShmOut      qbus_engine_shm_out_new      (CapeAioContext aio, QBusRoute, const CapeString path, const CapeString name);
+
+__CAPE_LIBEX   void              qbus_engine_shm_out_del      (EngineShmOut*);
+
+                 // reconnect timing of the remote
+__CAPE_LIBEX   void              qbus_engine_shm_out_backoff  (EngineShmOut, CapeUdc remote);
+
+__CAPE_LIBEX   int               qbus_engine_shm_out_reconnect  (EngineShmOut, CapeErr);
+
+//-----------------------------------------------------------------------------
+
+#endif
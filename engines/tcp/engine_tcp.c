@@ -2,11 +2,24 @@
 
 // cape includes
 #include "sys/cape_socket.h"
-#include "aio/cape_aio_timer.h"
+#include "sys/cape_thread.h"
 #include "sys/cape_log.h"
+#include "sys/cape_mutex.h"
+#include "stc/cape_list.h"
+
+// c includes
+#if defined __LINUX_OS || defined __BSD_OS
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#endif
 
 // qbus core
 #include "qbus_core.h"
+#include "qbus_backoff.h"
+#include "qbus_blob.h"
+#include "qbus_socket.h"
 
 //-----------------------------------------------------------------------------
 
@@ -24,20 +37,301 @@ void __STDCALL qbus_engine_tcp_mark (void* ptr1, void* ptr2)
 
 //-----------------------------------------------------------------------------
 
+void __STDCALL qbus_engine_tcp_close (void* ptr1, void* ptr2)
+{
+  cape_aio_socket_close (ptr2, ptr1);
+}
+
+//-----------------------------------------------------------------------------
+
+number_t __STDCALL qbus_engine_tcp_blob (void* ptr, int fd, number_t offset, number_t size)
+{
+  // the content goes from the page cache directly into the socket
+  return qbus_blob_send ((int)(number_t)ptr, fd, offset, size);
+}
+
+//-----------------------------------------------------------------------------
+
 struct EngineTcpInc_s
 {
   CapeString host;
   
   number_t port;
   
-  CapeAioContext aio;   // reference
+  CapeAioContext aio;   // reference, owned by shards
   
   QBusRoute route;      // reference
   
+  QBusSocketOptions options;
+  
+  // sharded mode
+  
+  CapeList shards;      // each shard has its own listener, AIO context and thread
+  
+  CapeThread thread;    // only for shards
+  
+  CapeMutex mutex;      // only for shards, protects the requests
+  
+  CapeList requests;    // connections which other threads want to mark or close
+  
+  int fd_signal[2];     // wakes up the loop of the shard for the requests
+  
 };
 
 //-----------------------------------------------------------------------------
 
+#define QBUS_ENGINE_TCP_REQ_MARK      0x01
+#define QBUS_ENGINE_TCP_REQ_CLOSE     0x02
+
+// a connection of a shard, its socket is only touched by the loop of the shard
+typedef struct
+{
+  EngineTcpInc shard;   // reference
+  
+  QBusConnection conn;
+  
+  CapeAioSocket sock;   // reference, valid until done
+  
+  int refcnt;           // the socket and a queued request
+  
+  int requests;         // protected by the mutex of the shard
+  
+  int done;             // only used by the loop of the shard
+  
+} EngineTcpIncConn;
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_tcp_inc_conn__dec (EngineTcpIncConn** p_self)
+{
+  EngineTcpIncConn* self = *p_self;
+  
+  *p_self = NULL;
+  
+  if (__atomic_sub_fetch (&(self->refcnt), 1, __ATOMIC_ACQ_REL))
+  {
+    return;
+  }
+  
+  CAPE_DEL (&self, EngineTcpIncConn);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_tcp_inc_conn__request (EngineTcpIncConn* self, int request)
+{
+  EngineTcpInc shard = self->shard;
+  
+  int wakeup = FALSE;
+  
+  cape_mutex_lock (shard->mutex);
+  
+  if (self->requests == 0)
+  {
+    // the queue holds a reference until the loop has processed the request
+    __atomic_add_fetch (&(self->refcnt), 1, __ATOMIC_RELAXED);
+    
+    wakeup = (cape_list_size (shard->requests) == 0);
+    
+    cape_list_push_back (shard->requests, self);
+  }
+  
+  self->requests |= request;
+  
+  cape_mutex_unlock (shard->mutex);
+  
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  if (wakeup)
+  {
+    char c = 1;
+    
+    // the pipe is non blocking, if it is full the loop wakes up anyway
+    if (write (shard->fd_signal[1], &c, 1) < 0 && errno != EAGAIN)
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "tcp shard", "can't wake up the shard: %s", strerror (errno));
+    }
+  }
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__mark (void* ptr1, void* ptr2)
+{
+  // might be called from any thread, the socket belongs to the loop of the shard
+  qbus_engine_tcp_inc_conn__request (ptr1, QBUS_ENGINE_TCP_REQ_MARK);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__close (void* ptr1, void* ptr2)
+{
+  qbus_engine_tcp_inc_conn__request (ptr1, QBUS_ENGINE_TCP_REQ_CLOSE);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__send (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata)
+{
+  EngineTcpIncConn* self = ptr1;
+  
+  // only called by the loop of the shard, when the socket is writable
+  cape_aio_socket_send (self->sock, self->shard->aio, bufdat, buflen, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__onSent (void* ptr, CapeAioSocket socket, void* userdata)
+{
+  EngineTcpIncConn* self = ptr;
+  
+  qbus_connection_onSent (self->conn, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__onRecv (void* ptr, CapeAioSocket socket, const char* bufdat, number_t buflen)
+{
+  EngineTcpIncConn* self = ptr;
+  
+  qbus_connection_onRecv (self->conn, bufdat, buflen);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc_conn__onDone (void* ptr, void* userdata)
+{
+  EngineTcpIncConn* self = ptr;
+  
+  // waits until other threads have queued their requests
+  qbus_connection_del (&(self->conn));
+  
+  // queued requests are dropped by the loop
+  self->done = TRUE;
+  self->sock = NULL;
+  
+  qbus_engine_tcp_inc_conn__dec (&self);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_tcp_inc__requests_run (EngineTcpInc self)
+{
+  EngineTcpIncConn* conn;
+  
+  cape_mutex_lock (self->mutex);
+  
+  while ((conn = cape_list_pop_front (self->requests)))
+  {
+    int requests = conn->requests;
+    
+    conn->requests = 0;
+    
+    cape_mutex_unlock (self->mutex);
+    
+    if (!conn->done)
+    {
+      if (requests & QBUS_ENGINE_TCP_REQ_CLOSE)
+      {
+        cape_aio_socket_close (conn->sock, self->aio);
+      }
+      else
+      {
+        cape_aio_socket_markSent (conn->sock, self->aio);
+      }
+    }
+    
+    qbus_engine_tcp_inc_conn__dec (&conn);
+    
+    cape_mutex_lock (self->mutex);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_tcp_inc__requests_clr (EngineTcpInc self)
+{
+  EngineTcpIncConn* conn;
+  
+  // the loop has ended, all sockets are closed
+  while ((conn = cape_list_pop_front (self->requests)))
+  {
+    qbus_engine_tcp_inc_conn__dec (&conn);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_engine_tcp_inc__signal_onEvent (void* ptr, int hflags, unsigned long events, unsigned long param1)
+{
+  EngineTcpInc self = ptr;
+  
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  char buf[64];
+  
+  // the pipe is non blocking, empty it
+  while (read (self->fd_signal[0], buf, sizeof(buf)) > 0)
+  {
+  }
+  
+#endif
+  
+  qbus_engine_tcp_inc__requests_run (self);
+  
+  return hflags;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc__signal_onUnref (void* ptr, CapeAioHandle aioh, int force_close)
+{
+  cape_aio_handle_del (&aioh);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_tcp_inc__signal_init (EngineTcpInc self, CapeErr err)
+{
+#if defined __LINUX_OS || defined __BSD_OS
+  
+  CapeAioHandle aioh;
+  
+  if (pipe (self->fd_signal) < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  fcntl (self->fd_signal[0], F_SETFL, fcntl (self->fd_signal[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl (self->fd_signal[1], F_SETFL, fcntl (self->fd_signal[1], F_GETFL, 0) | O_NONBLOCK);
+  
+  self->mutex = cape_mutex_new ();
+  self->requests = cape_list_new (NULL);
+  
+  aioh = cape_aio_handle_new (CAPE_AIO_READ, self, qbus_engine_tcp_inc__signal_onEvent, qbus_engine_tcp_inc__signal_onUnref);
+  
+  if (cape_aio_context_add (self->aio, aioh, (void*)(number_t)self->fd_signal[0], 0) == FALSE)
+  {
+    cape_aio_handle_del (&aioh);
+    
+    return cape_err_set (err, CAPE_ERR_RUNTIME, "can't add the shard signal to the event loop");
+  }
+  
+  return CAPE_ERR_NONE;
+  
+#else
+  
+  return cape_err_set (err, CAPE_ERR_NOT_SUPPORTED, "shards are not supported on this platform");
+  
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
 EngineTcpInc qbus_engine_tcp_inc_new (CapeAioContext aio, QBusRoute route, const CapeString host, number_t port)
 {
   EngineTcpInc self = CAPE_NEW (struct EngineTcpInc_s);
@@ -47,6 +341,17 @@ EngineTcpInc qbus_engine_tcp_inc_new (CapeAioContext aio, QBusRoute route, const
 
   self->aio = aio;
   self->route = route;
+  
+  self->shards = NULL;
+  self->thread = NULL;
+  
+  self->mutex = NULL;
+  self->requests = NULL;
+  
+  self->fd_signal[0] = -1;
+  self->fd_signal[1] = -1;
+  
+  qbus_socket_options_init (&(self->options));
     
   return self;
 }
@@ -61,12 +366,50 @@ void qbus_engine_tcp_inc_del (EngineTcpInc* p_self)
     
     cape_str_del (&(self->host));
     
+    if (self->shards)
+    {
+      // stops and joins all shards
+      cape_list_del (&(self->shards));
+    }
+    
+    if (self->thread)
+    {
+      // wake up the shard thread
+      cape_aio_context_close (self->aio, NULL);
+      
+      cape_thread_join (self->thread);
+      cape_thread_del (&(self->thread));
+    }
+    
+    if (self->mutex)
+    {
+      // closes all connections of the shard, the requests stay valid until then
+      cape_aio_context_del (&(self->aio));
+      
+      qbus_engine_tcp_inc__requests_clr (self);
+      
+      cape_list_del (&(self->requests));
+      cape_mutex_del (&(self->mutex));
+      
+#if defined __LINUX_OS || defined __BSD_OS
+      close (self->fd_signal[0]);
+      close (self->fd_signal[1]);
+#endif
+    }
+    
     CAPE_DEL(p_self, struct EngineTcpInc_s);
   }  
 }
 
 //-----------------------------------------------------------------------------
 
+void qbus_engine_tcp_inc_options (EngineTcpInc self, CapeUdc bind)
+{
+  qbus_socket_options_read (&(self->options), bind);
+}
+
+//-----------------------------------------------------------------------------
+
 static void __STDCALL qbus_engine_tcp_inc_onSent (void* ptr, CapeAioSocket socket, void* userdata)
 {
   qbus_connection_onSent (ptr, userdata);
@@ -90,6 +433,41 @@ static void __STDCALL qbus_engine_tcp_inc_onDone (void* ptr, void* userdata)
 
 //-----------------------------------------------------------------------------
 
+static void qbus_engine_tcp_inc__shard_connect (EngineTcpInc self, void* handle)
+{
+  EngineTcpIncConn* conn = CAPE_NEW (EngineTcpIncConn);
+  
+  conn->shard = self;
+  conn->conn = qbus_connection_new (self->route, 0);
+  conn->sock = cape_aio_socket_new (handle);
+  
+  // released by onDone
+  conn->refcnt = 1;
+  conn->requests = 0;
+  conn->done = FALSE;
+  
+  qbus_socket_options_apply (&(self->options), handle);
+  
+  // marks and closes of other threads are handed over to the loop of the shard
+  qbus_connection_cb (conn->conn, conn, NULL, qbus_engine_tcp_inc_conn__send, qbus_engine_tcp_inc_conn__mark);
+  qbus_connection_cb_close (conn->conn, qbus_engine_tcp_inc_conn__close);
+  qbus_connection_cb_blob (conn->conn, handle, qbus_engine_tcp_blob, NULL);
+  
+  cape_aio_socket_callback (conn->sock, conn, qbus_engine_tcp_inc_conn__onSent, qbus_engine_tcp_inc_conn__onRecv, qbus_engine_tcp_inc_conn__onDone);
+  
+  {
+    // the listen call takes the pointer, the connection keeps a reference
+    CapeAioSocket sock = conn->sock;
+    
+    cape_aio_socket_listen (&sock, self->aio);
+  }
+  
+  // activate routing
+  qbus_connection_reg (conn->conn);
+}
+
+//-----------------------------------------------------------------------------
+
 static void __STDCALL qbus_engine_tcp_inc_onConnect (void* ptr, void* handle, const char* remote_addr)
 {
   EngineTcpInc self = ptr;
@@ -101,16 +479,26 @@ static void __STDCALL qbus_engine_tcp_inc_onConnect (void* ptr, void* handle, co
     return;
   }
 
+  if (self->mutex)
+  {
+    qbus_engine_tcp_inc__shard_connect (self, handle);
+    return;
+  }
+  
   // handle new connection
   {
     // create a new core connection for routing
     QBusConnection qbus_connection = qbus_connection_new (self->route, 0);
+    
+    qbus_socket_options_apply (&(self->options), handle);
 
     // create a new handler for the created socket
     CapeAioSocket sock = cape_aio_socket_new (handle);
     
     // set qbus connection callbacks
     qbus_connection_cb (qbus_connection, self->aio, sock, qbus_engine_tcp_send, qbus_engine_tcp_mark);
+    qbus_connection_cb_close (qbus_connection, qbus_engine_tcp_close);
+    qbus_connection_cb_blob (qbus_connection, handle, qbus_engine_tcp_blob, NULL);
     
     // set callback
     cape_aio_socket_callback (sock, qbus_connection, qbus_engine_tcp_inc_onSent, qbus_engine_tcp_inc_onRecv, qbus_engine_tcp_inc_onDone);
@@ -132,27 +520,150 @@ static void __STDCALL qbus_engine_tcp_inc_onAcceptDone (void* ptr)
 
 //-----------------------------------------------------------------------------
 
+void qbus_engine_tcp_inc__accept (EngineTcpInc self, void* socket_handle)
+{
+  {
+    // create a new acceptor context for the AIO subsystem
+    CapeAioAccept accept_event_handler = cape_aio_accept_new (socket_handle);
+    
+    // set callbacks
+    cape_aio_accept_callback (accept_event_handler, self, qbus_engine_tcp_inc_onConnect, qbus_engine_tcp_inc_onAcceptDone);
+    
+    // register at AIO
+    cape_aio_accept_add (&accept_event_handler, self->aio);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_engine_tcp_inc_listen (EngineTcpInc self, CapeErr err)
 {
-  void* socket_handle = cape_sock__tcp__srv_new (self->host, self->port, err);
+  // the options must be set before listen, accepted sockets inherit them
+  void* socket_handle = qbus_socket_srv_new (self->host, self->port, &(self->options), FALSE, err);
   
   if (socket_handle == NULL)
   {
     return cape_err_code (err);
   }
   
+  qbus_engine_tcp_inc__accept (self, socket_handle);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_engine_tcp_inc__shard_worker (void* ptr)
+{
+  EngineTcpInc shard = ptr;
+  
+  CapeErr err = cape_err_new ();
+  
+  int res = cape_aio_context_wait (shard->aio, err);
+  if (res)
   {
-    // create a new acceptor context for the AIO subsystem
-    CapeAioAccept accept_event_handler = cape_aio_accept_new (socket_handle);
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "tcp shard", "event loop ended: %s", cape_err_text (err));
+  }
+  
+  cape_err_del (&err);
+  
+  // don't run again
+  return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_tcp_inc__shards_del (void* ptr)
+{
+  EngineTcpInc shard = ptr;
+  
+  qbus_engine_tcp_inc_del (&shard);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_tcp_inc__shard_abort (EngineTcpInc* p_shard)
+{
+  EngineTcpInc shard = *p_shard;
+  
+  if (shard->mutex == NULL)
+  {
+    // the context is only released together with the requests
+    cape_aio_context_del (&(shard->aio));
+  }
+  
+  // the shard thread was not started yet
+  qbus_engine_tcp_inc_del (p_shard);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_tcp_inc_listen_sharded (EngineTcpInc self, number_t shards, CapeErr err)
+{
+  int res;
+  number_t i;
+  
+  if (self->shards == NULL)
+  {
+    self->shards = cape_list_new (qbus_engine_tcp_inc__shards_del);
+  }
+  
+  for (i = 0; i < shards; i++)
+  {
+    void* socket_handle;
     
-    // set callbacks
-    cape_aio_accept_callback (accept_event_handler, self, qbus_engine_tcp_inc_onConnect, qbus_engine_tcp_inc_onAcceptDone);
+    // a shard is an engine with its own AIO context, sharing the route
+    EngineTcpInc shard = qbus_engine_tcp_inc_new (cape_aio_context_new (), self->route, self->host, self->port);
     
-    // register at AIO
-    cape_aio_accept_add (&accept_event_handler, self->aio);
+    shard->options = self->options;
+    
+    res = cape_aio_context_open (shard->aio, err);
+    if (res)
+    {
+      cape_aio_context_del (&(shard->aio));
+      qbus_engine_tcp_inc_del (&shard);
+      
+      goto exit_and_cleanup;
+    }
+    
+    res = qbus_engine_tcp_inc__signal_init (shard, err);
+    if (res)
+    {
+      qbus_engine_tcp_inc__shard_abort (&shard);
+      
+      goto exit_and_cleanup;
+    }
+    
+    socket_handle = qbus_socket_srv_new (self->host, self->port, &(self->options), TRUE, err);
+    if (socket_handle == NULL)
+    {
+      res = cape_err_code (err);
+      
+      qbus_engine_tcp_inc__shard_abort (&shard);
+      
+      goto exit_and_cleanup;
+    }
+    
+    qbus_engine_tcp_inc__accept (shard, socket_handle);
+    
+    // run the accept loop and all connections of this shard in its own thread
+    shard->thread = cape_thread_new ();
+    
+    cape_thread_start (shard->thread, qbus_engine_tcp_inc__shard_worker, shard);
+    
+    cape_list_push_back (self->shards, shard);
   }
   
+  cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "tcp listen", "listen on %s:%li with %li shards", self->host, self->port, shards);
+  
   return CAPE_ERR_NONE;
+  
+exit_and_cleanup:
+  
+  // don't leave a part of the shards running, stops and joins them
+  cape_list_del (&(self->shards));
+  
+  return res;
 }
 
 //=============================================================================
@@ -166,6 +677,10 @@ struct EngineTcpOut_s
   CapeAioContext aio;   // reference
   
   QBusRoute route;      // reference
+  
+  QBusBackoff backoff;
+  
+  QBusSocketOptions options;
 };
 
 //-----------------------------------------------------------------------------
@@ -180,6 +695,10 @@ EngineTcpOut qbus_engine_tcp_out_new (CapeAioContext aio, QBusRoute route, const
   self->aio = aio;
   self->route = route;
   
+  self->backoff = qbus_backoff_new ();
+  
+  qbus_socket_options_init (&(self->options));
+  
   return self;
 }
 
@@ -191,6 +710,7 @@ void qbus_engine_tcp_out_del (EngineTcpOut* p_self)
   {
     EngineTcpOut self = *p_self;
     
+    qbus_backoff_del (&(self->backoff));
     cape_str_del (&(self->host));
     
     CAPE_DEL(p_self, struct EngineTcpOut_s);
@@ -199,37 +719,39 @@ void qbus_engine_tcp_out_del (EngineTcpOut* p_self)
 
 //-----------------------------------------------------------------------------
 
-int __STDCALL qbus_engine_tcp_out_timer__onTimer (void* ptr)
+void qbus_engine_tcp_out_backoff (EngineTcpOut self, CapeUdc remote)
 {
-  CapeErr err = cape_err_new ();
-
-  qbus_engine_tcp_out_reconnect (ptr, err);
+  qbus_backoff_config (self->backoff, remote);
+}
 
-  cape_err_del (&err);
+//-----------------------------------------------------------------------------
 
-  // remove the timer
-  return FALSE;
+void qbus_engine_tcp_out_options (EngineTcpOut self, CapeUdc remote)
+{
+  qbus_socket_options_read (&(self->options), remote);
 }
 
 //-----------------------------------------------------------------------------
 
-void qbus_engine_tcp_out_timer_enable (EngineTcpOut self)
+void __STDCALL qbus_engine_tcp_out_timer__onRetry (void* ptr)
 {
-  int res;
   CapeErr err = cape_err_new ();
   
-  CapeAioTimer timer = cape_aio_timer_new ();
+  qbus_engine_tcp_out_reconnect (ptr, err);
   
-  res = cape_aio_timer_set (timer, 10000, self, qbus_engine_tcp_out_timer__onTimer, err);   // create timer with 10 seconds
-  if (res)
-  {
-    // throw std::runtime_error (cape_err_text (err));
-  }
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_tcp_out_timer_enable (EngineTcpOut self)
+{
+  CapeErr err = cape_err_new ();
   
-  res = cape_aio_timer_add (&timer, self->aio);
-  if (res)
+  // the backoff drops the attempt if the engine is deleted before the timer fires
+  if (qbus_backoff_schedule (self->backoff, self->aio, self, qbus_engine_tcp_out_timer__onRetry, err))
   {
-    // throw std::runtime_error (cape_err_text (err));
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "tcp reconnect", "can't set timer: %s", cape_err_text (err));
   }
   
   cape_err_del (&err);
@@ -259,6 +781,9 @@ void __STDCALL qbus_engine_tcp_out_onSent (void* ptr, CapeAioSocket socket, void
 void __STDCALL qbus_engine_tcp_out_onRecv (void* ptr, CapeAioSocket socket, const char* bufdat, number_t buflen)
 {
   QBusEngineTcpOutCtx* ctx = ptr;
+  
+  // the remote answers, next time start with an immediate retry
+  qbus_backoff_reset (ctx->eout->backoff);
 
   qbus_connection_onRecv (ctx->conn, bufdat, buflen);
 }
@@ -282,9 +807,13 @@ void __STDCALL qbus_engine_tcp_out_onDone (void* ptr, void* userdata)
 
 int qbus_engine_tcp_out_reconnect (EngineTcpOut self, CapeErr err)
 {
-  void* sock = cape_sock__tcp__clt_new (self->host, self->port, err);
+  // the options are set before connect
+  void* sock = qbus_socket_clt_new (self->host, self->port, &(self->options), err);
   if (sock == NULL)
   {
+    // try again later
+    qbus_engine_tcp_out_timer_enable (self);
+    
     return cape_err_code (err);
   }
   
@@ -308,6 +837,8 @@ int qbus_engine_tcp_out_reconnect (EngineTcpOut self, CapeErr err)
     
     // set qbus connection callbacks
     qbus_connection_cb (qbus_connection, self->aio, s, qbus_engine_tcp_send, qbus_engine_tcp_mark);
+    qbus_connection_cb_close (qbus_connection, qbus_engine_tcp_close);
+    qbus_connection_cb_blob (qbus_connection, sock, qbus_engine_tcp_blob, NULL);
     
     cape_aio_socket_listen (&s, self->aio);
 
@@ -18,8 +18,14 @@ __CAPE_LIBEX   EngineTcpInc      qbus_engine_tcp_inc_new      (CapeAioContext ai
 
 __CAPE_LIBEX   void              qbus_engine_tcp_inc_del      (EngineTcpInc*);
 
+                 // socket options of the 'tcp' node: nodelay, sndbuf, rcvbuf, keepalive, keepalive_interval, keepalive_count, user_timeout, backlog
+__CAPE_LIBEX   void              qbus_engine_tcp_inc_options  (EngineTcpInc, CapeUdc bind);
+
 __CAPE_LIBEX   int               qbus_engine_tcp_inc_listen   (EngineTcpInc, CapeErr err);
 
+                 // opens one SO_REUSEPORT listener per shard, each with its own thread and AIO context
+__CAPE_LIBEX   int               qbus_engine_tcp_inc_listen_sharded  (EngineTcpInc, number_t shards, CapeErr err);
+
 //=============================================================================
 
 struct EngineTcpOut_s; typedef struct EngineTcpOut_s* EngineTcpOut;
@@ -30,6 +36,12 @@ __CAPE_LIBEX   EngineTcpOut      qbus_engine_tcp_out_new      (CapeAioContext ai
 
 __CAPE_LIBEX   void              qbus_engine_tcp_out_del      (EngineTcpOut*);
 
+                 // reconnect timing of the remote
+__CAPE_LIBEX   void              qbus_engine_tcp_out_backoff  (EngineTcpOut, CapeUdc remote);
+
+                 // socket options of the 'tcp' node, same as for incoming connections
+__CAPE_LIBEX   void              qbus_engine_tcp_out_options  (EngineTcpOut, CapeUdc remote);
+
 __CAPE_LIBEX   int             qbus_engine_tcp_out_reconnect  (EngineTcpOut, CapeErr);
 
 //-----------------------------------------------------------------------------
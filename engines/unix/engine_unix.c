@@ -0,0 +1,470 @@
+#include "engine_unix.h"
+
+// cape includes
+#include "sys/cape_log.h"
+
+// qbus core
+#include "qbus_core.h"
+#include "qbus_backoff.h"
+#include "qbus_blob.h"
+
+// c includes
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_send (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata)
+{
+  cape_aio_socket_send (ptr2, ptr1, bufdat, buflen, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_mark (void* ptr1, void* ptr2)
+{
+  cape_aio_socket_markSent (ptr2, ptr1);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_close (void* ptr1, void* ptr2)
+{
+  cape_aio_socket_close (ptr2, ptr1);
+}
+
+//-----------------------------------------------------------------------------
+
+number_t __STDCALL qbus_engine_unix_blob (void* ptr, int fd, number_t offset, number_t size)
+{
+  // the AIO socket reads without ancillary data, the content is spliced into the stream
+  return qbus_blob_send ((int)(number_t)ptr, fd, offset, size);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_unix__addr (struct sockaddr_un* addr, const CapeString file, CapeErr err)
+{
+  memset (addr, 0, sizeof(struct sockaddr_un));
+  
+  addr->sun_family = AF_UNIX;
+  
+  if (strlen (file) >= sizeof(addr->sun_path))
+  {
+    return cape_err_set_fmt (err, CAPE_ERR_WRONG_VALUE, "socket path is too long: %s", file);
+  }
+  
+  strcpy (addr->sun_path, file);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_unix__nonblocking (int sock)
+{
+  fcntl (sock, F_SETFL, fcntl (sock, F_GETFL, 0) | O_NONBLOCK);
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_engine_unix__stale (struct sockaddr_un* addr, CapeErr err)
+{
+  int res = CAPE_ERR_NONE;
+  
+  int sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  if (connect (sock, (struct sockaddr*)addr, sizeof(struct sockaddr_un)) == 0 || errno == EAGAIN)
+  {
+    // another process still accepts connections on the socket
+    res = cape_err_set_fmt (err, CAPE_ERR_WRONG_STATE, "socket is in use: %s", addr->sun_path);
+  }
+  else if (errno == ECONNREFUSED)
+  {
+    // nobody listens anymore, remove the socket file of a previous run
+    unlink (addr->sun_path);
+  }
+  
+  close (sock);
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+struct EngineUnixInc_s
+{
+  CapeString file;
+  
+  int bound;            // the socket file was created by us
+  
+  CapeAioContext aio;   // reference
+  
+  QBusRoute route;      // reference
+  
+};
+
+//-----------------------------------------------------------------------------
+
+EngineUnixInc qbus_engine_unix_inc_new (CapeAioContext aio, QBusRoute route, const CapeString path, const CapeString name)
+{
+  EngineUnixInc self = CAPE_NEW (struct EngineUnixInc_s);
+  
+  self->file = cape_str_fmt ("%s/%s", path, name);
+  self->bound = FALSE;
+  
+  self->aio = aio;
+  self->route = route;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_unix_inc_del (EngineUnixInc* p_self)
+{
+  if (*p_self)
+  {
+    EngineUnixInc self = *p_self;
+    
+    if (self->bound)
+    {
+      // remove the socket file, only if it is ours
+      unlink (self->file);
+    }
+    
+    cape_str_del (&(self->file));
+    
+    CAPE_DEL(p_self, struct EngineUnixInc_s);
+  }  
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_unix_inc_onSent (void* ptr, CapeAioSocket socket, void* userdata)
+{
+  qbus_connection_onSent (ptr, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_unix_inc_onRecv (void* ptr, CapeAioSocket socket, const char* bufdat, number_t buflen)
+{
+  qbus_connection_onRecv (ptr, bufdat, buflen);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_unix_inc_onDone (void* ptr, void* userdata)
+{
+  QBusConnection qbus_connection = ptr;
+  
+  qbus_connection_del (&qbus_connection);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_unix_inc_onConnect (void* ptr, void* handle, const char* remote_addr)
+{
+  EngineUnixInc self = ptr;
+  
+  cape_log_fmt (CAPE_LL_TRACE, "QBUS", "on connect", "new connection on %s", self->file);
+  
+  if (handle == NULL)
+  {
+    return;
+  }
+
+  // handle new connection
+  {
+    // create a new core connection for routing
+    QBusConnection qbus_connection = qbus_connection_new (self->route, 0);
+
+    // create a new handler for the created socket
+    CapeAioSocket sock = cape_aio_socket_new (handle);
+    
+    // set qbus connection callbacks
+    qbus_connection_cb (qbus_connection, self->aio, sock, qbus_engine_unix_send, qbus_engine_unix_mark);
+    qbus_connection_cb_close (qbus_connection, qbus_engine_unix_close);
+    qbus_connection_cb_blob (qbus_connection, handle, qbus_engine_unix_blob, NULL);
+    
+    // set callback
+    cape_aio_socket_callback (sock, qbus_connection, qbus_engine_unix_inc_onSent, qbus_engine_unix_inc_onRecv, qbus_engine_unix_inc_onDone);
+        
+    // listen on the connection  
+    cape_aio_socket_listen (&sock, self->aio);
+
+    // activate routing
+    qbus_connection_reg (qbus_connection);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_unix_inc_onAcceptDone (void* ptr)
+{
+  cape_log_msg (CAPE_LL_TRACE, "QBUS", "on accept done", "stopped listen");
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_unix_inc_listen (EngineUnixInc self, CapeErr err)
+{
+  int res;
+  int sock;
+  
+  struct sockaddr_un addr;
+  
+  res = qbus_engine_unix__addr (&addr, self->file, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  // never take the socket file away from a running process
+  res = qbus_engine_unix__stale (&addr, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  sock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  if (bind (sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    
+    close (sock);
+    return res;
+  }
+  
+  self->bound = TRUE;
+  
+  if (listen (sock, SOMAXCONN) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    
+    close (sock);
+    return res;
+  }
+  
+  qbus_engine_unix__nonblocking (sock);
+  
+  {
+    // create a new acceptor context for the AIO subsystem
+    CapeAioAccept accept_event_handler = cape_aio_accept_new ((void*)(number_t)sock);
+    
+    // set callbacks
+    cape_aio_accept_callback (accept_event_handler, self, qbus_engine_unix_inc_onConnect, qbus_engine_unix_inc_onAcceptDone);
+    
+    // register at AIO
+    cape_aio_accept_add (&accept_event_handler, self->aio);
+  }
+  
+  cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "unix listen", "listen on %s", self->file);
+  
+  return CAPE_ERR_NONE;
+}
+
+//=============================================================================
+
+struct EngineUnixOut_s
+{
+  CapeString file;
+  
+  CapeAioContext aio;   // reference
+  
+  QBusRoute route;      // reference
+  
+  QBusBackoff backoff;
+};
+
+//-----------------------------------------------------------------------------
+
+EngineUnixOut qbus_engine_unix_out_new (CapeAioContext aio, QBusRoute route, const CapeString path, const CapeString name)
+{
+  EngineUnixOut self = CAPE_NEW (struct EngineUnixOut_s);
+  
+  self->file = cape_str_fmt ("%s/%s", path, name);
+  
+  self->aio = aio;
+  self->route = route;
+  
+  self->backoff = qbus_backoff_new ();
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_unix_out_del (EngineUnixOut* p_self)
+{
+  if (*p_self)
+  {
+    EngineUnixOut self = *p_self;
+    
+    qbus_backoff_del (&(self->backoff));
+    cape_str_del (&(self->file));
+    
+    CAPE_DEL(p_self, struct EngineUnixOut_s);
+  }  
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_unix_out_backoff (EngineUnixOut self, CapeUdc remote)
+{
+  qbus_backoff_config (self->backoff, remote);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_out_timer__onRetry (void* ptr)
+{
+  CapeErr err = cape_err_new ();
+  
+  qbus_engine_unix_out_reconnect (ptr, err);
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_unix_out_timer_enable (EngineUnixOut self)
+{
+  CapeErr err = cape_err_new ();
+  
+  // the backoff drops the attempt if the engine is deleted before the timer fires
+  if (qbus_backoff_schedule (self->backoff, self->aio, self, qbus_engine_unix_out_timer__onRetry, err))
+  {
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "unix reconnect", "can't set timer: %s", cape_err_text (err));
+  }
+  
+  cape_err_del (&err);
+}
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  QBusConnection conn;
+  
+  EngineUnixOut eout;
+  
+} QBusEngineUnixOutCtx;
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_out_onSent (void* ptr, CapeAioSocket socket, void* userdata)
+{
+  QBusEngineUnixOutCtx* ctx = ptr;
+  
+  qbus_connection_onSent (ctx->conn, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_out_onRecv (void* ptr, CapeAioSocket socket, const char* bufdat, number_t buflen)
+{
+  QBusEngineUnixOutCtx* ctx = ptr;
+  
+  // the remote answers, next time start with an immediate retry
+  qbus_backoff_reset (ctx->eout->backoff);
+
+  qbus_connection_onRecv (ctx->conn, bufdat, buflen);
+}
+
+//-----------------------------------------------------------------------------
+
+void __STDCALL qbus_engine_unix_out_onDone (void* ptr, void* userdata)
+{
+  QBusEngineUnixOutCtx* ctx = ptr;
+
+  qbus_connection_del (&(ctx->conn));
+
+  // add timer for reconnection
+  qbus_engine_unix_out_timer_enable (ctx->eout);
+  
+  // we can cleanup the context
+  CAPE_DEL (&ctx, QBusEngineUnixOutCtx);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_unix_out_reconnect (EngineUnixOut self, CapeErr err)
+{
+  int res;
+  int sock;
+  
+  struct sockaddr_un addr;
+  
+  res = qbus_engine_unix__addr (&addr, self->file, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  // never block the event loop
+  sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  // local sockets connect at once or fail, a full backlog is retried later
+  if (connect (sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+  {
+    res = cape_err_lastOSError (err);
+    
+    close (sock);
+    
+    // try again later
+    qbus_engine_unix_out_timer_enable (self);
+    
+    return res;
+  }
+  
+  // handle new connection
+  {
+    // create a new core connection for routing
+    QBusConnection qbus_connection = qbus_connection_new (self->route, 0);
+    
+    CapeAioSocket s = cape_aio_socket_new ((void*)(number_t)sock);
+    
+    {
+      QBusEngineUnixOutCtx* ctx = CAPE_NEW(QBusEngineUnixOutCtx);
+      
+      ctx->conn = qbus_connection;
+      ctx->eout = self;
+      
+      cape_aio_socket_callback (s, ctx, qbus_engine_unix_out_onSent, qbus_engine_unix_out_onRecv, qbus_engine_unix_out_onDone);
+    }    
+    
+    // set qbus connection callbacks
+    qbus_connection_cb (qbus_connection, self->aio, s, qbus_engine_unix_send, qbus_engine_unix_mark);
+    qbus_connection_cb_close (qbus_connection, qbus_engine_unix_close);
+    qbus_connection_cb_blob (qbus_connection, (void*)(number_t)sock, qbus_engine_unix_blob, NULL);
+    
+    cape_aio_socket_listen (&s, self->aio);
+
+    // activate routing
+    qbus_connection_reg (qbus_connection);
+  }
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
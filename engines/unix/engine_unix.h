@@ -0,0 +1,40 @@
+#ifndef __QBUS__ENGINE__UNIX__H
+#define __QBUS__ENGINE__UNIX__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_err.h"
+#include "stc/cape_udc.h"
+#include "aio/cape_aio_sock.h"
+
+#include "qbus_route.h"
+
+//=============================================================================
+
+struct EngineUnixInc_s; typedef struct EngineUnixInc_s* EngineUnixInc;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   EngineUnixInc     qbus_engine_unix_inc_new     (CapeAioContext aio, QBusRoute, const CapeString path, const CapeString name);
+
+__CAPE_LIBEX   void              qbus_engine_unix_inc_del     (EngineUnixInc*);
+
+__CAPE_LIBEX   int               qbus_engine_unix_inc_listen  (EngineUnixInc, CapeErr err);
+
+//=============================================================================
+
+struct EngineUnixOut_s; typedef struct EngineUnixOut_s* EngineUnixOut;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   EngineUnixOut     qbus_engine_unix_out_new     (CapeAioContext aio, QBusRoute, const CapeString path, const CapeString name);
+
+__CAPE_LIBEX   void              qbus_engine_unix_out_del     (EngineUnixOut*);
+
+                 // reconnect timing of the remote
+__CAPE_LIBEX   void              qbus_engine_unix_out_backoff (EngineUnixOut, CapeUdc remote);
+
+__CAPE_LIBEX   int               qbus_engine_unix_out_reconnect  (EngineUnixOut, CapeErr);
+
+//-----------------------------------------------------------------------------
+
+#endif
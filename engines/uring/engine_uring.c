@@ -0,0 +1,1064 @@
+#include "engine_uring.h"
+
+// cape includes
+#include "sys/cape_mutex.h"
+#include "sys/cape_log.h"
+#include "aio/cape_aio_ctx.h"
+
+// qbus core
+#include "qbus_core.h"
+#include "qbus_backoff.h"
+#include "qbus_socket.h"
+
+// c includes
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+//-----------------------------------------------------------------------------
+
+#define QBUS_ENGINE_URING_ENTRIES       1024
+#define QBUS_ENGINE_URING_BUF_COUNT     512       // must be a power of 2
+#define QBUS_ENGINE_URING_BUF_SIZE      16384
+#define QBUS_ENGINE_URING_BUF_GROUP     0
+#define QBUS_ENGINE_URING_CQE_BATCH     64
+
+// the operation is stored in the lower bits of the user data
+#define QBUS_ENGINE_URING_OP_ACCEPT     0
+#define QBUS_ENGINE_URING_OP_RECV       1
+#define QBUS_ENGINE_URING_OP_SEND       2
+#define QBUS_ENGINE_URING_OP_CLOSE      3
+#define QBUS_ENGINE_URING_OP_MASK       3
+
+//-----------------------------------------------------------------------------
+
+// watches the completions of the ring, owned by the engine and the event loop
+typedef struct
+{
+  void* engine;         // reference, NULL as soon as the engine was deleted
+  
+  CapeMutex mutex;
+  
+  int fd;
+  
+  int refcnt;
+  
+} EngineUringSignal;
+
+//-----------------------------------------------------------------------------
+
+struct EngineUringInc_s
+{
+  CapeString host;
+  
+  number_t port;
+  
+  CapeAioContext aio;   // reference
+  
+  QBusRoute route;      // reference
+  
+  QBusSocketOptions options;
+  
+  int fd_listen;
+  
+  int fd_event;         // signaled by the kernel for new completions
+  
+  EngineUringSignal* signal;
+  
+  struct io_uring ring;
+  
+  int ring_active;
+  
+  struct io_uring_buf_ring* buf_ring;
+  
+  char* buf_data;
+  
+  CapeMutex mutex;      // protects the submission queue and the buffer ring
+  
+  int draining;         // completions are processed, submit all at once afterwards
+  
+  int pending;          // entries wait for submission
+  
+  int closing;          // no more entries are submitted
+  
+  CapeList conns;       // all connections which are not finalized yet, protected by the mutex
+  
+  QBusBackoff backoff;  // delays accepting while the process runs out of resources
+  
+  int accept_wait;      // the multishot accept was canceled to wait for the backoff
+  
+  int accept_stop;      // the multishot accept failed permanently
+};
+
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+  EngineUringInc engine;
+  
+  QBusConnection conn;
+  
+  CapeListNode node;    // entry in the list of the engine
+  
+  int fd;
+  
+  CapeMutex mutex;
+  
+  int sending;          // one thread feeds the connection queue
+  
+  int again;            // the connection was marked while sending
+  
+  number_t sends;       // counts the submitted sends
+  
+  const char* send_data;
+  
+  number_t send_len;
+  
+  void* send_userdata;
+  
+  void* dropped;        // stream which couldn't be sent anymore
+  
+  int broken;           // no more sends are submitted
+  
+  int closed;           // receiving has ended
+  
+  int finalized;
+  
+} EngineUringConn;
+
+//-----------------------------------------------------------------------------
+
+static struct io_uring_sqe* qbus_engine_uring__sqe (EngineUringInc self)
+{
+  struct io_uring_sqe* sqe;
+  
+  if (self->closing)
+  {
+    // the engine is going down, the ring doesn't take new entries
+    return NULL;
+  }
+  
+  sqe = io_uring_get_sqe (&(self->ring));
+  
+  if (sqe == NULL)
+  {
+    // the submission queue is full
+    io_uring_submit (&(self->ring));
+    
+    sqe = io_uring_get_sqe (&(self->ring));
+  }
+  
+  return sqe;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__submit (EngineUringInc self)
+{
+  if (self->draining)
+  {
+    // batch all entries of the current completion round
+    self->pending = TRUE;
+  }
+  else
+  {
+    io_uring_submit (&(self->ring));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__arm_accept (EngineUringInc self)
+{
+  struct io_uring_sqe* sqe;
+  
+  cape_mutex_lock (self->mutex);
+  
+  sqe = qbus_engine_uring__sqe (self);
+  if (sqe)
+  {
+    io_uring_prep_multishot_accept (sqe, self->fd_listen, NULL, NULL, 0);
+    io_uring_sqe_set_data64 (sqe, (__u64)(number_t)self | QBUS_ENGINE_URING_OP_ACCEPT);
+    
+    qbus_engine_uring__submit (self);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__cancel_accept (EngineUringInc self)
+{
+  struct io_uring_sqe* sqe;
+  
+  cape_mutex_lock (self->mutex);
+  
+  sqe = qbus_engine_uring__sqe (self);
+  if (sqe)
+  {
+    // the cancel itself doesn't need a completion
+    io_uring_prep_cancel64 (sqe, (__u64)(number_t)self | QBUS_ENGINE_URING_OP_ACCEPT, 0);
+    io_uring_sqe_set_data64 (sqe, (__u64)(number_t)NULL | QBUS_ENGINE_URING_OP_CLOSE);
+    
+    qbus_engine_uring__submit (self);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__arm_recv (EngineUringConn* conn)
+{
+  EngineUringInc self = conn->engine;
+  struct io_uring_sqe* sqe;
+  
+  cape_mutex_lock (self->mutex);
+  
+  sqe = qbus_engine_uring__sqe (self);
+  if (sqe)
+  {
+    // the kernel picks a buffer of the group for each receive
+    io_uring_prep_recv_multishot (sqe, conn->fd, NULL, 0, 0);
+    io_uring_sqe_set_data64 (sqe, (__u64)(number_t)conn | QBUS_ENGINE_URING_OP_RECV);
+    
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = QBUS_ENGINE_URING_BUF_GROUP;
+    
+    qbus_engine_uring__submit (self);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__arm_send (EngineUringConn* conn)
+{
+  EngineUringInc self = conn->engine;
+  struct io_uring_sqe* sqe;
+  
+  cape_mutex_lock (self->mutex);
+  
+  sqe = qbus_engine_uring__sqe (self);
+  if (sqe)
+  {
+    io_uring_prep_send (sqe, conn->fd, conn->send_data, conn->send_len, MSG_NOSIGNAL);
+    io_uring_sqe_set_data64 (sqe, (__u64)(number_t)conn | QBUS_ENGINE_URING_OP_SEND);
+    
+    qbus_engine_uring__submit (self);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__arm_close (EngineUringConn* conn)
+{
+  EngineUringInc self = conn->engine;
+  struct io_uring_sqe* sqe;
+  
+  cape_mutex_lock (self->mutex);
+  
+  sqe = qbus_engine_uring__sqe (self);
+  if (sqe)
+  {
+    // the completion finalizes the connection within the event loop
+    io_uring_prep_nop (sqe);
+    io_uring_sqe_set_data64 (sqe, (__u64)(number_t)conn | QBUS_ENGINE_URING_OP_CLOSE);
+    
+    qbus_engine_uring__submit (self);
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__buf_return (EngineUringInc self, unsigned short bid)
+{
+  cape_mutex_lock (self->mutex);
+  
+  io_uring_buf_ring_add (self->buf_ring, self->buf_data + (number_t)bid * QBUS_ENGINE_URING_BUF_SIZE, QBUS_ENGINE_URING_BUF_SIZE, bid, io_uring_buf_ring_mask (QBUS_ENGINE_URING_BUF_COUNT), 0);
+  io_uring_buf_ring_advance (self->buf_ring, 1);
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring_conn__finalize (EngineUringConn* self)
+{
+  EngineUringInc engine = self->engine;
+  
+  cape_mutex_lock (engine->mutex);
+  
+  cape_list_node_erase (engine->conns, self->node);
+  
+  cape_mutex_unlock (engine->mutex);
+  
+  qbus_connection_del (&(self->conn));
+  
+  close (self->fd);
+  
+  cape_mutex_del (&(self->mutex));
+  
+  CAPE_DEL (&self, EngineUringConn);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring_conn__next (EngineUringConn* self, void* userdata)
+{
+  int finalize = FALSE;
+  
+  for (;;)
+  {
+    number_t sends;
+    
+    cape_mutex_lock (self->mutex);
+    
+    sends = self->sends;
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // releases the stream and hands over the next one
+    qbus_connection_onSent (self->conn, userdata);
+    
+    cape_mutex_lock (self->mutex);
+    
+    if (self->sends != sends)
+    {
+      // the completion will continue
+      cape_mutex_unlock (self->mutex);
+      return;
+    }
+    
+    if (self->dropped)
+    {
+      // release all remaining streams of a broken connection
+      userdata = self->dropped;
+      self->dropped = NULL;
+      
+      cape_mutex_unlock (self->mutex);
+      continue;
+    }
+    
+    if (self->again)
+    {
+      self->again = FALSE;
+      userdata = NULL;
+      
+      cape_mutex_unlock (self->mutex);
+      continue;
+    }
+    
+    self->sending = FALSE;
+    
+    if (self->closed && !self->finalized)
+    {
+      finalize = self->finalized = TRUE;
+    }
+    
+    cape_mutex_unlock (self->mutex);
+    break;
+  }
+  
+  if (finalize)
+  {
+    // this might run within a callback of the connection, which can't delete it
+    qbus_engine_uring__arm_close (self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_uring_send (void* ptr1, void* ptr2, const char* bufdat, number_t buflen, void* userdata)
+{
+  EngineUringConn* self = ptr1;
+  
+  cape_mutex_lock (self->mutex);
+  
+  if (self->broken)
+  {
+    self->dropped = userdata;
+    
+    cape_mutex_unlock (self->mutex);
+    return;
+  }
+  
+  self->sends++;
+  
+  self->send_data = bufdat;
+  self->send_len = buflen;
+  self->send_userdata = userdata;
+  
+  cape_mutex_unlock (self->mutex);
+  
+  qbus_engine_uring__arm_send (self);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_uring_mark (void* ptr1, void* ptr2)
+{
+  EngineUringConn* self = ptr1;
+  
+  cape_mutex_lock (self->mutex);
+  
+  if (self->sending)
+  {
+    // the sending thread will pick it up
+    self->again = TRUE;
+    
+    cape_mutex_unlock (self->mutex);
+    return;
+  }
+  
+  self->sending = TRUE;
+  
+  cape_mutex_unlock (self->mutex);
+  
+  qbus_engine_uring_conn__next (self, NULL);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_uring_close (void* ptr1, void* ptr2)
+{
+  EngineUringConn* self = ptr1;
+  
+  // the multishot receive ends and cleans up the connection
+  shutdown (self->fd, SHUT_RDWR);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_uring__accept_onRetry (void* ptr)
+{
+  EngineUringInc self = ptr;
+  
+  self->accept_wait = FALSE;
+  
+  qbus_engine_uring__arm_accept (self);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__on_accept (EngineUringInc self, int res, unsigned flags)
+{
+  if (res >= 0)
+  {
+    EngineUringConn* conn = CAPE_NEW (EngineUringConn);
+    
+    memset (conn, 0, sizeof(EngineUringConn));
+    
+    conn->engine = self;
+    conn->fd = res;
+    conn->mutex = cape_mutex_new ();
+    
+    qbus_socket_options_apply (&(self->options), (void*)(number_t)conn->fd);
+    
+    // create a new core connection for routing
+    conn->conn = qbus_connection_new (self->route, 0);
+    
+    // set qbus connection callbacks
+    qbus_connection_cb (conn->conn, conn, NULL, qbus_engine_uring_send, qbus_engine_uring_mark);
+    qbus_connection_cb_close (conn->conn, qbus_engine_uring_close);
+    
+    cape_mutex_lock (self->mutex);
+    
+    conn->node = cape_list_push_back (self->conns, conn);
+    
+    cape_mutex_unlock (self->mutex);
+    
+    qbus_engine_uring__arm_recv (conn);
+    
+    // activate routing
+    qbus_connection_reg (conn->conn);
+    
+    qbus_backoff_reset (self->backoff);
+  }
+  else switch (-res)
+  {
+    case EINTR:
+    case EAGAIN:
+    case ECONNABORTED:
+    case EPROTO:
+    case EPERM:
+    {
+      // only this connection failed
+      cape_log_fmt (CAPE_LL_WARN, "QBUS", "uring accept", "accept failed: %s", strerror (-res));
+      break;
+    }
+    case EMFILE:
+    case ENFILE:
+    case ENOBUFS:
+    case ENOMEM:
+    {
+      if (self->accept_wait == FALSE)
+      {
+        cape_log_fmt (CAPE_LL_WARN, "QBUS", "uring accept", "accept paused: %s", strerror (-res));
+        
+        // accepting right away would fail again, wait for the backoff
+        self->accept_wait = TRUE;
+        
+        if (flags & IORING_CQE_F_MORE)
+        {
+          qbus_engine_uring__cancel_accept (self);
+        }
+      }
+      
+      break;
+    }
+    case ECANCELED:
+    {
+      break;
+    }
+    default:
+    {
+      cape_log_fmt (CAPE_LL_ERROR, "QBUS", "uring accept", "accept stopped: %s", strerror (-res));
+      
+      self->accept_stop = TRUE;
+      
+      if (flags & IORING_CQE_F_MORE)
+      {
+        qbus_engine_uring__cancel_accept (self);
+      }
+      
+      break;
+    }
+  }
+  
+  if ((flags & IORING_CQE_F_MORE) == 0)
+  {
+    // the kernel stopped the multishot accept
+    if (self->accept_stop || self->closing)
+    {
+      return;
+    }
+    
+    if (self->accept_wait)
+    {
+      CapeErr err = cape_err_new ();
+      
+      // the backoff drops the attempt if the engine is deleted before the timer fires
+      if (qbus_backoff_schedule (self->backoff, self->aio, self, qbus_engine_uring__accept_onRetry, err))
+      {
+        cape_log_fmt (CAPE_LL_ERROR, "QBUS", "uring accept", "can't set timer: %s", cape_err_text (err));
+      }
+      
+      cape_err_del (&err);
+    }
+    else
+    {
+      qbus_engine_uring__arm_accept (self);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__on_recv (EngineUringConn* conn, int res, unsigned flags)
+{
+  if (res > 0)
+  {
+    unsigned short bid = (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT);
+    
+    qbus_connection_onRecv (conn->conn, conn->engine->buf_data + (number_t)bid * QBUS_ENGINE_URING_BUF_SIZE, res);
+    
+    qbus_engine_uring__buf_return (conn->engine, bid);
+    
+    if ((flags & IORING_CQE_F_MORE) == 0)
+    {
+      qbus_engine_uring__arm_recv (conn);
+    }
+  }
+  else if (res == -ENOBUFS)
+  {
+    // all buffers are in use, try again
+    qbus_engine_uring__arm_recv (conn);
+  }
+  else if ((flags & IORING_CQE_F_MORE) == 0)
+  {
+    int finalize = FALSE;
+    
+    cape_mutex_lock (conn->mutex);
+    
+    conn->closed = TRUE;
+    conn->broken = TRUE;
+    
+    if (!conn->sending && !conn->finalized)
+    {
+      finalize = conn->finalized = TRUE;
+    }
+    
+    cape_mutex_unlock (conn->mutex);
+    
+    if (finalize)
+    {
+      qbus_engine_uring_conn__finalize (conn);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__on_send (EngineUringConn* conn, int res)
+{
+  void* userdata;
+  
+  if (res > 0 && res < conn->send_len)
+  {
+    // partial send, continue with the rest
+    conn->send_data += res;
+    conn->send_len -= res;
+    
+    qbus_engine_uring__arm_send (conn);
+    return;
+  }
+  
+  cape_mutex_lock (conn->mutex);
+  
+  if (res <= 0)
+  {
+    conn->broken = TRUE;
+  }
+  
+  userdata = conn->send_userdata;
+  conn->send_userdata = NULL;
+  
+  cape_mutex_unlock (conn->mutex);
+  
+  if (res <= 0)
+  {
+    // let the receive end
+    shutdown (conn->fd, SHUT_RDWR);
+  }
+  
+  qbus_engine_uring_conn__next (conn, userdata);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring__on_event (EngineUringInc self)
+{
+  struct io_uring_cqe* cqes[QBUS_ENGINE_URING_CQE_BATCH];
+  struct io_uring_cqe items[QBUS_ENGINE_URING_CQE_BATCH];
+  
+  unsigned i, n;
+  
+  cape_mutex_lock (self->mutex);
+  
+  self->draining = TRUE;
+  
+  cape_mutex_unlock (self->mutex);
+  
+  do
+  {
+    cape_mutex_lock (self->mutex);
+    
+    n = io_uring_peek_batch_cqe (&(self->ring), cqes, QBUS_ENGINE_URING_CQE_BATCH);
+    
+    for (i = 0; i < n; i++)
+    {
+      items[i] = *(cqes[i]);
+    }
+    
+    io_uring_cq_advance (&(self->ring), n);
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // process without holding the lock, handlers might send on other connections
+    for (i = 0; i < n; i++)
+    {
+      void* obj = (void*)(number_t)(items[i].user_data & ~(__u64)QBUS_ENGINE_URING_OP_MASK);
+      
+      switch (items[i].user_data & QBUS_ENGINE_URING_OP_MASK)
+      {
+        case QBUS_ENGINE_URING_OP_ACCEPT:
+        {
+          qbus_engine_uring__on_accept (obj, items[i].res, items[i].flags);
+          break;
+        }
+        case QBUS_ENGINE_URING_OP_RECV:
+        {
+          qbus_engine_uring__on_recv (obj, items[i].res, items[i].flags);
+          break;
+        }
+        case QBUS_ENGINE_URING_OP_SEND:
+        {
+          qbus_engine_uring__on_send (obj, items[i].res);
+          break;
+        }
+        case QBUS_ENGINE_URING_OP_CLOSE:
+        {
+          // canceling the accept has no object
+          if (obj)
+          {
+            qbus_engine_uring_conn__finalize (obj);
+          }
+          
+          break;
+        }
+      }
+    }
+  }
+  while (n == QBUS_ENGINE_URING_CQE_BATCH);
+  
+  cape_mutex_lock (self->mutex);
+  
+  self->draining = FALSE;
+  
+  if (self->pending)
+  {
+    self->pending = FALSE;
+    
+    // one system call for all entries of this round
+    io_uring_submit (&(self->ring));
+  }
+  
+  cape_mutex_unlock (self->mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring_signal__dec (EngineUringSignal** p_self)
+{
+  EngineUringSignal* self = *p_self;
+  
+  *p_self = NULL;
+  
+  if (__atomic_sub_fetch (&(self->refcnt), 1, __ATOMIC_ACQ_REL))
+  {
+    return;
+  }
+  
+  close (self->fd);
+  
+  cape_mutex_del (&(self->mutex));
+  
+  CAPE_DEL (&self, EngineUringSignal);
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_engine_uring_signal__on_event (void* ptr, int hflags, unsigned long events, unsigned long param1)
+{
+  EngineUringSignal* self = ptr;
+  
+  eventfd_t val;
+  
+  // resets the counter, the handle is non blocking
+  eventfd_read (self->fd, &val);
+  
+  cape_mutex_lock (self->mutex);
+  
+  if (self->engine)
+  {
+    qbus_engine_uring__on_event (self->engine);
+  }
+  else
+  {
+    // the engine is gone, remove the handle from the event loop
+    hflags = CAPE_AIO_DONE;
+  }
+  
+  cape_mutex_unlock (self->mutex);
+  
+  return hflags;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_engine_uring_signal__on_unref (void* ptr, CapeAioHandle aioh, int force_close)
+{
+  EngineUringSignal* self = ptr;
+  
+  qbus_engine_uring_signal__dec (&self);
+  
+  cape_aio_handle_del (&aioh);
+}
+
+//-----------------------------------------------------------------------------
+
+static EngineUringSignal* qbus_engine_uring_signal_new (CapeAioContext aio, void* engine, int fd, CapeErr err)
+{
+  EngineUringSignal* self = CAPE_NEW (EngineUringSignal);
+  
+  self->engine = engine;
+  self->mutex = cape_mutex_new ();
+  self->fd = fd;
+  
+  // one for the engine and one for the event loop
+  self->refcnt = 2;
+  
+  {
+    CapeAioHandle aioh = cape_aio_handle_new (CAPE_AIO_READ, self, qbus_engine_uring_signal__on_event, qbus_engine_uring_signal__on_unref);
+    
+    if (cape_aio_context_add (aio, aioh, (void*)(number_t)fd, 0) == FALSE)
+    {
+      cape_err_set (err, CAPE_ERR_RUNTIME, "can't add eventfd to the event loop");
+      
+      cape_aio_handle_del (&aioh);
+      
+      // nobody else holds a reference
+      self->refcnt = 1;
+      qbus_engine_uring_signal__dec (&self);
+    }
+  }
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_engine_uring_signal_detach (EngineUringSignal** p_self)
+{
+  EngineUringSignal* self = *p_self;
+  
+  if (self)
+  {
+    cape_mutex_lock (self->mutex);
+    
+    // a running handler finishes before the engine is released
+    self->engine = NULL;
+    
+    cape_mutex_unlock (self->mutex);
+    
+    // the next event lets the handler remove itself
+    eventfd_write (self->fd, 1);
+    
+    qbus_engine_uring_signal__dec (p_self);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+EngineUringInc qbus_engine_uring_inc_new (CapeAioContext aio, QBusRoute route, const CapeString host, number_t port)
+{
+  EngineUringInc self = CAPE_NEW (struct EngineUringInc_s);
+  
+  self->host = cape_str_cp (host);
+  self->port = port;
+  
+  self->aio = aio;
+  self->route = route;
+  
+  qbus_socket_options_init (&(self->options));
+  
+  self->fd_listen = -1;
+  self->fd_event = -1;
+  
+  self->ring_active = FALSE;
+  self->buf_ring = NULL;
+  self->buf_data = NULL;
+  
+  self->signal = NULL;
+  
+  self->mutex = cape_mutex_new ();
+  self->draining = FALSE;
+  self->pending = FALSE;
+  self->closing = FALSE;
+  
+  self->conns = cape_list_new (NULL);
+  
+  self->backoff = qbus_backoff_new ();
+  self->accept_wait = FALSE;
+  self->accept_stop = FALSE;
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_uring_inc_del (EngineUringInc* p_self)
+{
+  if (*p_self)
+  {
+    EngineUringInc self = *p_self;
+    
+    EngineUringConn* conn;
+    
+    // no retry of the accept anymore
+    qbus_backoff_del (&(self->backoff));
+    
+    // waits for a running completion round
+    qbus_engine_uring_signal_detach (&(self->signal));
+    
+    cape_mutex_lock (self->mutex);
+    
+    self->closing = TRUE;
+    
+    // cancel all operations of the kernel on our sockets
+    {
+      CapeListCursor* cursor = cape_list_cursor_create (self->conns, CAPE_DIRECTION_FORW);
+      
+      while (cape_list_cursor_next (cursor))
+      {
+        conn = cape_list_node_data (cursor->node);
+        
+        shutdown (conn->fd, SHUT_RDWR);
+      }
+      
+      cape_list_cursor_destroy (&cursor);
+    }
+    
+    cape_mutex_unlock (self->mutex);
+    
+    if (self->fd_listen >= 0)
+    {
+      shutdown (self->fd_listen, SHUT_RDWR);
+    }
+    
+    if (self->buf_ring)
+    {
+      io_uring_free_buf_ring (&(self->ring), self->buf_ring, QBUS_ENGINE_URING_BUF_COUNT, QBUS_ENGINE_URING_BUF_GROUP);
+    }
+    
+    if (self->ring_active)
+    {
+      io_uring_queue_exit (&(self->ring));
+    }
+    
+    // no completions will arrive anymore, finalize all remaining connections here
+    while ((conn = cape_list_pop_front (self->conns)))
+    {
+      QBusConnection qconn = qbus_connection_inc (conn->conn);
+      
+      void* userdata;
+      
+      // waits until no other thread is inside of a callback
+      qbus_connection_del (&(conn->conn));
+      
+      conn->broken = TRUE;
+      
+      userdata = conn->send_userdata;
+      conn->send_userdata = NULL;
+      
+      if (userdata == NULL)
+      {
+        userdata = conn->dropped;
+        conn->dropped = NULL;
+      }
+      
+      // release all streams, which are still waiting
+      while (userdata)
+      {
+        qbus_connection_onSent (qconn, userdata);
+        
+        userdata = conn->dropped;
+        conn->dropped = NULL;
+      }
+      
+      qbus_connection_dec (&qconn);
+      
+      close (conn->fd);
+      
+      cape_mutex_del (&(conn->mutex));
+      
+      CAPE_DEL (&conn, EngineUringConn);
+    }
+    
+    cape_list_del (&(self->conns));
+    
+    if (self->fd_listen >= 0)
+    {
+      close (self->fd_listen);
+    }
+    
+    if (self->buf_data)
+    {
+      free (self->buf_data);
+    }
+    
+    cape_mutex_del (&(self->mutex));
+    
+    cape_str_del (&(self->host));
+    
+    CAPE_DEL (p_self, struct EngineUringInc_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_engine_uring_inc_options (EngineUringInc self, CapeUdc bind)
+{
+  qbus_socket_options_read (&(self->options), bind);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_engine_uring_inc_listen (EngineUringInc self, CapeErr err)
+{
+  int res;
+  int i;
+  
+  // the options must be set before listen, accepted sockets inherit them
+  void* socket_handle = qbus_socket_srv_new (self->host, self->port, &(self->options), FALSE, err);
+  if (socket_handle == NULL)
+  {
+    return cape_err_code (err);
+  }
+  
+  self->fd_listen = (int)(number_t)socket_handle;
+  
+  res = io_uring_queue_init (QBUS_ENGINE_URING_ENTRIES, &(self->ring), 0);
+  if (res < 0)
+  {
+    return cape_err_set_fmt (err, CAPE_ERR_OS, "can't create io_uring: %s", strerror (-res));
+  }
+  
+  self->ring_active = TRUE;
+  
+  // the receive buffers are provided to the kernel once
+  self->buf_ring = io_uring_setup_buf_ring (&(self->ring), QBUS_ENGINE_URING_BUF_COUNT, QBUS_ENGINE_URING_BUF_GROUP, 0, &res);
+  if (self->buf_ring == NULL)
+  {
+    return cape_err_set_fmt (err, CAPE_ERR_NOT_SUPPORTED, "can't register buffer ring: %s", strerror (-res));
+  }
+  
+  self->buf_data = malloc ((size_t)QBUS_ENGINE_URING_BUF_COUNT * QBUS_ENGINE_URING_BUF_SIZE);
+  
+  for (i = 0; i < QBUS_ENGINE_URING_BUF_COUNT; i++)
+  {
+    io_uring_buf_ring_add (self->buf_ring, self->buf_data + (number_t)i * QBUS_ENGINE_URING_BUF_SIZE, QBUS_ENGINE_URING_BUF_SIZE, (unsigned short)i, io_uring_buf_ring_mask (QBUS_ENGINE_URING_BUF_COUNT), i);
+  }
+  
+  io_uring_buf_ring_advance (self->buf_ring, QBUS_ENGINE_URING_BUF_COUNT);
+  
+  // completions wake up the AIO context
+  self->fd_event = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->fd_event < 0)
+  {
+    return cape_err_lastOSError (err);
+  }
+  
+  res = io_uring_register_eventfd (&(self->ring), self->fd_event);
+  if (res < 0)
+  {
+    close (self->fd_event);
+    self->fd_event = -1;
+    
+    return cape_err_set_fmt (err, CAPE_ERR_OS, "can't register eventfd: %s", strerror (-res));
+  }
+  
+  // the signal owns the eventfd from now on
+  self->signal = qbus_engine_uring_signal_new (self->aio, self, self->fd_event, err);
+  if (self->signal == NULL)
+  {
+    return cape_err_code (err);
+  }
+  
+  qbus_engine_uring__arm_accept (self);
+  
+  cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "uring listen", "listen on %s:%li", self->host, self->port);
+  
+  return CAPE_ERR_NONE;
+}
@@ -0,0 +1,29 @@
+#ifndef __QBUS__ENGINE__URING__H
+#define __QBUS__ENGINE__URING__H 1
+
+#include "sys/cape_export.h"
+#include "sys/cape_err.h"
+#include "stc/cape_udc.h"
+#include "aio/cape_aio_ctx.h"
+
+#include "qbus_route.h"
+
+//=============================================================================
+
+struct EngineUringInc_s; typedef struct EngineUringInc_s* EngineUringInc;
+
+//-----------------------------------------------------------------------------
+
+                 // tcp listener driven by io_uring, completions are processed by the AIO context
+__CAPE_LIBEX   EngineUringInc    qbus_engine_uring_inc_new    (CapeAioContext aio, QBusRoute, const CapeString host, number_t port);
+
+__CAPE_LIBEX   void              qbus_engine_uring_inc_del    (EngineUringInc*);
+
+                 // socket options of the 'tcp' node, same as for the tcp engine
+__CAPE_LIBEX   void              qbus_engine_uring_inc_options  (EngineUringInc, CapeUdc bind);
+
+__CAPE_LIBEX   int               qbus_engine_uring_inc_listen (EngineUringInc, CapeErr err);
+
+//-----------------------------------------------------------------------------
+
+#endif
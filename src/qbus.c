@@ -1,5 +1,8 @@
 #include "qbus.h" 
 #include "qbus_route.h"
+#include "qbus_core.h"
+#include "qbus_submit.h"
+#include "qbus_blob.h"
 
 // c includes
 #include <stdlib.h>
@@ -13,6 +16,7 @@
 
 #include <termios.h>
 #include <unistd.h>
+#include <sched.h>
 
 #endif
 
@@ -20,14 +24,26 @@
 #include "sys/cape_log.h"
 #include "sys/cape_types.h"
 #include "sys/cape_file.h"
+#include "sys/cape_thread.h"
 #include "stc/cape_str.h"
 #include "aio/cape_aio_sock.h"
+#include "aio/cape_aio_timer.h"
 #include "fmt/cape_args.h"
 #include "fmt/cape_json.h"
 #include "fmt/cape_tokenizer.h"
 
 // engines
 #include "../engines/tcp/engine_tcp.h"
+#include "../engines/unix/engine_unix.h"
+#include "../engines/local/engine_local.h"
+
+#if defined QBUS_ENGINE_SHM
+#include "../engines/shm/engine_shm.h"
+#endif
+
+#if defined QBUS_ENGINE_URING
+#include "../engines/uring/engine_uring.h"
+#endif
 
 //-----------------------------------------------------------------------------
 
@@ -39,11 +55,30 @@ struct QBus_s
   
   QBusRoute route;
   
-  // TODO -> into list
-  EngineTcpInc engine_tcp_inc;
+  QBusSubmit submit;
+  
+  // all engines, the instance can listen and connect on several transports
+  CapeList engines_tcp_inc;
+  
+  CapeList engines_tcp_out;
+  
+  CapeList engines_unix_inc;
+  
+  CapeList engines_unix_out;
   
-  // TODO -> into list
-  EngineTcpOut engine_tcp_out;
+  CapeList engines_local;
+  
+#if defined QBUS_ENGINE_SHM
+  CapeList engines_shm_inc;
+  
+  CapeList engines_shm_out;
+#endif
+  
+#if defined QBUS_ENGINE_URING
+  CapeList engines_uring_inc;
+#endif
+  
+  number_t heartbeat_misses;
   
   // config
   CapeUdc config;
@@ -53,6 +88,91 @@ struct QBus_s
 
 //-----------------------------------------------------------------------------
 
+static void __STDCALL qbus__engines_tcp_inc_onDel (void* ptr)
+{
+  EngineTcpInc engine = ptr;
+  
+  qbus_engine_tcp_inc_del (&engine);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_tcp_out_onDel (void* ptr)
+{
+  EngineTcpOut engine = ptr;
+  
+  qbus_engine_tcp_out_del (&engine);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_unix_inc_onDel (void* ptr)
+{
+  EngineUnixInc engine = ptr;
+  
+  qbus_engine_unix_inc_del (&engine);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_unix_out_onDel (void* ptr)
+{
+  EngineUnixOut engine = ptr;
+  
+  qbus_engine_unix_out_del (&engine);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_local_onDel (void* ptr)
+{
+  EngineLocal engine = ptr;
+  
+  qbus_engine_local_del (&engine);
+}
+
+#if defined QBUS_ENGINE_SHM
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_shm_inc_onDel (void* ptr)
+{
+  EngineShmInc engine = ptr;
+  
+  qbus_engine_shm_inc_del (&engine);
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_shm_out_onDel (void* ptr)
+{
+  EngineShmOut engine = ptr;
+  
+  qbus_engine_shm_out_del (&engine);
+}
+
+#endif
+
+#if defined QBUS_ENGINE_URING
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus__engines_uring_inc_onDel (void* ptr)
+{
+  EngineUringInc engine = ptr;
+  
+  qbus_engine_uring_inc_del (&engine);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+// number of living instances, the last one releases the message pool
+static int qbus_instances = 0;
+
+//-----------------------------------------------------------------------------
+
 QBus qbus_new (const char* module_origin)
 {
   QBus self = CAPE_NEW(struct QBus_s);
@@ -65,11 +185,31 @@ QBus qbus_new (const char* module_origin)
   
   self->aio = cape_aio_context_new ();
   
-  self->engine_tcp_inc = NULL;
-  self->engine_tcp_out = NULL;
+  self->submit = qbus_submit_new (self, self->route);
+  
+  qbus_route_set_submit (self->route, self->submit);
+  
+  self->engines_tcp_inc = cape_list_new (qbus__engines_tcp_inc_onDel);
+  self->engines_tcp_out = cape_list_new (qbus__engines_tcp_out_onDel);
+  self->engines_unix_inc = cape_list_new (qbus__engines_unix_inc_onDel);
+  self->engines_unix_out = cape_list_new (qbus__engines_unix_out_onDel);
+  self->engines_local = cape_list_new (qbus__engines_local_onDel);
+  
+#if defined QBUS_ENGINE_SHM
+  self->engines_shm_inc = cape_list_new (qbus__engines_shm_inc_onDel);
+  self->engines_shm_out = cape_list_new (qbus__engines_shm_out_onDel);
+#endif
+  
+#if defined QBUS_ENGINE_URING
+  self->engines_uring_inc = cape_list_new (qbus__engines_uring_inc_onDel);
+#endif
+  
+  self->heartbeat_misses = 0;
   
   self->config = NULL;
   self->config_file = NULL;
+  
+  __atomic_add_fetch (&qbus_instances, 1, __ATOMIC_ACQ_REL);
     
   return self;
 }
@@ -84,15 +224,36 @@ void qbus_del (QBus* p_self)
   
   cape_str_del (&(self->name));
   
-  qbus_engine_tcp_inc_del (&(self->engine_tcp_inc));
-  qbus_engine_tcp_out_del (&(self->engine_tcp_out));
+  cape_list_del (&(self->engines_tcp_inc));
+  cape_list_del (&(self->engines_tcp_out));
+  cape_list_del (&(self->engines_unix_inc));
+  cape_list_del (&(self->engines_unix_out));
+  cape_list_del (&(self->engines_local));
   
+#if defined QBUS_ENGINE_SHM
+  cape_list_del (&(self->engines_shm_inc));
+  cape_list_del (&(self->engines_shm_out));
+#endif
+  
+#if defined QBUS_ENGINE_URING
+  cape_list_del (&(self->engines_uring_inc));
+#endif
+  
+  // joins the worker pools, which might still hand over responses
   qbus_route_del (&(self->route));
   
+  qbus_submit_del (&(self->submit));
+  
   cape_udc_del (&(self->config));
   cape_str_del (&(self->config_file));
   
   CAPE_DEL (p_self, struct QBus_s);
+  
+  // the message pool is shared by all instances
+  if (__atomic_sub_fetch (&qbus_instances, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    qbus_message_pool_clr ();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -114,9 +275,100 @@ void qbus_add_income_port (QBus self, CapeUdc bind)
     
     if (name && path)
     {
+      EngineUnixInc engine = qbus_engine_unix_inc_new (self->aio, self->route, path, name);
+      
+      cape_list_push_back (self->engines_unix_inc, engine);
+      
+      // power up engine
+      {
+        CapeErr err = cape_err_new ();
+        
+        int res = qbus_engine_unix_inc_listen (engine, err);
+        if (res)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add income", "error in listen: %s", cape_err_text (err));
+        }
+        
+        cape_err_del (&err);
+      }
+    }
+    
+    return;
+  }
+  
+  if (strcmp (type, "shm") == 0)
+  {
+#if defined QBUS_ENGINE_SHM
+    
+    // check if we have name and path of the handshake socket
+    const CapeString name = cape_udc_get_s (bind, "name", NULL);
+    const CapeString path = cape_udc_get_s (bind, "path", NULL);
+    
+    if (name && path)
+    {
+      EngineShmInc engine = qbus_engine_shm_inc_new (self->aio, self->route, path, name);
+      
+      cape_list_push_back (self->engines_shm_inc, engine);
+      
+      // power up engine
+      {
+        CapeErr err = cape_err_new ();
+        
+        int res = qbus_engine_shm_inc_listen (engine, err);
+        if (res)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add income", "error in listen: %s", cape_err_text (err));
+        }
+        
+        cape_err_del (&err);
+      }
+    }
+    
+#else
+    
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "add income", "shm engine is not available");
+    
+#endif
+    
+    return;
+  }
+  
+  if (strcmp (type, "uring") == 0)
+  {
+#if defined QBUS_ENGINE_URING
+    
+    // check if we have host and port
+    const CapeString host = cape_udc_get_s (bind, "host", NULL);
+    number_t port = cape_udc_get_n (bind, "port", 0);
+    
+    if (host && port)
+    {
+      EngineUringInc engine = qbus_engine_uring_inc_new (self->aio, self->route, host, port);
+      
+      cape_list_push_back (self->engines_uring_inc, engine);
+      
+      qbus_engine_uring_inc_options (engine, bind);
       
+      // power up engine
+      {
+        CapeErr err = cape_err_new ();
+        
+        int res = qbus_engine_uring_inc_listen (engine, err);
+        if (res)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add income", "error in listen: %s", cape_err_text (err));
+        }
+        
+        cape_err_del (&err);
+      }
     }
     
+#else
+    
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "add income", "uring engine is not available, build with liburing");
+    
+#endif
+    
     return;
   }
   
@@ -126,15 +378,22 @@ void qbus_add_income_port (QBus self, CapeUdc bind)
     const CapeString host = cape_udc_get_s (bind, "host", NULL);
     number_t port = cape_udc_get_n (bind, "port", 0);
     
+    // optional amount of listeners with their own threads
+    number_t shards = cape_udc_get_n (bind, "shards", 0);
+    
     if (host && port)
     {
-      self->engine_tcp_inc = qbus_engine_tcp_inc_new (self->aio, self->route, host, port);
+      EngineTcpInc engine = qbus_engine_tcp_inc_new (self->aio, self->route, host, port);
+      
+      cape_list_push_back (self->engines_tcp_inc, engine);
+      
+      qbus_engine_tcp_inc_options (engine, bind);
 
       // power up engine
       {
         CapeErr err = cape_err_new ();
         
-        int res = qbus_engine_tcp_inc_listen (self->engine_tcp_inc, err);
+        int res = (shards > 1) ? qbus_engine_tcp_inc_listen_sharded (engine, shards, err) : qbus_engine_tcp_inc_listen (engine, err);
         if (res)
         {
           cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add income", "error in listen: %s", cape_err_text (err));
@@ -150,7 +409,7 @@ void qbus_add_income_port (QBus self, CapeUdc bind)
 
 //-----------------------------------------------------------------------------
 
-void qbus_add_remote_port (QBus self, CapeUdc remote)
+void qbus_add_remote_link (QBus self, CapeUdc remote)
 {
   const CapeString type = cape_udc_get_s (remote, "type", NULL);
   
@@ -167,12 +426,68 @@ void qbus_add_remote_port (QBus self, CapeUdc remote)
     
     if (name && path)
     {
+      EngineUnixOut engine = qbus_engine_unix_out_new (self->aio, self->route, path, name);
       
+      cape_list_push_back (self->engines_unix_out, engine);
+      
+      qbus_engine_unix_out_backoff (engine, remote);
+      
+      // power up engine
+      {
+        CapeErr err = cape_err_new ();
+        
+        int res = qbus_engine_unix_out_reconnect (engine, err);
+        if (res)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add remote", "error in connect: %s", cape_err_text (err));
+        }
+        
+        cape_err_del (&err);
+      }
     }
     
     return;
   }
   
+  if (strcmp (type, "shm") == 0)
+  {
+#if defined QBUS_ENGINE_SHM
+    
+    // check if we have name and path of the handshake socket
+    const CapeString name = cape_udc_get_s (remote, "name", NULL);
+    const CapeString path = cape_udc_get_s (remote, "path", NULL);
+    
+    if (name && path)
+    {
+      EngineShmOut engine = qbus_engine_shm_out_new (self->aio, self->route, path, name);
+      
+      cape_list_push_back (self->engines_shm_out, engine);
+      
+      qbus_engine_shm_out_backoff (engine, remote);
+      
+      // power up engine
+      {
+        CapeErr err = cape_err_new ();
+        
+        int res = qbus_engine_shm_out_reconnect (engine, err);
+        if (res)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add remote", "error in connect: %s", cape_err_text (err));
+        }
+        
+        cape_err_del (&err);
+      }
+    }
+    
+#else
+    
+    cape_log_msg (CAPE_LL_ERROR, "QBUS", "add remote", "shm engine is not available");
+    
+#endif
+    
+    return;
+  }
+  
   if (strcmp (type, "socket") == 0)
   {
     // check if we have host and port
@@ -181,13 +496,18 @@ void qbus_add_remote_port (QBus self, CapeUdc remote)
     
     if (host && port)
     {
-      self->engine_tcp_out = qbus_engine_tcp_out_new (self->aio, self->route, host, port);
+      EngineTcpOut engine = qbus_engine_tcp_out_new (self->aio, self->route, host, port);
+      
+      cape_list_push_back (self->engines_tcp_out, engine);
+      
+      qbus_engine_tcp_out_backoff (engine, remote);
+      qbus_engine_tcp_out_options (engine, remote);
       
       // power up engine
       {
         CapeErr err = cape_err_new ();
         
-        int res = qbus_engine_tcp_out_reconnect (self->engine_tcp_out, err);
+        int res = qbus_engine_tcp_out_reconnect (engine, err);
         if (res)
         {
           cape_log_fmt (CAPE_LL_ERROR, "QBUS", "add remote", "error in connect: %s", cape_err_text (err));
@@ -203,6 +523,25 @@ void qbus_add_remote_port (QBus self, CapeUdc remote)
 
 //-----------------------------------------------------------------------------
 
+void qbus_add_remote_port (QBus self, CapeUdc remote)
+{
+  // parallel connections to the same remote, the route stripes requests across them
+  number_t links = cape_udc_get_n (remote, "links", 1);
+  number_t i;
+  
+  if (links < 1)
+  {
+    links = 1;
+  }
+  
+  for (i = 0; i < links; i++)
+  {
+    qbus_add_remote_link (self, remote);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_add_income_ports (QBus self, CapeUdc binds)
 {
   switch (cape_udc_type (binds))
@@ -257,6 +596,84 @@ void qbus_add_remote_ports (QBus self, CapeUdc remotes)
 
 //-----------------------------------------------------------------------------
 
+static int __STDCALL qbus_wait__worker (void* ptr)
+{
+  QBus self = ptr;
+  
+  CapeErr err = cape_err_new ();
+  
+  int res = cape_aio_context_wait (self->aio, err);
+  if (res)
+  {
+    cape_log_fmt (CAPE_LL_ERROR, "QBUS", "wait", "event loop thread ended: %s", cape_err_text (err));
+  }
+  
+  cape_err_del (&err);
+  
+  // don't run again
+  return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_wait__workers_del (void* ptr)
+{
+  CapeThread thread = ptr;
+  
+  cape_thread_join (thread);
+  cape_thread_del (&thread);
+}
+
+//-----------------------------------------------------------------------------
+
+static int __STDCALL qbus_wait__heartbeat__onTimer (void* ptr)
+{
+  QBus self = ptr;
+  
+  qbus_route_heartbeat (self->route, self->heartbeat_misses);
+  
+  // keep the timer
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+
+static int qbus_wait__heartbeat (QBus self, CapeErr err)
+{
+  int res;
+  CapeAioTimer timer;
+  
+  // disabled by default, older peers don't answer heartbeats
+  number_t interval = qbus_config_n (self, "heartbeat_interval", 0);
+  
+  self->heartbeat_misses = qbus_config_n (self, "heartbeat_misses", 3);
+  
+  if (interval <= 0)
+  {
+    return CAPE_ERR_NONE;
+  }
+  
+  timer = cape_aio_timer_new ();
+  
+  res = cape_aio_timer_set (timer, interval, self, qbus_wait__heartbeat__onTimer, err);
+  if (res)
+  {
+    return res;
+  }
+  
+  res = cape_aio_timer_add (&timer, self->aio);
+  if (res)
+  {
+    return res;
+  }
+  
+  cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "wait", "heartbeat every %li ms, drop after %li misses", interval, self->heartbeat_misses);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_wait__intern (QBus self, CapeUdc binds, CapeUdc remotes, CapeErr err)
 {
   int res;
@@ -268,6 +685,13 @@ int qbus_wait__intern (QBus self, CapeUdc binds, CapeUdc remotes, CapeErr err)
     return res;
   }
   
+  // requests from other threads
+  res = qbus_submit_open (self->submit, self->aio, err);
+  if (res)
+  {
+    return res;
+  }
+  
   if (binds)
   {
     qbus_add_income_ports (self, binds);
@@ -278,16 +702,73 @@ int qbus_wait__intern (QBus self, CapeUdc binds, CapeUdc remotes, CapeErr err)
     qbus_add_remote_ports (self, remotes);
   }
   
-  // TODO: run in several threads
+  // detect peers which hang without closing the connection
+  res = qbus_wait__heartbeat (self, err);
+  if (res)
+  {
+    return res;
+  }
   
-  // wait infinite and let the AIO subsystem handle all events
-  res = cape_aio_context_wait (self->aio, err);
+  {
+    number_t i;
+    number_t threads = qbus_config_n (self, "threads", 1);
+    
+    CapeList workers = cape_list_new (qbus_wait__workers_del);
+    
+    // all threads wait on the same AIO context
+    // the AIO subsystem hands out each handle to one thread at a time
+    for (i = 1; i < threads; i++)
+    {
+      CapeThread thread = cape_thread_new ();
+      
+      cape_thread_start (thread, qbus_wait__worker, self);
+      
+      cape_list_push_back (workers, thread);
+    }
+    
+    cape_log_fmt (CAPE_LL_DEBUG, "QBUS", "wait", "run event loop with %li threads", threads < 1 ? 1 : threads);
+    
+    // wait infinite and let the AIO subsystem handle all events
+    res = cape_aio_context_wait (self->aio, err);
+    
+    // wake up all other threads
+    cape_aio_context_close (self->aio, NULL);
+    
+    // joins all threads
+    cape_list_del (&workers);
+  }
   
   return res;
 }
 
 //-----------------------------------------------------------------------------
 
+int qbus_link (QBus self, QBus other, CapeErr err)
+{
+  int res;
+  EngineLocal engine;
+  
+  if (self == other)
+  {
+    return cape_err_set (err, CAPE_ERR_WRONG_VALUE, "instance can't be linked to itself");
+  }
+  
+  engine = qbus_engine_local_new (self->route, other->route);
+  
+  res = qbus_engine_local_connect (engine, err);
+  if (res)
+  {
+    qbus_engine_local_del (&engine);
+    return res;
+  }
+  
+  cape_list_push_back (self->engines_local, engine);
+  
+  return CAPE_ERR_NONE;
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_wait (QBus self, CapeUdc binds, CapeUdc remotes, CapeErr err)
 {
   int res;
@@ -306,22 +787,151 @@ int qbus_wait (QBus self, CapeUdc binds, CapeUdc remotes, CapeErr err)
 
 int qbus_register (QBus self, const char* method, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, CapeErr err)
 {
-  qbus_route_meth_reg (self->route, method, ptr, onMsg, onRm);
+  return qbus_route_meth_reg (self->route, method, ptr, onMsg, onRm, QBUS_EXEC_INLINE, 0, err);
+}
+
+//-----------------------------------------------------------------------------
 
+static int qbus_register__workers (QBus self, number_t policy, number_t* p_workers, CapeErr err)
+{
+  if (policy == QBUS_EXEC_SHARED)
+  {
+    if (*p_workers)
+    {
+      // all methods share one pool, a size per method can't be honoured
+      return cape_err_set (err, CAPE_ERR_WRONG_VALUE, "the shared pool is sized by the config 'workers', use a dedicated pool instead");
+    }
+    
+    *p_workers = qbus_config_n (self, "workers", 4);
+  }
+  
   return CAPE_ERR_NONE;
 }
 
 //-----------------------------------------------------------------------------
 
+int qbus_register_ex (QBus self, const char* method, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  if (qbus_register__workers (self, policy, &workers, err))
+  {
+    return cape_err_code (err);
+  }
+  
+  return qbus_route_meth_reg (self->route, method, ptr, onMsg, onRm, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_register_payload (QBus self, const char* method, void* ptr, fct_qbus_onPayload onPayload, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  if (qbus_register__workers (self, policy, &workers, err))
+  {
+    return cape_err_code (err);
+  }
+  
+  return qbus_route_meth_reg_payload (self->route, method, ptr, onPayload, onRm, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_register_raw (QBus self, const char* method, void* ptr, fct_qbus_onRaw onRaw, fct_qbus_onRemoved onRm, number_t policy, number_t workers, CapeErr err)
+{
+  if (qbus_register__workers (self, policy, &workers, err))
+  {
+    return cape_err_code (err);
+  }
+  
+  return qbus_route_meth_reg_raw (self->route, method, ptr, onRaw, onRm, policy, workers, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_send_raw (QBus self, const char* module, const char* method, number_t mtype, const char* bufdat, number_t buflen, void* ptr, fct_qbus_onRaw onRaw, fct_qbus_onRemoved onRm, CapeErr err)
+{
+  int res = qbus_route_request_raw (self->route, module, method, mtype, bufdat, buflen, ptr, onRaw, onRm, err);
+  
+  // the response will be delivered to the callback
+  if (res == CAPE_ERR_CONTINUE)
+  {
+    return CAPE_ERR_NONE;
+  }
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_response_raw (QBus self, const char* module, const char* chain_key, number_t mtype, const char* bufdat, number_t buflen, CapeErr err)
+{
+  return qbus_route_response_raw (self->route, module, chain_key, mtype, bufdat, buflen, err);
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_send (QBus self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, CapeErr err)
 {  
-  qbus_route_request (self->route, module, method, msg, ptr, onMsg, FALSE, err);
+  return qbus_send_ex (self, module, method, msg, ptr, onMsg, NULL, err);
+}
 
+//-----------------------------------------------------------------------------
+
+int qbus_send_ex (QBus self, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, CapeErr err)
+{
+  int res = qbus_route_request (self->route, module, method, msg, ptr, onMsg, onRm, FALSE, err);
+  
+  // the response will be delivered to the callback
+  if (res == CAPE_ERR_CONTINUE)
+  {
+    return CAPE_ERR_NONE;
+  }
+  
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_notify (QBus self, const char* module, const char* method, QBusM msg, CapeErr err)
+{
+  return qbus_route_notify (self->route, module, method, msg, err);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_subscribe (QBus self, const char* topic, void* ptr, fct_qbus_onMessage onMsg, fct_qbus_onRemoved onRm, CapeErr err)
+{
+  if (topic == NULL || *topic == '\0')
+  {
+    return cape_err_set (err, CAPE_ERR_WRONG_VALUE, "no topic");
+  }
+  
+  qbus_route_subscribe (self->route, topic, ptr, onMsg, onRm);
+  
   return CAPE_ERR_NONE;
 }
 
 //-----------------------------------------------------------------------------
 
+int qbus_publish (QBus self, const char* topic, QBusM msg, CapeErr err)
+{
+  return qbus_route_publish (self->route, topic, msg, err);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_send_async (QBus self, const char* module, const char* method, QBusM* p_msg, void* ptr, fct_qbus_onMessage onMsg, QBusCompletion cq)
+{
+  qbus_submit_add (self->submit, module, method, p_msg, ptr, onMsg, cq);
+}
+
+//-----------------------------------------------------------------------------
+
+int qbus_send_batch (QBus self, QBusBatch* p_batch, void* ptr, fct_qbus_onMessage onMsg, CapeErr err)
+{
+  return qbus_route_request_batch (self->route, p_batch, ptr, onMsg, err);
+}
+
+//-----------------------------------------------------------------------------
+
 int qbus_test_s (QBus self, const char* module, const char* method, CapeErr err)
 {  
     /*
@@ -339,15 +949,18 @@ int qbus_continue (QBus self, const char* module, const char* method, QBusM qin,
 {
   int res;
   
+  // the continued chain is registered with the key of the incoming request
+  qbus_message_chain_key (qin);
+  
   if (p_ptr)
   {
-    res = qbus_route_request (self->route, module, method, qin, *p_ptr, on_msg, TRUE, err);
+    res = qbus_route_request (self->route, module, method, qin, *p_ptr, on_msg, NULL, TRUE, err);
 
     *p_ptr = NULL;
   }
   else
   {
-    res = qbus_route_request (self->route, module, method, qin, NULL, on_msg, TRUE, err);
+    res = qbus_route_request (self->route, module, method, qin, NULL, on_msg, NULL, TRUE, err);
   }
     
   return res;
@@ -357,7 +970,7 @@ int qbus_continue (QBus self, const char* module, const char* method, QBusM qin,
 
 int qbus_response (QBus self, const char* module, QBusM msg, CapeErr err)
 {
-  qbus_route_response (self->route, module, msg, NULL);
+  qbus_route_response (self->route, module, msg, err);
   
   return CAPE_ERR_NONE;
 }
@@ -385,35 +998,100 @@ CapeUdc qbus_modules (QBus self)
 
 //-----------------------------------------------------------------------------
 
-QBusConnection const qbus_find_conn (QBus self, const char* module)
+QBusConnection qbus_find_conn (QBus self, const char* module)
 {
   return qbus_route_module_find (self->route, module);
 }
 
 //-----------------------------------------------------------------------------
 
+void qbus_conn_release (QBusConnection* p_conn)
+{
+  qbus_connection_dec (p_conn);
+}
+
+//-----------------------------------------------------------------------------
+
 void qbus_conn_request (QBus self, QBusConnection const conn, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage onMsg)
 {
-  qbus_route_conn_request (self->route, conn, module, method, msg, ptr, onMsg, FALSE);
+  qbus_route_conn_request (self->route, conn, module, method, msg, ptr, onMsg, NULL, FALSE);
 }
 
 //-----------------------------------------------------------------------------
 
-QBusM qbus_message_new (const CapeString key, const CapeString sender)
+#define QBUS_MESSAGE_POOL_SIZE   256
+
+static QBusM qbus_message_pool[QBUS_MESSAGE_POOL_SIZE];
+static number_t qbus_message_pool_used = 0;
+static int qbus_message_pool_lock = 0;
+
+//-----------------------------------------------------------------------------
+
+static void qbus_message_pool__lock (void)
 {
-  QBusM self = CAPE_NEW (struct QBusMessage_s);
+  // the pool is only held for a few instructions
+  while (__atomic_exchange_n (&qbus_message_pool_lock, 1, __ATOMIC_ACQUIRE))
+  {
+    // wait without writing to the cache line, give the holder a chance if it was preempted
+    while (__atomic_load_n (&qbus_message_pool_lock, __ATOMIC_RELAXED))
+    {
+#if defined __WINDOWS_OS
+      Sleep (0);
+#else
+      sched_yield ();
+#endif
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+static void qbus_message_pool__unlock (void)
+{
+  __atomic_store_n (&qbus_message_pool_lock, 0, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_message_pool_clr (void)
+{
+  qbus_message_pool__lock ();
   
-  if (key)
+  while (qbus_message_pool_used)
   {
-    // clone the key
-    self->chain_key = cape_str_cp (key);
+    qbus_message_pool_used--;
+    
+    CAPE_DEL (&(qbus_message_pool[qbus_message_pool_used]), struct QBusMessage_s);
   }
-  else
+  
+  qbus_message_pool__unlock ();
+}
+
+//-----------------------------------------------------------------------------
+
+QBusM qbus_message_new (const char* key, const char* sender)
+{
+  QBusM self = NULL;
+  
+  qbus_message_pool__lock ();
+  
+  if (qbus_message_pool_used)
+  {
+    qbus_message_pool_used--;
+    
+    self = qbus_message_pool[qbus_message_pool_used];
+  }
+  
+  qbus_message_pool__unlock ();
+  
+  if (self == NULL)
   {
-    // create a new key
-    self->chain_key = cape_str_uuid ();    
+    self = CAPE_NEW (struct QBusMessage_s);
   }
   
+  // clone the key, if there is no key it will be created when a chain needs one
+  self->chain_key = cape_str_cp (key);
+  
   self->sender = cape_str_cp (sender);
   
   // init the objects
@@ -422,6 +1100,7 @@ QBusM qbus_message_new (const CapeString key, const CapeString sender)
   self->clist = NULL;
   self->rinfo = NULL;
   self->files = NULL;
+  self->blobs = NULL;
   
   self->err = NULL;
   
@@ -458,11 +1137,105 @@ void qbus_message_del (QBusM* p_self)
   // only clear it here
   cape_udc_del (&(self->rinfo));
   cape_udc_del (&(self->files));
+  
+  // the local copies of the files are not needed anymore
+  qbus_blobs_del (&(self->blobs));
 
   cape_str_del (&(self->chain_key));
   cape_str_del (&(self->sender));
   
-  CAPE_DEL (p_self, struct QBusMessage_s);
+  // all members are released, the object can be reused as it is
+  qbus_message_pool__lock ();
+  
+  if (qbus_message_pool_used < QBUS_MESSAGE_POOL_SIZE)
+  {
+    qbus_message_pool[qbus_message_pool_used] = self;
+    qbus_message_pool_used++;
+    
+    self = NULL;
+  }
+  
+  qbus_message_pool__unlock ();
+  
+  if (self)
+  {
+    CAPE_DEL (p_self, struct QBusMessage_s);
+  }
+  else
+  {
+    *p_self = NULL;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+const CapeString qbus_message_chain_key (QBusM self)
+{
+  if (self->chain_key == NULL)
+  {
+    // only requests which are answered later need a key
+    self->chain_key = cape_str_uuid ();
+  }
+  
+  return self->chain_key;
+}
+
+//-----------------------------------------------------------------------------
+
+static void __STDCALL qbus_batch_items_del (void* ptr)
+{
+  QBusBatchItem item = ptr;
+  
+  cape_str_del (&(item->module));
+  cape_str_del (&(item->method));
+  
+  if (item->msg)
+  {
+    qbus_message_del (&(item->msg));
+  }
+  
+  CAPE_DEL (&item, struct QBusBatchItem_s);
+}
+
+//-----------------------------------------------------------------------------
+
+QBusBatch qbus_batch_new (void)
+{
+  QBusBatch self = CAPE_NEW (struct QBusBatch_s);
+  
+  self->items = cape_list_new (qbus_batch_items_del);
+  
+  return self;
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_batch_del (QBusBatch* p_self)
+{
+  if (*p_self)
+  {
+    QBusBatch self = *p_self;
+    
+    cape_list_del (&(self->items));
+    
+    CAPE_DEL (p_self, struct QBusBatch_s);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void qbus_batch_add (QBusBatch self, const char* module, const char* method, QBusM* p_msg)
+{
+  QBusBatchItem item = CAPE_NEW (struct QBusBatchItem_s);
+  
+  item->module = cape_str_cp (module);
+  item->method = cape_str_cp (method);
+  
+  // transfer ownership
+  item->msg = *p_msg;
+  *p_msg = NULL;
+  
+  cape_list_push_back (self->items, (void*)item);
 }
 
 //-----------------------------------------------------------------------------
@@ -4,6 +4,8 @@
 #include "sys/cape_export.h"
 #include "sys/cape_err.h"
 #include "stc/cape_udc.h"
+#include "stc/cape_list.h"
+#include "stc/cape_stream.h"
 #include "aio/cape_aio_ctx.h"
 
 //=============================================================================
@@ -18,6 +20,10 @@ __CAPE_LIBEX   void               qbus_del               (QBus*);
 
 __CAPE_LIBEX   int                qbus_wait              (QBus, CapeUdc bind, CapeUdc remotes, CapeErr);
 
+                 // links another instance of the same process without sockets, must be called before qbus_wait
+                 // the other instance must not be deleted before this one
+__CAPE_LIBEX   int                qbus_link              (QBus, QBus other, CapeErr);
+
 //-----------------------------------------------------------------------------
 
 #define QBUS_MTYPE_NONE         0
@@ -37,10 +43,14 @@ struct QBusMessage_s
   CapeUdc rinfo;
   
   CapeUdc files;    // if the content is too big, payload is stored in temporary files
+                    // with mtype QBUS_MTYPE_FILE the files are transferred and the receiver gets local copies
+                    // the local copies are removed with the message, small ones might only be valid inside this process
+  
+  struct QBusBlobs_s* blobs;   // received files, removed with the message
   
   CapeErr err;
   
-  CapeString chain_key;  // don't change this key
+  CapeString chain_key;  // don't change this key, use qbus_message_chain_key to get it
   
   CapeString sender;     // don't change this
   
@@ -51,12 +61,112 @@ struct QBusMessage_s
 typedef int    (__STDCALL         *fct_qbus_onMessage)   (QBus, void* ptr, QBusM qin, QBusM qout, CapeErr);
 typedef void   (__STDCALL         *fct_qbus_onRemoved)   (void* ptr);
 
+struct QBusRaw_s
+{
+  number_t mtype;
+  
+  const char* bufdat;      // the complete serialized payload, including 'rinfo' and errors
+  
+  number_t buflen;
+  
+  const char* chain_key;   // needed to respond later, if the handler continues
+  
+  const char* sender;
+  
+  CapeStream reply;        // the complete payload of the response, NULL in response callbacks
+  
+}; typedef struct QBusRaw_s* QBusRaw;
+
+typedef int    (__STDCALL         *fct_qbus_onRaw)       (QBus, void* ptr, QBusRaw, CapeErr);
+
+                 // bufdat is the JSON text of 'cdata', the JSON text of the output 'cdata' is appended to reply
+typedef int    (__STDCALL         *fct_qbus_onPayload)   (QBus, void* ptr, const char* bufdat, number_t buflen, CapeStream reply, CapeErr);
+
 //-----------------------------------------------------------------------------
 
 __CAPE_LIBEX   int                qbus_register          (QBus, const char* method, void* ptr, fct_qbus_onMessage, fct_qbus_onRemoved, CapeErr);
 
+#define QBUS_EXEC_INLINE        0    // the method runs on the I/O thread
+#define QBUS_EXEC_SHARED        1    // the method runs on the shared worker pool, size by config 'workers', 'workers' must be 0
+#define QBUS_EXEC_DEDICATED     2    // the method runs on its own worker pool with 'workers' threads
+
+__CAPE_LIBEX   int                qbus_register_ex       (QBus, const char* method, void* ptr, fct_qbus_onMessage, fct_qbus_onRemoved, number_t policy, number_t workers, CapeErr);
+
+                 // the handler works on the serialized payload, no UDC tree is built for remote requests
+__CAPE_LIBEX   int                qbus_register_payload  (QBus, const char* method, void* ptr, fct_qbus_onPayload, fct_qbus_onRemoved, number_t policy, number_t workers, CapeErr);
+
+                 // the handler gets the payload bytes as received and its reply is sent as it is
+__CAPE_LIBEX   int                qbus_register_raw      (QBus, const char* method, void* ptr, fct_qbus_onRaw, fct_qbus_onRemoved, number_t policy, number_t workers, CapeErr);
+
+                 // sends a serialized payload, the response is delivered serialized as well
+                 // onRemoved is called when the response handler is released, after the response or on shutdown
+__CAPE_LIBEX   int                qbus_send_raw          (QBus, const char* module, const char* method, number_t mtype, const char* bufdat, number_t buflen, void* ptr, fct_qbus_onRaw, fct_qbus_onRemoved, CapeErr);
+
+                 // answers a raw request which returned CAPE_ERR_CONTINUE
+__CAPE_LIBEX   int                qbus_response_raw      (QBus, const char* module, const char* chain_key, number_t mtype, const char* bufdat, number_t buflen, CapeErr);
+
 __CAPE_LIBEX   int                qbus_send              (QBus, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage, CapeErr);
 
+                 // same as qbus_send, onRemoved is called when the response handler is released, after the response or on shutdown
+__CAPE_LIBEX   int                qbus_send_ex           (QBus, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage, fct_qbus_onRemoved, CapeErr);
+
+__CAPE_LIBEX   int                qbus_notify            (QBus, const char* module, const char* method, QBusM msg, CapeErr);   // one-way, no response
+
+__CAPE_LIBEX   int                qbus_subscribe         (QBus, const char* topic, void* ptr, fct_qbus_onMessage, fct_qbus_onRemoved, CapeErr);
+
+__CAPE_LIBEX   int                qbus_publish           (QBus, const char* topic, QBusM msg, CapeErr);   // one-way to all subscribers
+
+//-----------------------------------------------------------------------------
+// send from any thread
+
+struct QBusCompletion_s; typedef struct QBusCompletion_s* QBusCompletion;
+
+__CAPE_LIBEX   QBusCompletion     qbus_completion_new    (CapeErr);
+
+__CAPE_LIBEX   void               qbus_completion_del    (QBusCompletion*);
+
+                   // becomes readable if responses are waiting
+__CAPE_LIBEX   void*              qbus_completion_handle (QBusCompletion);
+
+                   // runs all waiting response callbacks in the calling thread
+__CAPE_LIBEX   number_t           qbus_completion_poll   (QBusCompletion);
+
+                   // thread-safe, takes ownership of the message, without completion the callback runs on the I/O thread
+__CAPE_LIBEX   void               qbus_send_async        (QBus, const char* module, const char* method, QBusM* p_msg, void* ptr, fct_qbus_onMessage, QBusCompletion);
+
+//-----------------------------------------------------------------------------
+
+struct QBusBatchItem_s
+{
+  CapeString module;
+  
+  CapeString method;
+  
+  QBusM msg;
+  
+}; typedef struct QBusBatchItem_s* QBusBatchItem;
+
+struct QBusBatch_s
+{
+  CapeList items;   // list of QBusBatchItem
+  
+}; typedef struct QBusBatch_s* QBusBatch;
+
+//-----------------------------------------------------------------------------
+
+__CAPE_LIBEX   QBusBatch          qbus_batch_new         (void);
+
+__CAPE_LIBEX   void               qbus_batch_del         (QBusBatch*);
+
+__CAPE_LIBEX   void               qbus_batch_add         (QBusBatch, const char* module, const char* method, QBusM* p_msg);   // takes ownership of the message
+
+                 // all calls to the same module are packed into one frame, which takes one connection to the module
+                 // the callback is called once, qin->clist contains one result node per call in the same order
+                 // calls without a method get an error node
+__CAPE_LIBEX   int                qbus_send_batch        (QBus, QBusBatch*, void* ptr, fct_qbus_onMessage, CapeErr);
+
+//-----------------------------------------------------------------------------
+
 __CAPE_LIBEX   int                qbus_test_s           (QBus, const char* module, const char* method, CapeErr);   // Called from java with JNI
 
 __CAPE_LIBEX   int                qbus_continue          (QBus, const char* module, const char* method, QBusM qin, void** p_ptr, fct_qbus_onMessage, CapeErr);
@@ -87,16 +197,26 @@ struct QBusConnection_s; typedef struct QBusConnection_s* QBusConnection;
 
 //-----------------------------------------------------------------------------
 
-__CAPE_LIBEX   QBusConnection const  qbus_find_conn      (QBus, const char* module);
+                 // returns a reference to the connection, release it with qbus_conn_release
+__CAPE_LIBEX   QBusConnection     qbus_find_conn         (QBus, const char* module);
+
+__CAPE_LIBEX   void               qbus_conn_release      (QBusConnection*);
 
 __CAPE_LIBEX   void               qbus_conn_request      (QBus, QBusConnection const, const char* module, const char* method, QBusM msg, void* ptr, fct_qbus_onMessage);
 
 //-----------------------------------------------------------------------------
 
-__CAPE_LIBEX   QBusM              qbus_message_new       (const CapeString key, const CapeString sender);
+                 // the message object is taken from a pool, without a key the chain_key stays NULL until a chain needs it
+__CAPE_LIBEX   QBusM              qbus_message_new       (const char* key, const char* sender);
 
 __CAPE_LIBEX   void               qbus_message_del       (QBusM*);
 
+                 // returns the key to continue or respond later, local requests get their key only here
+__CAPE_LIBEX   const CapeString   qbus_message_chain_key (QBusM);
+
+                 // releases all pooled message objects, done by qbus_del of the last instance
+__CAPE_LIBEX   void               qbus_message_pool_clr  (void);
+
 __CAPE_LIBEX   void               qbus_message_clr       (QBusM, u_t cdata_udc_type);
 
 //-----------------------------------------------------------------------------
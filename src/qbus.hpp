@@ -3,9 +3,23 @@
 
 // STL includes
 #include <stdexcept>
+#include <string>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define QBUS_COROUTINES 1
+#include <coroutine>
+#include <atomic>
+#endif
 
 // cape includes
 #include <hpp/cape_stc.hpp>
+#include <sys/cape_log.h>
 
 // qbus include
 #include <qbus.h>
@@ -75,6 +89,9 @@ namespace qbus
     
     int ret () { return m_ret; }
     
+    // the response will be sent later, keep the returned values to send it
+    void set_deferred () { m_ret = CAPE_ERR_CONTINUE; }
+    
   private:
     
     QBus m_qbus;
@@ -89,6 +106,1350 @@ namespace qbus
     
   };
   
+  //-----------------------------------------------------------------------------
+  
+  // outgoing message, owns the message object and moves its content into the frame
+  
+  class Request
+  {
+    
+  public:
+    
+    Request () : m_msg (qbus_message_new (NULL, NULL))
+    {
+      m_msg->mtype = QBUS_MTYPE_JSON;
+    }
+    
+    explicit Request (cape::Udc& content) : Request ()
+    {
+      cdata (content);
+    }
+    
+    Request (Request&& rhs) noexcept : m_msg (rhs.m_msg)
+    {
+      rhs.m_msg = NULL;
+    }
+    
+    Request& operator= (Request&& rhs) noexcept
+    {
+      if (this != &rhs)
+      {
+        release ();
+        
+        m_msg = rhs.m_msg;
+        rhs.m_msg = NULL;
+      }
+      
+      return *this;
+    }
+    
+    Request (const Request&) = delete;
+    
+    Request& operator= (const Request&) = delete;
+    
+    ~Request ()
+    {
+      release ();
+    }
+    
+    // takes over the content, no copy
+    Request& cdata (cape::Udc& content)
+    {
+      cape_udc_del (&(m_msg->cdata));
+      m_msg->cdata = content.release();
+      
+      return *this;
+    }
+    
+    Request& pdata (cape::Udc& content)
+    {
+      cape_udc_del (&(m_msg->pdata));
+      m_msg->pdata = content.release();
+      
+      return *this;
+    }
+    
+    QBusM msg ()
+    {
+      if (m_msg == NULL)
+      {
+        throw std::runtime_error ("request was moved");
+      }
+      
+      return m_msg;
+    }
+    
+  private:
+    
+    void release ()
+    {
+      if (m_msg)
+      {
+        qbus_message_del (&m_msg);
+      }
+    }
+    
+    QBusM m_msg;
+    
+  };
+  
+  //-----------------------------------------------------------------------------
+  
+  // incoming response, only valid within the callback
+  
+  class Response
+  {
+    
+  public:
+    
+    Response (QBusM qin) : m_qin (qin) {}
+    
+    bool ok () const { return m_qin->err == NULL; }
+    
+    number_t code () const { return m_qin->err ? cape_err_code (m_qin->err) : CAPE_ERR_NONE; }
+    
+    const char* text () const { return m_qin->err ? cape_err_text (m_qin->err) : ""; }
+    
+    // moves the content out of the response, no copy
+    cape::Udc take ()
+    {
+      if (m_qin->err)
+      {
+        throw std::runtime_error (cape_err_text (m_qin->err));
+      }
+      
+      CapeUdc h = m_qin->cdata;
+      m_qin->cdata = NULL;
+      
+      return cape::Udc (&h);
+    }
+    
+    QBusM qin () { return m_qin; }
+    
+  private:
+    
+    QBusM m_qin;
+    
+  };
+  
+  //-----------------------------------------------------------------------------
+  
+  namespace detail
+  {
+    // small trivially copyable callables like lambdas capturing a pointer are kept in the context pointer itself
+    template <typename T> struct callable_inplace : std::integral_constant<bool, sizeof (T) <= sizeof (void*) && alignof (T) <= alignof (void*) && std::is_trivially_copyable<T>::value> {};
+    
+    template <typename T, typename F> void* callable_store (F&& fct, std::true_type)
+    {
+      void* ptr = NULL;
+      
+      T h (std::forward<F>(fct));
+      std::memcpy (&ptr, &h, sizeof (T));
+      
+      return ptr;
+    }
+    
+    template <typename T, typename F> void* callable_store (F&& fct, std::false_type)
+    {
+      return new T (std::forward<F>(fct));
+    }
+    
+    template <typename T, typename F> void* callable_store (F&& fct)
+    {
+      return callable_store<T> (std::forward<F>(fct), callable_inplace<T>());
+    }
+    
+    template <typename T> T& callable_get (void*& ptr, std::true_type)
+    {
+      return *reinterpret_cast<T*>(&ptr);
+    }
+    
+    template <typename T> T& callable_get (void*& ptr, std::false_type)
+    {
+      return *static_cast<T*>(ptr);
+    }
+    
+    template <typename T> T& callable_get (void*& ptr)
+    {
+      return callable_get<T> (ptr, callable_inplace<T>());
+    }
+    
+    template <typename T> void callable_release (void* ptr)
+    {
+      if (!callable_inplace<T>::value)
+      {
+        delete static_cast<T*>(ptr);
+      }
+    }
+  }
+  
+  //-----------------------------------------------------------------------------
+  
+  // typed messages, the struct declares its fields and is encoded / decoded directly from the JSON text
+  //
+  //   struct Order
+  //   {
+  //     std::string id;
+  //     number_t amount;
+  //     std::vector<Item> items;
+  //
+  //     QBUS_SCHEMA (QBUS_FIELD (id) QBUS_FIELD (amount) QBUS_FIELD (items))
+  //   };
+  
+#define QBUS_SCHEMA(fields)          template <typename V> void qbus_schema (V& qbus_visitor) { fields }
+#define QBUS_FIELD(name)             qbus_visitor (#name, name);
+#define QBUS_FIELD_AS(key, name)     qbus_visitor (key, name);
+  
+  namespace schema
+  {
+    
+    //-----------------------------------------------------------------------------
+    
+    class Encoder
+    {
+      
+    public:
+      
+      Encoder (CapeStream cs) : m_cs (cs), m_first (true) {}
+      
+      template <typename T> void operator() (const char* name, T& field)
+      {
+        if (!m_first)
+        {
+          cape_stream_append_c (m_cs, ',');
+        }
+        
+        m_first = false;
+        
+        write_string (name, strlen (name));
+        cape_stream_append_c (m_cs, ':');
+        
+        write (field);
+      }
+      
+      template <typename T> void object (T& obj)
+      {
+        bool first = m_first;
+        
+        m_first = true;
+        
+        cape_stream_append_c (m_cs, '{');
+        obj.qbus_schema (*this);
+        cape_stream_append_c (m_cs, '}');
+        
+        m_first = first;
+      }
+      
+      void write (std::string& value)
+      {
+        write_string (value.data(), value.size());
+      }
+      
+      void write (bool& value)
+      {
+        cape_stream_append_str (m_cs, value ? "true" : "false");
+      }
+      
+      template <typename T> typename std::enable_if<std::is_integral<T>::value>::type write (T& value)
+      {
+        char buf[32];
+        
+        if (std::is_signed<T>::value)
+        {
+          snprintf (buf, sizeof (buf), "%lld", (long long)value);
+        }
+        else
+        {
+          snprintf (buf, sizeof (buf), "%llu", (unsigned long long)value);
+        }
+        
+        cape_stream_append_str (m_cs, buf);
+      }
+      
+      template <typename T> typename std::enable_if<std::is_floating_point<T>::value>::type write (T& value)
+      {
+        char buf[32];
+        
+        if (value != value || value - value != 0)
+        {
+          // JSON has no NaN or infinity
+          cape_stream_append_str (m_cs, "null");
+          return;
+        }
+        
+        snprintf (buf, sizeof (buf), "%.17g", (double)value);
+        
+        cape_stream_append_str (m_cs, buf);
+      }
+      
+      template <typename T> void write (std::vector<T>& value)
+      {
+        cape_stream_append_c (m_cs, '[');
+        
+        for (size_t i = 0; i < value.size(); i++)
+        {
+          if (i)
+          {
+            cape_stream_append_c (m_cs, ',');
+          }
+          
+          write (value[i]);
+        }
+        
+        cape_stream_append_c (m_cs, ']');
+      }
+      
+      // vector<bool> stores bits and has no element references
+      void write (std::vector<bool>& value)
+      {
+        cape_stream_append_c (m_cs, '[');
+        
+        for (size_t i = 0; i < value.size(); i++)
+        {
+          if (i)
+          {
+            cape_stream_append_c (m_cs, ',');
+          }
+          
+          cape_stream_append_str (m_cs, value[i] ? "true" : "false");
+        }
+        
+        cape_stream_append_c (m_cs, ']');
+      }
+      
+      template <typename T> typename std::enable_if<std::is_class<T>::value>::type write (T& value)
+      {
+        object (value);
+      }
+      
+    private:
+      
+      void write_string (const char* bufdat, size_t buflen)
+      {
+        cape_stream_append_c (m_cs, '"');
+        
+        for (size_t i = 0; i < buflen; i++)
+        {
+          unsigned char c = bufdat[i];
+          
+          switch (c)
+          {
+            case '"':  cape_stream_append_str (m_cs, "\\\""); break;
+            case '\\': cape_stream_append_str (m_cs, "\\\\"); break;
+            case '\n': cape_stream_append_str (m_cs, "\\n"); break;
+            case '\r': cape_stream_append_str (m_cs, "\\r"); break;
+            case '\t': cape_stream_append_str (m_cs, "\\t"); break;
+            default:
+            {
+              if (c < 0x20)
+              {
+                char buf[8];
+                
+                snprintf (buf, sizeof (buf), "\\u%04x", c);
+                cape_stream_append_str (m_cs, buf);
+              }
+              else
+              {
+                cape_stream_append_c (m_cs, (char)c);
+              }
+              
+              break;
+            }
+          }
+        }
+        
+        cape_stream_append_c (m_cs, '"');
+      }
+      
+      CapeStream m_cs;
+      
+      bool m_first;
+      
+    };
+    
+    //-----------------------------------------------------------------------------
+    
+    class Decoder
+    {
+      
+    public:
+      
+      // the text must be followed by a terminating character, which is always the case for frames
+      Decoder (const char* bufdat, size_t buflen) : m_pos (bufdat), m_end (bufdat + buflen), m_obj_begin (NULL), m_obj_end (NULL), m_cursor (NULL) {}
+      
+      template <typename T> void operator() (const char* name, T& field)
+      {
+        const char* val = find (name);
+        
+        if (val)
+        {
+          m_pos = val;
+          
+          read (field);
+        }
+      }
+      
+      template <typename T> void object (T& obj)
+      {
+        const char* obj_begin = m_obj_begin;
+        const char* obj_end = m_obj_end;
+        const char* cursor = m_cursor;
+        
+        ws ();
+        
+        if (m_pos >= m_end || *m_pos != '{')
+        {
+          throw std::runtime_error ("schema: object expected");
+        }
+        
+        m_obj_begin = m_pos + 1;
+        m_obj_end = skip (m_pos);
+        m_cursor = m_obj_begin;
+        
+        obj.qbus_schema (*this);
+        
+        m_pos = m_obj_end;
+        
+        m_obj_begin = obj_begin;
+        m_obj_end = obj_end;
+        m_cursor = cursor;
+      }
+      
+      void read (std::string& value)
+      {
+        ws ();
+        
+        if (null ())
+        {
+          value.clear ();
+          return;
+        }
+        
+        if (m_pos >= m_end || *m_pos != '"')
+        {
+          throw std::runtime_error ("schema: string expected");
+        }
+        
+        value.clear ();
+        
+        for (m_pos++; m_pos < m_end && *m_pos != '"'; m_pos++)
+        {
+          if (*m_pos != '\\')
+          {
+            value += *m_pos;
+            continue;
+          }
+          
+          if (++m_pos >= m_end)
+          {
+            break;
+          }
+          
+          switch (*m_pos)
+          {
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'u': utf8 (value); break;
+            default:  value += *m_pos; break;
+          }
+        }
+        
+        m_pos++;
+      }
+      
+      void read (bool& value)
+      {
+        ws ();
+        
+        if (m_end - m_pos >= 4 && strncmp (m_pos, "true", 4) == 0)
+        {
+          value = true;
+        }
+        else if (m_end - m_pos >= 5 && strncmp (m_pos, "false", 5) == 0)
+        {
+          value = false;
+        }
+        else if (!null ())
+        {
+          throw std::runtime_error ("schema: boolean expected");
+        }
+      }
+      
+      template <typename T> typename std::enable_if<std::is_integral<T>::value>::type read (T& value)
+      {
+        char* num_end;
+        
+        ws ();
+        
+        if (null ())
+        {
+          return;
+        }
+        
+        if (std::is_signed<T>::value)
+        {
+          value = (T)strtoll (m_pos, &num_end, 10);
+        }
+        else
+        {
+          value = (T)strtoull (m_pos, &num_end, 10);
+        }
+        
+        if (num_end == m_pos)
+        {
+          throw std::runtime_error ("schema: number expected");
+        }
+        
+        if (*num_end == '.' || *num_end == 'e' || *num_end == 'E')
+        {
+          // written as floating point number
+          value = (T)strtod (m_pos, &num_end);
+        }
+        
+        m_pos = num_end;
+      }
+      
+      template <typename T> typename std::enable_if<std::is_floating_point<T>::value>::type read (T& value)
+      {
+        char* num_end;
+        
+        ws ();
+        
+        if (null ())
+        {
+          return;
+        }
+        
+        value = (T)strtod (m_pos, &num_end);
+        
+        if (num_end == m_pos)
+        {
+          throw std::runtime_error ("schema: number expected");
+        }
+        
+        m_pos = num_end;
+      }
+      
+      template <typename T> void read (std::vector<T>& value)
+      {
+        ws ();
+        
+        value.clear ();
+        
+        if (null ())
+        {
+          return;
+        }
+        
+        if (m_pos >= m_end || *m_pos != '[')
+        {
+          throw std::runtime_error ("schema: array expected");
+        }
+        
+        for (m_pos++; ws (), m_pos < m_end && *m_pos != ']'; )
+        {
+          const char* next = skip (m_pos);
+          
+          value.push_back (T ());
+          read (value.back ());
+          
+          m_pos = next;
+          ws ();
+          
+          if (m_pos < m_end && *m_pos == ',')
+          {
+            m_pos++;
+          }
+        }
+        
+        m_pos++;
+      }
+      
+      // vector<bool> stores bits and has no element references
+      void read (std::vector<bool>& value)
+      {
+        ws ();
+        
+        value.clear ();
+        
+        if (null ())
+        {
+          return;
+        }
+        
+        if (m_pos >= m_end || *m_pos != '[')
+        {
+          throw std::runtime_error ("schema: array expected");
+        }
+        
+        for (m_pos++; ws (), m_pos < m_end && *m_pos != ']'; )
+        {
+          const char* next = skip (m_pos);
+          
+          bool item = false;
+          
+          read (item);
+          value.push_back (item);
+          
+          m_pos = next;
+          ws ();
+          
+          if (m_pos < m_end && *m_pos == ',')
+          {
+            m_pos++;
+          }
+        }
+        
+        m_pos++;
+      }
+      
+      template <typename T> typename std::enable_if<std::is_class<T>::value>::type read (T& value)
+      {
+        ws ();
+        
+        if (!null ())
+        {
+          object (value);
+        }
+      }
+      
+    private:
+      
+      void ws ()
+      {
+        while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r' || *m_pos == '\n'))
+        {
+          m_pos++;
+        }
+      }
+      
+      bool null ()
+      {
+        if (m_end - m_pos >= 4 && strncmp (m_pos, "null", 4) == 0)
+        {
+          m_pos += 4;
+          return true;
+        }
+        
+        return false;
+      }
+      
+      // returns the position behind the value
+      const char* skip (const char* pos) const
+      {
+        int depth = 0;
+        
+        while (pos < m_end)
+        {
+          switch (*pos)
+          {
+            case '"':
+            {
+              for (pos++; pos < m_end && *pos != '"'; pos++)
+              {
+                if (*pos == '\\')
+                {
+                  pos++;
+                }
+              }
+              
+              if (depth == 0)
+              {
+                return pos + 1;
+              }
+              
+              break;
+            }
+            case '{': case '[':
+            {
+              depth++;
+              break;
+            }
+            case '}': case ']':
+            {
+              if (depth == 0)
+              {
+                return pos;
+              }
+              
+              if (--depth == 0)
+              {
+                return pos + 1;
+              }
+              
+              break;
+            }
+            case ',':
+            {
+              if (depth == 0)
+              {
+                return pos;
+              }
+              
+              break;
+            }
+          }
+          
+          pos++;
+        }
+        
+        return pos;
+      }
+      
+      // scans the members from the last match on, fields are mostly in the same order as written
+      const char* find (const char* name)
+      {
+        size_t name_len = strlen (name);
+        
+        const char* start = m_cursor;
+        const char* pos = m_cursor;
+        
+        bool wrapped = false;
+        
+        while (true)
+        {
+          if (wrapped && pos >= start)
+          {
+            return NULL;
+          }
+          
+          m_pos = pos;
+          ws ();
+          
+          if (m_pos < m_obj_end && *m_pos == '"')
+          {
+            const char* key = m_pos + 1;
+            const char* key_end = skip (m_pos) - 1;
+            const char* val;
+            
+            m_pos = key_end + 1;
+            ws ();
+            
+            if (m_pos >= m_obj_end || *m_pos != ':')
+            {
+              throw std::runtime_error ("schema: invalid object");
+            }
+            
+            m_pos++;
+            ws ();
+            
+            val = m_pos;
+            pos = skip (val);
+            
+            m_pos = pos;
+            ws ();
+            
+            if (m_pos < m_obj_end && *m_pos == ',')
+            {
+              m_pos++;
+            }
+            
+            if ((size_t)(key_end - key) == name_len && strncmp (key, name, name_len) == 0)
+            {
+              m_cursor = m_pos;
+              return val;
+            }
+            
+            pos = m_pos;
+          }
+          else if (wrapped || start == m_obj_begin)
+          {
+            return NULL;
+          }
+          else
+          {
+            wrapped = true;
+            pos = m_obj_begin;
+          }
+        }
+      }
+      
+      void utf8 (std::string& value)
+      {
+        unsigned long cp = 0;
+        
+        if (m_end - m_pos < 5)
+        {
+          throw std::runtime_error ("schema: invalid escape");
+        }
+        
+        cp = strtoul (std::string (m_pos + 1, 4).c_str(), NULL, 16);
+        m_pos += 4;
+        
+        // surrogate pair
+        if (cp >= 0xD800 && cp <= 0xDBFF && m_end - m_pos >= 7 && m_pos[1] == '\\' && m_pos[2] == 'u')
+        {
+          unsigned long low = strtoul (std::string (m_pos + 3, 4).c_str(), NULL, 16);
+          
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          m_pos += 6;
+        }
+        
+        if (cp < 0x80)
+        {
+          value += (char)cp;
+        }
+        else if (cp < 0x800)
+        {
+          value += (char)(0xC0 | (cp >> 6));
+          value += (char)(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+          value += (char)(0xE0 | (cp >> 12));
+          value += (char)(0x80 | ((cp >> 6) & 0x3F));
+          value += (char)(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+          value += (char)(0xF0 | (cp >> 18));
+          value += (char)(0x80 | ((cp >> 12) & 0x3F));
+          value += (char)(0x80 | ((cp >> 6) & 0x3F));
+          value += (char)(0x80 | (cp & 0x3F));
+        }
+      }
+      
+      const char* m_pos;
+      
+      const char* m_end;
+      
+      const char* m_obj_begin;
+      
+      const char* m_obj_end;
+      
+      const char* m_cursor;
+      
+    };
+    
+    //-----------------------------------------------------------------------------
+    
+    template <typename T> void encode (T& obj, CapeStream cs)
+    {
+      Encoder encoder (cs);
+      
+      encoder.object (obj);
+    }
+    
+    // an empty text leaves all fields with their defaults
+    template <typename T> void decode (T& obj, const char* bufdat, number_t buflen)
+    {
+      if (bufdat && buflen)
+      {
+        Decoder decoder (bufdat, buflen);
+        
+        decoder.read (obj);
+      }
+    }
+    
+  }
+  
+  //-----------------------------------------------------------------------------
+  
+  // sends the response of a deferred message
+  
+  class Responder
+  {
+    
+  public:
+    
+    Responder (Message& msg) : m_qbus (msg.qbus()), m_chain_key (qbus_message_chain_key (msg.qin())), m_sender (msg.qin()->sender)
+    {
+      msg.set_deferred ();
+    }
+    
+    void send (cape::Udc& content)
+    {
+      QBusM qout = qbus_message_new (m_chain_key.c_str(), NULL);
+      
+      qout->mtype = QBUS_MTYPE_JSON;
+      qout->cdata = content.release();
+      
+      qbus_response (m_qbus, m_sender.c_str(), qout, NULL);
+      
+      qbus_message_del (&qout);
+    }
+    
+    void fail (number_t code, const char* text)
+    {
+      QBusM qout = qbus_message_new (m_chain_key.c_str(), NULL);
+      
+      qout->err = cape_err_new ();
+      cape_err_set (qout->err, code, text);
+      
+      qbus_response (m_qbus, m_sender.c_str(), qout, qout->err);
+      
+      qbus_message_del (&qout);
+    }
+    
+  private:
+    
+    QBus m_qbus;
+    
+    std::string m_chain_key;
+    
+    std::string m_sender;
+    
+  };
+  
+#ifdef QBUS_COROUTINES
+  
+  //-----------------------------------------------------------------------------
+  
+  // fire and forget coroutine, the frame is released when the coroutine ends
+  
+  struct Task
+  {
+    struct promise_type
+    {
+      Task get_return_object () { return {}; }
+      
+      std::suspend_never initial_suspend () noexcept { return {}; }
+      
+      std::suspend_never final_suspend () noexcept { return {}; }
+      
+      void return_void () {}
+      
+      void unhandled_exception ()
+      {
+        try
+        {
+          throw;
+        }
+        catch (std::exception& e)
+        {
+          cape_log_fmt (CAPE_LL_ERROR, "QBUS", "coroutine", "unhandled exception: %s", e.what());
+        }
+        catch (...)
+        {
+          cape_log_msg (CAPE_LL_ERROR, "QBUS", "coroutine", "unhandled exception");
+        }
+      }
+    };
+  };
+  
+  //-----------------------------------------------------------------------------
+  
+  // awaitable for one request, lives in the coroutine frame
+  
+  class Call
+  {
+    
+  public:
+    
+    Call (QBus qbus, const char* module, const char* method, cape::Udc& content) : m_qbus (qbus), m_module (module), m_method (method), m_content (content.release()), m_result (NULL), m_err (cape_err_new ()), m_ready (false) {}
+    
+    ~Call ()
+    {
+      cape_udc_del (&m_content);
+      cape_udc_del (&m_result);
+      cape_err_del (&m_err);
+    }
+    
+    Call (const Call&) = delete;
+    
+    Call& operator= (const Call&) = delete;
+    
+    bool await_ready () const noexcept { return false; }
+    
+    bool await_suspend (std::coroutine_handle<> handle)
+    {
+      m_handle = handle;
+      
+      {
+        CapeErr err = cape_err_new ();
+        
+        QBusM msg = qbus_message_new (NULL, NULL);
+        
+        msg->cdata = m_content;
+        m_content = NULL;
+        
+        qbus_send (m_qbus, m_module.c_str(), m_method.c_str(), msg, this, Call::on_message, err);
+        
+        qbus_message_del (&msg);
+        
+        if (cape_err_code (err))
+        {
+          cape_err_set (m_err, cape_err_code (err), cape_err_text (err));
+          cape_err_del (&err);
+          
+          // the request was not sent, no response will come
+          return false;
+        }
+        
+        cape_err_del (&err);
+      }
+      
+      // if the response arrived already, don't suspend
+      return !m_ready.exchange (true);
+    }
+    
+    cape::Udc await_resume ()
+    {
+      if (cape_err_code (m_err))
+      {
+        throw std::runtime_error (cape_err_text (m_err));
+      }
+      
+      return cape::Udc (&m_result);
+    }
+    
+  private:
+    
+    static int __STDCALL on_message (QBus qbus, void* ptr, QBusM qin, QBusM qout, CapeErr err)
+    {
+      Call* self = static_cast<Call*>(ptr);
+      
+      if (qin->err)
+      {
+        cape_err_set (self->m_err, cape_err_code (qin->err), cape_err_text (qin->err));
+      }
+      else
+      {
+        // transfer ownership
+        self->m_result = qin->cdata;
+        qin->cdata = NULL;
+      }
+      
+      // resume on the thread which delivered the response
+      if (self->m_ready.exchange (true))
+      {
+        self->m_handle.resume ();
+      }
+      
+      return CAPE_ERR_NONE;
+    }
+    
+    QBus m_qbus;
+    
+    std::string m_module;
+    
+    std::string m_method;
+    
+    CapeUdc m_content;
+    
+    CapeUdc m_result;
+    
+    CapeErr m_err;
+    
+    std::atomic<bool> m_ready;
+    
+    std::coroutine_handle<> m_handle;
+    
+  };
+  
+#endif
+  
+  //-----------------------------------------------------------------------------
+  
+  class Bus
+  {
+    
+  public:
+    
+    Bus (QBus qbus) : m_qbus (qbus) {}
+    
+    // bus.on ("method", [](qbus::Message& msg) { ... })
+    template <typename F> void on (const char* method, F&& fct, number_t policy = QBUS_EXEC_INLINE, number_t workers = 0)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      CapeErr err = cape_err_new ();
+      
+      void* ptr = detail::callable_store<T> (std::forward<F>(fct));
+      
+      int res = qbus_register_ex (m_qbus, method, ptr, Bus::on_request<T>, Bus::on_removed<T>, policy, workers, err);
+      if (res)
+      {
+        // the method was not registered, the removed callback won't be called
+        detail::callable_release<T> (ptr);
+        
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // bus.subscribe ("topic", [](qbus::Message& msg) { ... })
+    template <typename F> void subscribe (const char* topic, F&& fct)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      CapeErr err = cape_err_new ();
+      
+      void* ptr = detail::callable_store<T> (std::forward<F>(fct));
+      
+      int res = qbus_subscribe (m_qbus, topic, ptr, Bus::on_request<T>, Bus::on_removed<T>, err);
+      if (res)
+      {
+        // the topic was not subscribed, the removed callback won't be called
+        detail::callable_release<T> (ptr);
+        
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // bus.on_typed<In, Out> ("method", [](In& in, Out& out) { ... }), both types declare a QBUS_SCHEMA
+    template <typename I, typename O, typename F> void on_typed (const char* method, F&& fct, number_t policy = QBUS_EXEC_INLINE, number_t workers = 0)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      CapeErr err = cape_err_new ();
+      
+      void* ptr = detail::callable_store<T> (std::forward<F>(fct));
+      
+      int res = qbus_register_payload (m_qbus, method, ptr, Bus::on_payload<I, O, T>, Bus::on_removed<T>, policy, workers, err);
+      if (res)
+      {
+        detail::callable_release<T> (ptr);
+        
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // bus.on_raw ("method", [](QBusRaw raw) { ...; return CAPE_ERR_NONE; }), the reply is appended to raw->reply
+    template <typename F> void on_raw (const char* method, F&& fct, number_t policy = QBUS_EXEC_INLINE, number_t workers = 0)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      CapeErr err = cape_err_new ();
+      
+      void* ptr = detail::callable_store<T> (std::forward<F>(fct));
+      
+      int res = qbus_register_raw (m_qbus, method, ptr, Bus::on_raw_request<T>, Bus::on_removed<T>, policy, workers, err);
+      if (res)
+      {
+        detail::callable_release<T> (ptr);
+        
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // bus.send_raw ("MODULE", "method", QBUS_MTYPE_JSON, bufdat, buflen, [](QBusRaw raw) { ... })
+    template <typename F> void send_raw (const char* module, const char* method, number_t mtype, const char* bufdat, number_t buflen, F&& fct)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      CapeErr err = cape_err_new ();
+      
+      // the callback is called exactly once, even if there is no route
+      // it is released with the response handler, which also happens on shutdown
+      int res = qbus_send_raw (m_qbus, module, method, mtype, bufdat, buflen, detail::callable_store<T> (std::forward<F>(fct)), Bus::on_raw_response<T>, Bus::on_removed<T>, err);
+      if (res)
+      {
+        // the callback got the error as well
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // answers a raw request which returned CAPE_ERR_CONTINUE, sender and chain key must be copied from the request
+    void response_raw (const char* module, const char* chain_key, number_t mtype, const char* bufdat, number_t buflen)
+    {
+      CapeErr err = cape_err_new ();
+      
+      int res = qbus_response_raw (m_qbus, module, chain_key, mtype, bufdat, buflen, err);
+      if (res)
+      {
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    // bus.send ("MODULE", "method", std::move (request), [](qbus::Response& res) { ... })
+    template <typename F> void send (const char* module, const char* method, Request&& request, F&& fct)
+    {
+      typedef typename std::decay<F>::type T;
+      
+      Request req (std::move (request));
+      
+      CapeErr err = cape_err_new ();
+      
+      // the callback is called exactly once, even if there is no route
+      // it is released with the response handler, which also happens on shutdown
+      int res = qbus_send_ex (m_qbus, module, method, req.msg(), detail::callable_store<T> (std::forward<F>(fct)), Bus::on_response<T>, Bus::on_removed<T>, err);
+      if (res)
+      {
+        // the callback got the error as well
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    void notify (const char* module, const char* method, Request&& request)
+    {
+      Request req (std::move (request));
+      
+      CapeErr err = cape_err_new ();
+      
+      int res = qbus_notify (m_qbus, module, method, req.msg(), err);
+      if (res)
+      {
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+    void publish (const char* topic, Request&& request)
+    {
+      Request req (std::move (request));
+      
+      CapeErr err = cape_err_new ();
+      
+      int res = qbus_publish (m_qbus, topic, req.msg(), err);
+      if (res)
+      {
+        throw_err (err);
+      }
+      
+      cape_err_del (&err);
+    }
+    
+#ifdef QBUS_COROUTINES
+    
+    // co_await bus.call ("MODULE", "method", content)
+    Call call (const char* module, const char* method, cape::Udc& content)
+    {
+      return Call (m_qbus, module, method, content);
+    }
+    
+#endif
+    
+    QBus qbus () { return m_qbus; }
+    
+  private:
+    
+    static void throw_err (CapeErr err)
+    {
+      std::runtime_error e (cape_err_text (err));
+      
+      cape_err_del (&err);
+      
+      throw e;
+    }
+    
+    template <typename T> static int __STDCALL on_request (QBus qbus, void* ptr, QBusM qin, QBusM qout, CapeErr err)
+    {
+      Message msg (qbus, qin, qout);
+      
+      try
+      {
+        detail::callable_get<T> (ptr) (msg);
+      }
+      catch (std::exception& e)
+      {
+        return cape_err_set (err, CAPE_ERR_RUNTIME, e.what());
+      }
+      catch (...)
+      {
+        // exceptions must not pass the C callback
+        return cape_err_set (err, CAPE_ERR_RUNTIME, "unknown exception");
+      }
+      
+      return msg.ret();
+    }
+    
+    template <typename I, typename O, typename T> static int __STDCALL on_payload (QBus qbus, void* ptr, const char* bufdat, number_t buflen, CapeStream reply, CapeErr err)
+    {
+      try
+      {
+        I in;
+        O out;
+        
+        schema::decode (in, bufdat, buflen);
+        
+        detail::callable_get<T> (ptr) (in, out);
+        
+        schema::encode (out, reply);
+      }
+      catch (std::exception& e)
+      {
+        return cape_err_set (err, CAPE_ERR_RUNTIME, e.what());
+      }
+      catch (...)
+      {
+        return cape_err_set (err, CAPE_ERR_RUNTIME, "unknown exception");
+      }
+      
+      return CAPE_ERR_NONE;
+    }
+    
+    template <typename T> static int __STDCALL on_raw_request (QBus qbus, void* ptr, QBusRaw raw, CapeErr err)
+    {
+      try
+      {
+        return detail::callable_get<T> (ptr) (raw);
+      }
+      catch (std::exception& e)
+      {
+        return cape_err_set (err, CAPE_ERR_RUNTIME, e.what());
+      }
+      catch (...)
+      {
+        return cape_err_set (err, CAPE_ERR_RUNTIME, "unknown exception");
+      }
+    }
+    
+    template <typename T> static int __STDCALL on_raw_response (QBus qbus, void* ptr, QBusRaw raw, CapeErr err)
+    {
+      try
+      {
+        detail::callable_get<T> (ptr) (raw);
+      }
+      catch (std::exception& e)
+      {
+        cape_log_fmt (CAPE_LL_ERROR, "QBUS", "response", "unhandled exception: %s", e.what());
+      }
+      catch (...)
+      {
+        cape_log_msg (CAPE_LL_ERROR, "QBUS", "response", "unhandled exception");
+      }
+      
+      // the callable is released by on_removed
+      return CAPE_ERR_NONE;
+    }
+    
+    template <typename T> static void __STDCALL on_removed (void* ptr)
+    {
+      detail::callable_release<T> (ptr);
+    }
+    
+    template <typename T> static int __STDCALL on_response (QBus qbus, void* ptr, QBusM qin, QBusM qout, CapeErr err)
+    {
+      Response res (qin);
+      
+      try
+      {
+        detail::callable_get<T> (ptr) (res);
+      }
+      catch (std::exception& e)
+      {
+        cape_log_fmt (CAPE_LL_ERROR, "QBUS", "response", "unhandled exception: %s", e.what());
+      }
+      catch (...)
+      {
+        cape_log_msg (CAPE_LL_ERROR, "QBUS", "response", "unhandled exception");
+      }
+      
+      // the callable is released by on_removed
+      return CAPE_ERR_NONE;
+    }
+    
+    QBus m_qbus;
+    
+  };
   
 }
 